@@ -0,0 +1,127 @@
+#include "AccessLog.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "base/AsyncLogging.h"
+#include "base/CurrentThread.h"
+
+std::string AccessLog::fileName_ = "./access.log";
+bool AccessLog::enabled_ = false;
+AccessLogFormat AccessLog::format_ = kAccessLogCommon;
+double AccessLog::sampleRatio_ = 1.0;
+
+static pthread_once_t accessOnce_ = PTHREAD_ONCE_INIT;
+static AsyncLogging* accessLogger_;
+
+static void accessLogInit() {
+  accessLogger_ = new AsyncLogging(AccessLog::getFileName());
+  accessLogger_->start();
+}
+
+void AccessLog::setSampleRatio(double ratio) {
+  if (ratio > 1.0) ratio = 1.0;
+  if (ratio < 0.0) ratio = 0.0;
+  sampleRatio_ = ratio;
+}
+
+void AccessLog::output(const char* data, int len) {
+  pthread_once(&accessOnce_, accessLogInit);
+  accessLogger_->append(data, len);
+}
+
+namespace {
+// 同一秒内的记录复用已格式化的时间串，省掉localtime_r/strftime
+__thread time_t t_lastSecond = 0;
+__thread char t_timeStr[32];
+__thread int t_timeLen = 0;
+
+void appendTime(LogStream& stream, int64_t timeUs) {
+  time_t seconds = static_cast<time_t>(timeUs / 1000000);
+  if (seconds != t_lastSecond) {
+    struct tm tm_time;
+    localtime_r(&seconds, &tm_time);
+    t_timeLen = static_cast<int>(
+        strftime(t_timeStr, sizeof t_timeStr, "%d/%b/%Y:%H:%M:%S %z", &tm_time));
+    t_lastSecond = seconds;
+  }
+  stream.append(t_timeStr, t_timeLen);
+}
+
+void appendPeer(LogStream& stream, const AccessRecord& record) {
+  char ip[INET_ADDRSTRLEN];
+  struct in_addr addr;
+  addr.s_addr = record.peerAddr;
+  if (inet_ntop(AF_INET, &addr, ip, sizeof ip) == NULL) strcpy(ip, "-");
+  stream << ip << ':' << ntohs(record.peerPort);
+}
+
+// JSON字符串转义，只处理路径里可能出现的字符
+void appendJsonString(LogStream& stream, const char* str, int len) {
+  static const char hex[] = "0123456789abcdef";
+  stream << '"';
+  for (int i = 0; i < len; ++i) {
+    unsigned char c = static_cast<unsigned char>(str[i]);
+    if (c == '"' || c == '\\') {
+      stream << '\\' << static_cast<char>(c);
+    } else if (c < 0x20) {
+      char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+      stream.append(esc, sizeof esc);
+    } else {
+      stream << static_cast<char>(c);
+    }
+  }
+  stream << '"';
+}
+}  // namespace
+
+void AccessLog::format(LogStream& stream, const AccessRecord& record) {
+  if (format_ == kAccessLogJson) {
+    stream << "{\"ts_us\":" << record.timeUs << ",\"peer\":\"";
+    appendPeer(stream, record);
+    stream << "\",\"method\":\"" << record.method << "\",\"path\":";
+    appendJsonString(stream, record.path, record.pathLen);
+    stream << ",\"status\":" << record.status << ",\"bytes\":" << record.bytes
+           << ",\"latency_us\":" << record.latencyUs
+           << ",\"loop\":" << record.loopId << "}\n";
+  } else {
+    // 类似Common Log Format，末尾追加耗时和loop
+    appendPeer(stream, record);
+    stream << " - - [";
+    appendTime(stream, record.timeUs);
+    stream << "] \"" << record.method << ' ';
+    stream.append(record.path, record.pathLen);
+    stream << "\" " << record.status << ' ' << record.bytes << ' '
+           << record.latencyUs << "us loop=" << record.loopId << '\n';
+  }
+}
+
+AccessLogBatch::AccessLogBatch() : count_(0), sampleCredit_(0.0) {}
+
+AccessRecord* AccessLogBatch::begin() {
+  if (!AccessLog::enabled()) return NULL;
+  // 按比例累积额度，保证长期看恰好是ratio的请求被记录
+  sampleCredit_ += AccessLog::getSampleRatio();
+  if (sampleCredit_ < 1.0) return NULL;
+  sampleCredit_ -= 1.0;
+  return &records_[count_];
+}
+
+void AccessLogBatch::commit() {
+  records_[count_].loopId = CurrentThread::tid();
+  if (++count_ == kBatchSize) flush();
+}
+
+void AccessLogBatch::flush() {
+  if (count_ == 0) return;
+  buffer_.reset();
+  LogStream stream;
+  for (int i = 0; i < count_; ++i) {
+    stream.resetBuffer();
+    AccessLog::format(stream, records_[i]);
+    buffer_.append(stream.buffer().data(), stream.buffer().length());
+  }
+  count_ = 0;
+  AccessLog::output(buffer_.data(), buffer_.length());
+}
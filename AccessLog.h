@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include "base/LogStream.h"
+#include "base/noncopyable.h"
+
+// 一条访问日志记录，定长，请求结束时由HttpData直接填写，不做任何分配
+struct AccessRecord {
+  static const int kMaxPath = 128;
+  const char* method;  // 指向静态字符串
+  int status;
+  uint64_t bytes;      // 响应字节数
+  uint64_t latencyUs;  // 从读到请求到响应入队的耗时
+  int64_t timeUs;      // 请求完成时刻
+  uint32_t peerAddr;   // 网络字节序IPv4
+  uint16_t peerPort;   // 网络字节序
+  int loopId;          // 所属EventLoop线程的tid
+  int pathLen;
+  char path[kMaxPath];
+};
+
+enum AccessLogFormat { kAccessLogCommon = 0, kAccessLogJson };
+
+// 访问日志的全局配置和输出，底层是一个独立文件的AsyncLogging
+class AccessLog {
+ public:
+  // 设置文件名即开启访问日志，需在服务启动前调用
+  static void setFileName(const std::string& fileName) {
+    fileName_ = fileName;
+    enabled_ = true;
+  }
+  static const std::string& getFileName() { return fileName_; }
+  static bool enabled() { return enabled_; }
+  static void setFormat(AccessLogFormat format) { format_ = format; }
+  static AccessLogFormat getFormat() { return format_; }
+  // 采样比例，(0, 1]，1表示每个请求都记录
+  static void setSampleRatio(double ratio);
+  static double getSampleRatio() { return sampleRatio_; }
+
+  // 把已格式化好的一批记录交给异步日志
+  static void output(const char* data, int len);
+  // 按当前格式把一条记录追加到stream
+  static void format(LogStream& stream, const AccessRecord& record);
+
+ private:
+  static std::string fileName_;
+  static bool enabled_;
+  static AccessLogFormat format_;
+  static double sampleRatio_;
+};
+
+// 每个EventLoop持有一个，只在loop线程内使用，因此无需加锁。
+// 攒满kBatchSize条或者一轮loop结束时一次性写入异步日志。
+class AccessLogBatch : noncopyable {
+ public:
+  static const int kBatchSize = 64;
+
+  AccessLogBatch();
+  // 按采样比例决定本次请求是否记录，返回待填写的记录或NULL
+  AccessRecord* begin();
+  // 填写完毕，满了就flush
+  void commit();
+  void flush();
+
+ private:
+  AccessRecord records_[kBatchSize];
+  int count_;
+  double sampleCredit_;
+  FixedBuffer<kSmallBuffer * 16> buffer_;
+};
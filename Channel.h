@@ -81,6 +81,7 @@ class Channel {
   void handleConn();
 
   void setRevents(__uint32_t ev) { revents_ = ev; }
+  __uint32_t getRevents() const { return revents_; }
 
   void setEvents(__uint32_t ev) { events_ = ev; }
   __uint32_t &getEvents() { return events_; }
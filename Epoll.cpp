@@ -7,6 +7,7 @@
 #include <sys/socket.h>
 #include <deque>
 #include <queue>
+#include "Metrics.h"
 #include "Util.h"
 #include "base/Logging.h"
 
@@ -80,7 +81,13 @@ std::vector<SP_Channel> Epoll::poll() {
   while (true) {
     int event_count =
         epoll_wait(epollFd_, &*events_.begin(), events_.size(), EPOLLWAIT_TIME);
-    if (event_count < 0) perror("epoll wait error");
+    if (event_count < 0) {
+      perror("epoll wait error");
+    } else {
+      Metrics::add(kMetricEpollWakeups);
+      Metrics::add(kMetricEpollEvents, event_count);
+      Metrics::record(kMetricEventsPerWakeup, event_count);
+    }
     std::vector<SP_Channel> req_data = getEventsRequest(event_count);
     if (req_data.size() > 0) return req_data;
   }
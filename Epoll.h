@@ -20,6 +20,7 @@ class Epoll {
   void add_timer(std::shared_ptr<Channel> request_data, int timeout);
   int getEpollFd() { return epollFd_; }
   void handleExpired();
+  size_t timerCount() const { return timerManager_.size(); }
 
  private:
   static const int MAXFDS = 100000;
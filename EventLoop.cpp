@@ -1,7 +1,11 @@
 #include "EventLoop.h"
+#include <cxxabi.h>
+#include <stdlib.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <time.h>
 #include <iostream>
+#include "Metrics.h"
 #include "Util.h"
 #include "base/Logging.h"
 
@@ -10,6 +14,15 @@ using namespace std;
 // __threadֲ߳̾洢ÿ̶߳Լıʵ
 __thread EventLoop* t_loopInThisThread = 0;
 
+bool EventLoop::instrumented_ = false;
+int64_t EventLoop::stallThresholdUs_ = 0;
+
+static int64_t monotonicMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 int createEventfd() {
   int evtfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
   if (evtfd < 0) {
@@ -98,17 +111,83 @@ void EventLoop::loop() {
   while (!quit_) {
     // cout << "doing" << endl;
     ret.clear();
+    if (instrumented_) {
+      loopOnceTimed(ret);
+      continue;
+    }
     ret = poller_->poll();
     eventHandling_ = true;
     for (auto& it : ret) it->handleEvents();
     eventHandling_ = false;
     doPendingFunctors();
     poller_->handleExpired();   //Լ
+    Metrics::set(kMetricTimerQueueSize, poller_->timerCount());
+    accessLog_.flush();
   }
   looping_ = false;
 }
 
-void EventLoop::doPendingFunctors() {
+// loop()һֻͬÿ׶ǰȡһʱ
+void EventLoop::loopOnceTimed(std::vector<SP_Channel>& ret) {
+  int64_t start = monotonicMicros();
+  ret = poller_->poll();
+  int64_t polled = monotonicMicros();
+
+  eventHandling_ = true;
+  int64_t last = polled;
+  int64_t slowChannelUs = 0;
+  int slowFd = -1;
+  __uint32_t slowRevents = 0;
+  for (auto& it : ret) {
+    __uint32_t revents = it->getRevents();
+    it->handleEvents();
+    int64_t now = monotonicMicros();
+    if (now - last > slowChannelUs) {
+      slowChannelUs = now - last;
+      slowFd = it->getFd();
+      slowRevents = revents;
+    }
+    last = now;
+  }
+  eventHandling_ = false;
+  int64_t handled = last;
+
+  int64_t slowFunctorUs = 0;
+  const char* slowFunctorType = "";
+  size_t functorNum = doPendingFunctors(&slowFunctorUs, &slowFunctorType);
+  int64_t called = monotonicMicros();
+
+  poller_->handleExpired();
+  Metrics::set(kMetricTimerQueueSize, poller_->timerCount());
+  accessLog_.flush();
+  int64_t end = monotonicMicros();
+
+  Metrics::record(kMetricLoopPoll, polled - start);
+  Metrics::record(kMetricLoopEvents, handled - polled);
+  Metrics::record(kMetricLoopFunctors, called - handled);
+  Metrics::record(kMetricLoopTimers, end - called);
+
+  // epoll_waitĵȴ㿨٣ֻ֮æ˶
+  int64_t busy = end - polled;
+  if (stallThresholdUs_ > 0 && busy > stallThresholdUs_) {
+    Metrics::add(kMetricLoopStalls);
+    int status = 0;
+    char* demangled =
+        abi::__cxa_demangle(slowFunctorType, NULL, NULL, &status);
+    LOG << "EventLoop stall: iteration busy " << busy << "us (events "
+        << handled - polled << "us over " << ret.size() << " channels, functors "
+        << called - handled << "us over " << functorNum << ", timers "
+        << end - called << "us); slowest channel fd=" << slowFd
+        << " revents=" << slowRevents << " took " << slowChannelUs
+        << "us; slowest functor "
+        << (status == 0 ? demangled : slowFunctorType) << " took "
+        << slowFunctorUs << "us";
+    free(demangled);
+  }
+}
+
+size_t EventLoop::doPendingFunctors(int64_t* slowestUs,
+                                    const char** slowestType) {
   std::vector<Functor> functors;
   callingPendingFunctors_ = true;
 
@@ -116,9 +195,25 @@ void EventLoop::doPendingFunctors() {
     MutexLockGuard lock(mutex_);
     functors.swap(pendingFunctors_);
   }
+  Metrics::set(kMetricPendingFunctors, functors.size());
 
-  for (size_t i = 0; i < functors.size(); ++i) functors[i]();
+  if (slowestUs) {
+    int64_t last = monotonicMicros();
+    for (size_t i = 0; i < functors.size(); ++i) {
+      functors[i]();
+      int64_t now = monotonicMicros();
+      if (now - last > *slowestUs) {
+        *slowestUs = now - last;
+        // صbindģܿ󶨵ĸԱ
+        *slowestType = functors[i].target_type().name();
+      }
+      last = now;
+    }
+  } else {
+    for (size_t i = 0; i < functors.size(); ++i) functors[i]();
+  }
   callingPendingFunctors_ = false;
+  return functors.size();
 }
 
 void EventLoop::quit() {
@@ -2,6 +2,7 @@
 #include <functional>
 #include <memory>
 #include <vector>
+#include "AccessLog.h"
 #include "Channel.h"
 #include "Epoll.h"
 #include "Util.h"
@@ -35,6 +36,15 @@ class EventLoop {
   void addToPoller(shared_ptr<Channel> channel, int timeout = 0) {
     poller_->epoll_add(channel, timeout);
   }
+  pid_t threadId() const { return threadId_; }
+  // 统计每轮loop各阶段(epoll_wait/处理事件/回调/定时器)的耗时，在loop()之前设置。
+  // stallThresholdMs > 0 时，一轮忙碌时间超过阈值就打日志，指出最慢的channel和回调
+  static void enableInstrumentation(int stallThresholdMs) {
+    instrumented_ = true;
+    stallThresholdUs_ = stallThresholdMs > 0 ? stallThresholdMs * 1000 : 0;
+  }
+  // 本loop的访问日志批次，只能在loop线程内使用
+  AccessLogBatch& accessLog() { return accessLog_; }
 
  private:
   // 声明顺序 wakeupFd_ > pwakeupChannel_
@@ -48,9 +58,15 @@ class EventLoop {
   bool callingPendingFunctors_;
   const pid_t threadId_;
   shared_ptr<Channel> pwakeupChannel_;
+  AccessLogBatch accessLog_;
+  static bool instrumented_;
+  static int64_t stallThresholdUs_;
 
   void wakeup();
   void handleRead();
-  void doPendingFunctors();
+  void loopOnceTimed(std::vector<SP_Channel>& ret);
+  // slowestUs不为空时顺便统计最慢的回调，返回执行的回调个数
+  size_t doPendingFunctors(int64_t* slowestUs = NULL,
+                           const char** slowestType = NULL);
   void handleConn();
 };
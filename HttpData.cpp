@@ -2,9 +2,12 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <iostream>
 #include "Channel.h"
 #include "EventLoop.h"
+#include "Metrics.h"
+#include "Trace.h"
 #include "Util.h"
 #include "time.h"
 
@@ -16,6 +19,12 @@ std::unordered_map<std::string, std::string> MimeType::mime;
 const __uint32_t DEFAULT_EVENT = EPOLLIN | EPOLLET | EPOLLONESHOT;
 const int DEFAULT_EXPIRED_TIME = 2000;              // ms
 const int DEFAULT_KEEP_ALIVE_TIME = 5 * 60 * 1000;  // ms
+
+static int64_t nowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
 //favicon数组包含了PNG文件的二进制数据
 char favicon[555] = {
     '\x89', 'P',    'N',    'G',    '\xD',  '\xA',  '\x1A', '\xA',  '\x0',
@@ -118,11 +127,20 @@ HttpData::HttpData(EventLoop *loop, int connfd)
       nowReadPos_(0),
       state_(STATE_PARSE_URI),
       hState_(H_START),
-      keepAlive_(false) {
+      keepAlive_(false),
+      requestStartUs_(0) {
+  memset(&peerAddr_, 0, sizeof peerAddr_);
   // loop_->queueInLoop(bind(&HttpData::setHandlers, this));
   channel_->setReadHandler(bind(&HttpData::handleRead, this));
   channel_->setWriteHandler(bind(&HttpData::handleWrite, this));
   channel_->setConnHandler(bind(&HttpData::handleConn, this));
+  TRACE2(conn_create, fd_, this);
+}
+
+HttpData::~HttpData() {
+  TRACE1(conn_close, fd_);
+  Metrics::add(kMetricConnClosed);
+  close(fd_);
 }
 
 void HttpData::reset() {
@@ -133,6 +151,7 @@ void HttpData::reset() {
   state_ = STATE_PARSE_URI;
   hState_ = H_START;
   headers_.clear();
+  requestStartUs_ = 0;
   // keepAlive_ = false;
   if (timer_.lock()) {
     shared_ptr<TimerNode> my_timer(timer_.lock());
@@ -156,6 +175,7 @@ void HttpData::handleRead() {
   do {
     bool zero = false;
     int read_num = readn(fd_, inBuffer_, zero);
+    if (read_num > 0) Metrics::add(kMetricBytesIn, read_num);
     LOG << "Request: " << inBuffer_;
     if (connectionState_ == H_DISCONNECTING) {
       inBuffer_.clear();
@@ -186,6 +206,8 @@ void HttpData::handleRead() {
       // cout << "readnum == 0" << endl;
     }
 
+    if (state_ == STATE_PARSE_URI && requestStartUs_ == 0 && !inBuffer_.empty())
+      requestStartUs_ = nowMicros();
     if (state_ == STATE_PARSE_URI) {
       URIState flag = this->parseURI();
       if (flag == PARSE_URI_AGAIN)
@@ -231,8 +253,10 @@ void HttpData::handleRead() {
       state_ = STATE_ANALYSIS;
     }
     if (state_ == STATE_ANALYSIS) {
+      TRACE3(request_parsed, fd_, static_cast<int>(method_), fileName_.c_str());
       AnalysisState flag = this->analysisRequest();
       if (flag == ANALYSIS_SUCCESS) {
+        logAccess(200, outBuffer_.size());
         state_ = STATE_FINISH;
         break;
       } else {
@@ -269,12 +293,16 @@ void HttpData::handleRead() {
 void HttpData::handleWrite() {
   if (!error_ && connectionState_ != H_DISCONNECTED) {
     __uint32_t &events_ = channel_->getEvents();
-    if (writen(fd_, outBuffer_) < 0) {
+    ssize_t written = writen(fd_, outBuffer_);
+    if (written < 0) {
       perror("writen");
       events_ = 0;
       error_ = true;
     }
-    if (outBuffer_.size() > 0) events_ |= EPOLLOUT;
+    if (outBuffer_.size() > 0)
+      events_ |= EPOLLOUT;
+    else if (written > 0)
+      TRACE2(write_complete, fd_, written);
   }
 }
 
@@ -321,7 +349,7 @@ URIState HttpData::parseURI() {
   string cop = str;
   // 读到完整的请求行再开始解析请求
   size_t pos = str.find('\r', nowReadPos_);
-  if (pos < 0) {
+  if (pos == string::npos) {
     return PARSE_URI_AGAIN;
   }
   // 去掉请求行所占的空间，节省空间
@@ -460,7 +488,9 @@ HeaderState HttpData::parseHeaders() {
       }
       case H_END_CR: {
         if (str[i] == '\n') {
+          // 头部到此结束，后面可能是pipeline的下一个请求，不能再多吃一个字符
           hState_ = H_END_LF;
+          notFinish = false;
         } else
           return PARSE_HEADER_ERROR;
         break;
@@ -524,10 +554,19 @@ AnalysisState HttpData::analysisRequest() {
     else
       filetype = MimeType::getMime(fileName_.substr(dot_pos));
 
+    if (fileName_ == Metrics::kPath) {
+      string body = Metrics::scrape();
+      header += "Content-Type: text/plain; version=0.0.4\r\n";
+      header += "Content-Length: " + to_string(body.size()) + "\r\n\r\n";
+      outBuffer_ = header;
+      if (method_ != METHOD_HEAD) outBuffer_ += body;
+      return ANALYSIS_SUCCESS;
+    }
     // echo test
     if (fileName_ == "hello" || fileName_ == "index.html") {
-      outBuffer_ =
-          "HTTP/1.1 200 OK\r\nContent-type: text/plain\r\n\r\nHello World";
+      // 带上Content-Length，keep-alive的客户端才知道响应在哪结束
+      header += "Content-type: text/plain\r\nContent-Length: 11\r\n\r\n";
+      outBuffer_ = header + "Hello World";
       return ANALYSIS_SUCCESS;
     }
     if (fileName_ == "favicon.ico") {
@@ -602,6 +641,32 @@ void HttpData::handleError(int fd, int err_num, string short_msg) {
   writen(fd, send_buff, strlen(send_buff));
   sprintf(send_buff, "%s", body_buff.c_str());
   writen(fd, send_buff, strlen(send_buff));
+  logAccess(err_num, header_buff.size() + body_buff.size());
+}
+
+// 请求结束时填一条访问日志记录，交给本loop的批次
+void HttpData::logAccess(int status, size_t bytes) {
+  int64_t now = nowMicros();
+  uint64_t latency = requestStartUs_ > 0 ? now - requestStartUs_ : 0;
+  Metrics::recordRequest(status, bytes, latency);
+  TRACE3(response_queued, fd_, status, bytes);
+  AccessRecord *record = loop_->accessLog().begin();
+  if (!record) return;
+  static const char *const methodNames[] = {"-", "POST", "GET", "HEAD"};
+  record->method = methodNames[method_];
+  record->status = status;
+  record->bytes = bytes;
+  record->latencyUs = latency;
+  record->timeUs = now;
+  record->peerAddr = peerAddr_.sin_addr.s_addr;
+  record->peerPort = peerAddr_.sin_port;
+  size_t len = fileName_.size();
+  if (len + 1 > static_cast<size_t>(AccessRecord::kMaxPath))
+    len = AccessRecord::kMaxPath - 1;
+  record->path[0] = '/';
+  memcpy(record->path + 1, fileName_.data(), len);
+  record->pathLen = static_cast<int>(len + 1);
+  loop_->accessLog().commit();
 }
 
 void HttpData::handleClose() {
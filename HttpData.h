@@ -1,4 +1,6 @@
 #pragma once
+#include <netinet/in.h>
+#include <stdint.h>
 #include <sys/epoll.h>
 #include <unistd.h>
 #include <functional>
@@ -70,7 +72,7 @@ class MimeType {
 class HttpData : public std::enable_shared_from_this<HttpData> {
  public:
   HttpData(EventLoop *loop, int connfd);
-  ~HttpData() { close(fd_); }
+  ~HttpData();
   void reset();
   void seperateTimer();
   void linkTimer(std::shared_ptr<TimerNode> mtimer) {
@@ -78,7 +80,9 @@ class HttpData : public std::enable_shared_from_this<HttpData> {
     timer_ = mtimer;
   }
   std::shared_ptr<Channel> getChannel() { return channel_; }
+  int getFd() const { return fd_; }
   EventLoop *getLoop() { return loop_; }
+  void setPeer(const struct sockaddr_in &addr) { peerAddr_ = addr; }
   void handleClose();
   void newEvent();
 
@@ -101,6 +105,8 @@ class HttpData : public std::enable_shared_from_this<HttpData> {
   bool keepAlive_;
   std::map<std::string, std::string> headers_;
   std::weak_ptr<TimerNode> timer_;
+  struct sockaddr_in peerAddr_;
+  int64_t requestStartUs_;
 
   void handleRead();
   void handleWrite();
@@ -109,4 +115,5 @@ class HttpData : public std::enable_shared_from_this<HttpData> {
   URIState parseURI();
   HeaderState parseHeaders();
   AnalysisState analysisRequest();
+  void logAccess(int status, size_t bytes);
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <getopt.h>
 #include <string>
+#include "AccessLog.h"
 #include "EventLoop.h"
 #include "Server.h"
 #include "base/Logging.h"
@@ -12,7 +13,7 @@ int main(int argc, char *argv[]) {
 
   // parse args
   int opt;
-  const char *str = "t:l:p:";
+  const char *str = "t:l:p:a:r:js:";
   while ((opt = getopt(argc, argv, str)) != -1) {
     switch (opt) {
       case 't': {
@@ -31,6 +32,24 @@ int main(int argc, char *argv[]) {
         port = atoi(optarg);
         break;
       }
+      // 访问日志：-a 文件路径，-r 采样比例，-j 输出JSON格式
+      case 'a': {
+        AccessLog::setFileName(optarg);
+        break;
+      }
+      case 'r': {
+        AccessLog::setSampleRatio(atof(optarg));
+        break;
+      }
+      case 'j': {
+        AccessLog::setFormat(kAccessLogJson);
+        break;
+      }
+      // -s 毫秒：统计loop各阶段耗时，单轮忙碌超过该值时打日志
+      case 's': {
+        EventLoop::enableInstrumentation(atoi(optarg));
+        break;
+      }
       default:
         break;
     }
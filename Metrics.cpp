@@ -0,0 +1,277 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <vector>
+#include "base/CurrentThread.h"
+#include "base/Logging.h"
+#include "base/MutexLock.h"
+
+const char Metrics::kPath[] = "metrics";
+
+namespace {
+
+// 每个槽只有所属线程会写，所以用relaxed的load+store代替fetch_add，
+// atomic只是为了让抓取线程读到完整的值
+struct alignas(64) Slot {
+  std::atomic<uint64_t> counters[kMetricCounterNum];
+  std::atomic<int64_t> gauges[kMetricGaugeNum];
+  std::atomic<uint64_t> buckets[kMetricHistogramNum][Metrics::kBuckets];
+  std::atomic<uint64_t> sums[kMetricHistogramNum];
+  std::atomic<bool> hasGauges;
+  int tid;
+};
+
+MutexLock g_slotsMutex;
+std::vector<Slot*> g_slots;
+__thread Slot* t_slot = NULL;
+
+Slot* registerSlot() {
+  void* mem = NULL;
+  if (posix_memalign(&mem, 64, sizeof(Slot)) != 0) abort();
+  Slot* slot = new (mem) Slot;
+  for (int i = 0; i < kMetricCounterNum; ++i) slot->counters[i] = 0;
+  for (int i = 0; i < kMetricGaugeNum; ++i) slot->gauges[i] = 0;
+  for (int h = 0; h < kMetricHistogramNum; ++h) {
+    for (int i = 0; i < Metrics::kBuckets; ++i) slot->buckets[h][i] = 0;
+    slot->sums[h] = 0;
+  }
+  slot->hasGauges = false;
+  slot->tid = CurrentThread::tid();
+  // 线程退出后槽位也不回收，保证计数器单调不减
+  MutexLockGuard lock(g_slotsMutex);
+  g_slots.push_back(slot);
+  t_slot = slot;
+  return slot;
+}
+
+inline Slot* localSlot() { return t_slot ? t_slot : registerSlot(); }
+
+template <typename T>
+inline void increase(std::atomic<T>& value, T n) {
+  value.store(value.load(std::memory_order_relaxed) + n,
+              std::memory_order_relaxed);
+}
+
+const char* const kCounterNames[kMetricCounterNum][2] = {
+    {"webserver_connections_accepted_total", "Connections accepted."},
+    {"webserver_connections_rejected_total",
+     "Connections closed right after accept because of the fd limit."},
+    {"webserver_connections_closed_total", "Connections closed."},
+    {"", ""},
+    {"", ""},
+    {"", ""},
+    {"", ""},
+    {"webserver_bytes_received_total", "Bytes read from clients."},
+    {"webserver_bytes_sent_total", "Response bytes sent to clients."},
+    {"webserver_epoll_wakeups_total", "Returns from epoll_wait."},
+    {"webserver_epoll_events_total", "Events returned by epoll_wait."},
+    {"webserver_loop_stalls_total",
+     "Loop iterations that stayed busy longer than the stall threshold."},
+};
+
+const char* const kLoopPhases[] = {"poll", "events", "functors", "timers"};
+
+const char* const kGaugeNames[kMetricGaugeNum][2] = {
+    {"webserver_loop_pending_functors",
+     "Functors drained from the pending queue in the last loop iteration."},
+    {"webserver_loop_timer_queue_size", "Entries in the loop's timer heap."},
+};
+
+void appendHeader(std::string& out, const char* name, const char* help,
+                  const char* type) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+void appendValue(std::string& out, const char* name, const char* labels,
+                 double value) {
+  char buf[32];
+  // 计数值按整数原样输出，其余保留9位有效数字
+  if (value == static_cast<double>(static_cast<int64_t>(value)))
+    snprintf(buf, sizeof buf, " %.0f\n", value);
+  else
+    snprintf(buf, sizeof buf, " %.9g\n", value);
+  out += name;
+  out += labels;
+  out += buf;
+}
+
+// 导出一个直方图的数据行，labels是除le以外的标签(可以为空)，
+// scale把内部单位换算成导出单位
+void appendHistogram(std::string& out, const char* name, const char* labels,
+                     const uint64_t* buckets, uint64_t sum, double scale) {
+  char allLabels[128];
+  char metric[128];
+  const char* sep = labels[0] ? "," : "";
+  snprintf(metric, sizeof metric, "%s_bucket", name);
+  uint64_t cumulative = 0;
+  for (int i = 0; i < Metrics::kBuckets - 1; ++i) {
+    cumulative += buckets[i];
+    snprintf(allLabels, sizeof allLabels, "{%s%sle=\"%.9g\"}", labels, sep,
+             Metrics::bucketLimit(i) * scale);
+    appendValue(out, metric, allLabels, static_cast<double>(cumulative));
+  }
+  cumulative += buckets[Metrics::kBuckets - 1];
+  snprintf(allLabels, sizeof allLabels, "{%s%sle=\"+Inf\"}", labels, sep);
+  appendValue(out, metric, allLabels, static_cast<double>(cumulative));
+  snprintf(allLabels, sizeof allLabels, labels[0] ? "{%s}" : "%s", labels);
+  snprintf(metric, sizeof metric, "%s_sum", name);
+  appendValue(out, metric, allLabels, sum * scale);
+  snprintf(metric, sizeof metric, "%s_count", name);
+  appendValue(out, metric, allLabels, static_cast<double>(cumulative));
+}
+
+}  // namespace
+
+int Metrics::bucketOf(uint64_t value) {
+  int msb = 63 - __builtin_clzll(value | (kSubCount * 2 - 1));
+  int shift = msb - kSubBits;
+  if (shift > kMaxShift) return kBuckets - 1;
+  return shift * kSubCount + static_cast<int>(value >> shift);
+}
+
+uint64_t Metrics::bucketLimit(int index) {
+  int shift = index < kSubCount * 2 ? 0 : index / kSubCount - 1;
+  uint64_t sub = index - shift * kSubCount;
+  return ((sub + 1) << shift) - 1;
+}
+
+void Metrics::add(MetricCounter counter, uint64_t n) {
+  increase(localSlot()->counters[counter], n);
+}
+
+void Metrics::set(MetricGauge gauge, int64_t value) {
+  Slot* slot = localSlot();
+  slot->gauges[gauge].store(value, std::memory_order_relaxed);
+  slot->hasGauges.store(true, std::memory_order_relaxed);
+}
+
+void Metrics::record(MetricHistogram histogram, uint64_t value) {
+  Slot* slot = localSlot();
+  increase(slot->buckets[histogram][bucketOf(value)], static_cast<uint64_t>(1));
+  increase(slot->sums[histogram], value);
+}
+
+void Metrics::recordRequest(int status, uint64_t bytes, uint64_t latencyUs) {
+  Slot* slot = localSlot();
+  int cls = status / 100;
+  if (cls < 2) cls = 5;
+  if (cls > 5) cls = 5;
+  increase(slot->counters[kMetricRequests2xx + cls - 2],
+           static_cast<uint64_t>(1));
+  increase(slot->counters[kMetricBytesOut], bytes);
+  increase(slot->buckets[kMetricRequestLatency][bucketOf(latencyUs)],
+           static_cast<uint64_t>(1));
+  increase(slot->sums[kMetricRequestLatency], latencyUs);
+}
+
+std::string Metrics::scrape() {
+  std::vector<Slot*> slots;
+  {
+    MutexLockGuard lock(g_slotsMutex);
+    slots = g_slots;
+  }
+  uint64_t counters[kMetricCounterNum] = {0};
+  std::vector<uint64_t> buckets(kMetricHistogramNum * kBuckets, 0);
+  uint64_t sums[kMetricHistogramNum] = {0};
+  for (size_t s = 0; s < slots.size(); ++s) {
+    const Slot* slot = slots[s];
+    for (int i = 0; i < kMetricCounterNum; ++i)
+      counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+    for (int h = 0; h < kMetricHistogramNum; ++h) {
+      for (int i = 0; i < kBuckets; ++i)
+        buckets[h * kBuckets + i] +=
+            slot->buckets[h][i].load(std::memory_order_relaxed);
+      sums[h] += slot->sums[h].load(std::memory_order_relaxed);
+    }
+  }
+
+  std::string out;
+  out.reserve(16 * 1024);
+  for (int i = 0; i < kMetricCounterNum; ++i) {
+    if (i >= kMetricRequests2xx && i <= kMetricRequests5xx) continue;
+    appendHeader(out, kCounterNames[i][0], kCounterNames[i][1], "counter");
+    appendValue(out, kCounterNames[i][0], "", static_cast<double>(counters[i]));
+  }
+  // accept计在主线程的槽里，关闭计在loop线程的槽里，两者不是同一时刻读的，
+  // 所以活跃连接数只是近似值
+  int64_t active = static_cast<int64_t>(counters[kMetricConnAccepted]) -
+                   static_cast<int64_t>(counters[kMetricConnClosed]);
+  appendHeader(out, "webserver_connections_active", "Connections currently open.",
+               "gauge");
+  appendValue(out, "webserver_connections_active", "",
+              static_cast<double>(active > 0 ? active : 0));
+
+  appendHeader(out, "webserver_http_requests_total",
+               "HTTP requests completed, by status class.", "counter");
+  static const char* const kClasses[] = {"{code=\"2xx\"}", "{code=\"3xx\"}",
+                                         "{code=\"4xx\"}", "{code=\"5xx\"}"};
+  for (int i = 0; i < 4; ++i)
+    appendValue(out, "webserver_http_requests_total", kClasses[i],
+                static_cast<double>(counters[kMetricRequests2xx + i]));
+
+  for (int g = 0; g < kMetricGaugeNum; ++g) {
+    appendHeader(out, kGaugeNames[g][0], kGaugeNames[g][1], "gauge");
+    for (size_t s = 0; s < slots.size(); ++s) {
+      if (!slots[s]->hasGauges.load(std::memory_order_relaxed)) continue;
+      char labels[32];
+      snprintf(labels, sizeof labels, "{thread=\"%d\"}", slots[s]->tid);
+      appendValue(out, kGaugeNames[g][0], labels,
+                  static_cast<double>(
+                      slots[s]->gauges[g].load(std::memory_order_relaxed)));
+    }
+  }
+
+  appendHeader(out, "webserver_request_duration_seconds",
+               "Time from reading a request to queueing its response.",
+               "histogram");
+  appendHistogram(out, "webserver_request_duration_seconds", "",
+                  &buckets[kMetricRequestLatency * kBuckets],
+                  sums[kMetricRequestLatency], 1e-6);
+  appendHeader(out, "webserver_epoll_events_per_wakeup",
+               "Events returned by a single epoll_wait.", "histogram");
+  appendHistogram(out, "webserver_epoll_events_per_wakeup", "",
+                  &buckets[kMetricEventsPerWakeup * kBuckets],
+                  sums[kMetricEventsPerWakeup], 1.0);
+
+  // 各loop各阶段的耗时单独导出，只有开启了统计的loop才有数据
+  appendHeader(out, "webserver_loop_phase_seconds",
+               "Time spent in each phase of an event loop iteration.",
+               "histogram");
+  std::vector<uint64_t> local(kBuckets);
+  for (size_t s = 0; s < slots.size(); ++s) {
+    const Slot* slot = slots[s];
+    for (int h = kMetricLoopPoll; h <= kMetricLoopTimers; ++h) {
+      uint64_t count = 0;
+      for (int i = 0; i < kBuckets; ++i) {
+        local[i] = slot->buckets[h][i].load(std::memory_order_relaxed);
+        count += local[i];
+      }
+      if (count == 0) continue;
+      char labels[64];
+      snprintf(labels, sizeof labels, "thread=\"%d\",phase=\"%s\"", slot->tid,
+               kLoopPhases[h - kMetricLoopPoll]);
+      appendHistogram(out, "webserver_loop_phase_seconds", labels, &local[0],
+                      slot->sums[h].load(std::memory_order_relaxed), 1e-6);
+    }
+  }
+
+  appendHeader(out, "webserver_log_dropped_lines_total",
+               "Log lines dropped by the async logger.", "counter");
+  appendValue(out, "webserver_log_dropped_lines_total", "",
+              static_cast<double>(Logger::droppedLines()));
+  appendHeader(out, "webserver_log_dropped_bytes_total",
+               "Log bytes dropped by the async logger.", "counter");
+  appendValue(out, "webserver_log_dropped_bytes_total", "",
+              static_cast<double>(Logger::droppedBytes()));
+  return out;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// 只增不减的计数器，抓取时对所有线程求和
+enum MetricCounter {
+  kMetricConnAccepted = 0,
+  kMetricConnRejected,  // 超过MAXFDS被直接关掉的连接
+  kMetricConnClosed,
+  kMetricRequests2xx,
+  kMetricRequests3xx,
+  kMetricRequests4xx,
+  kMetricRequests5xx,
+  kMetricBytesIn,
+  kMetricBytesOut,
+  kMetricEpollWakeups,
+  kMetricEpollEvents,
+  kMetricLoopStalls,  // 单轮loop忙碌时间超过阈值的次数
+  kMetricCounterNum
+};
+
+// 瞬时值，由各个loop线程自己设置，抓取时按线程分别导出
+enum MetricGauge {
+  kMetricPendingFunctors = 0,  // 一轮loop取出的待执行回调数
+  kMetricTimerQueueSize,       // 定时器堆的大小
+  kMetricGaugeNum
+};
+
+enum MetricHistogram {
+  kMetricRequestLatency = 0,  // 微秒
+  kMetricEventsPerWakeup,
+  // 以下是EventLoop开启统计后每轮各阶段的耗时(微秒)，按loop分别导出
+  kMetricLoopPoll,
+  kMetricLoopEvents,
+  kMetricLoopFunctors,
+  kMetricLoopTimers,
+  kMetricHistogramNum
+};
+
+// 每个线程第一次上报时分配一块按cache line对齐的槽位，之后只写自己的槽，
+// 热路径上没有锁也没有带lock前缀的原子指令；/metrics抓取时才遍历所有槽汇总。
+// 直方图是对数-线性的：每个2的幂区间再等分kSubCount格。
+class Metrics {
+ public:
+  static const int kSubBits = 2;
+  static const int kSubCount = 1 << kSubBits;
+  static const int kMaxShift = 26;  // 超过2^28的值都记在最后一格
+  static const int kBuckets = kSubCount * (kMaxShift + 2);
+  // HttpData保留给/metrics的路径
+  static const char kPath[];
+
+  static void add(MetricCounter counter, uint64_t n = 1);
+  static void set(MetricGauge gauge, int64_t value);
+  static void record(MetricHistogram histogram, uint64_t value);
+  // 一个请求结束：按状态码计数，累加发送字节数，记录耗时
+  static void recordRequest(int status, uint64_t bytes, uint64_t latencyUs);
+
+  // 汇总所有线程的数据，生成Prometheus文本格式
+  static std::string scrape();
+
+  static int bucketOf(uint64_t value);
+  // 第index格能装下的最大值(含)，和Prometheus的le一致
+  static uint64_t bucketLimit(int index);
+};
@@ -2,18 +2,40 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <functional>
+#include "Metrics.h"
+#include "Trace.h"
 #include "Util.h"
 #include "base/Logging.h"
 
 Server::Server(EventLoop *loop, int threadNum, int port)
+    : Server(loop, threadNum, port, std::string(), socket_bind_listen(port)) {}
+
+Server::Server(EventLoop *loop, int threadNum, const std::string &unixPath)
+    : Server(loop, threadNum, 0, unixPath,
+             socket_bind_listen_unix(unixPath.c_str())) {}
+
+Server::Server(EventLoop *loop, int threadNum, int port,
+               const std::string &unixPath, int listenFd)
     : loop_(loop),
       threadNum_(threadNum),
       eventLoopThreadPool_(new EventLoopThreadPool(loop_, threadNum)),
       started_(false),
       acceptChannel_(new Channel(loop_)),
       port_(port),
-      listenFd_(socket_bind_listen(port_)) {
+      unixPath_(unixPath),
+      unixInode_(0),
+      listenFd_(listenFd) {
+  if (listenFd_ < 0) {
+    perror("socket bind listen failed");
+    abort();
+  }
+  // 记下自己建的socket文件，析构时只删它
+  struct stat st;
+  if (!unixPath_.empty() && lstat(unixPath_.c_str(), &st) == 0)
+    unixInode_ = st.st_ino;
   acceptChannel_->setFd(listenFd_);
   handle_for_sigpipe();
   if (setSocketNonBlocking(listenFd_) < 0) {
@@ -22,6 +44,15 @@ Server::Server(EventLoop *loop, int threadNum, int port)
   }
 }
 
+Server::~Server() {
+  // socket文件不会随进程退出消失，留着的话下次bind之前也会删掉。
+  // 路径上已经换成了别的文件(比如另一个服务器重新建的socket)就不动
+  struct stat st;
+  if (!unixPath_.empty() && lstat(unixPath_.c_str(), &st) == 0 &&
+      S_ISSOCK(st.st_mode) && st.st_ino == unixInode_)
+    unlink(unixPath_.c_str());
+}
+
 void Server::start() {
   eventLoopThreadPool_->start();
   // acceptChannel_->setEvents(EPOLLIN | EPOLLET | EPOLLONESHOT);
@@ -41,9 +72,19 @@ void Server::handNewConn() {
   while ((accept_fd = accept(listenFd_, (struct sockaddr *)&client_addr,
                              &client_addr_len)) > 0) 
   {
+    TRACE3(accept, accept_fd, client_addr.sin_addr.s_addr,
+           client_addr.sin_port);
     EventLoop *loop = eventLoopThreadPool_->getNextLoop();
-    LOG << "New connection from " << inet_ntoa(client_addr.sin_addr) << ":"
-        << ntohs(client_addr.sin_port);
+    bool local = client_addr.sin_family == AF_UNIX;
+    if (local) {
+      LOG << "New connection on " << unixPath_;
+    } else {
+      // inet_ntoa返回静态缓冲区，非线程安全
+      char peer_ip[INET_ADDRSTRLEN] = "-";
+      inet_ntop(AF_INET, &client_addr.sin_addr, peer_ip, sizeof peer_ip);
+      LOG << "New connection from " << peer_ip << ":"
+          << ntohs(client_addr.sin_port);
+    }
     // cout << "new connection" << endl;
     // cout << inet_ntoa(client_addr.sin_addr) << endl;
     // cout << ntohs(client_addr.sin_port) << endl;
@@ -56,6 +97,7 @@ void Server::handNewConn() {
     */
     // 限制服务器的最大并发连接数
     if (accept_fd >= MAXFDS) {
+      Metrics::add(kMetricConnRejected);
       close(accept_fd);
       continue;
     }
@@ -66,10 +108,16 @@ void Server::handNewConn() {
       return;
     }
 
-    setSocketNodelay(accept_fd);
+    if (!local) setSocketNodelay(accept_fd);
     // setSocketNoLinger(accept_fd);
+    Metrics::add(kMetricConnAccepted);
+    if (newConnCallback_) {
+      newConnCallback_(loop, accept_fd, client_addr);
+      continue;
+    }
     // 线程池新loop和新poller监听
     shared_ptr<HttpData> req_info(new HttpData(loop, accept_fd));
+    req_info->setPeer(client_addr);
     req_info->getChannel()->setHolder(req_info);
     loop->queueInLoop(std::bind(&HttpData::newEvent, req_info));
   }
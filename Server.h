@@ -1,17 +1,29 @@
 #pragma once
+#include <netinet/in.h>
+#include <sys/types.h>
+#include <functional>
 #include <memory>
+#include <string>
 #include "Channel.h"
 #include "EventLoop.h"
 #include "EventLoopThreadPool.h"
 
 class Server {
  public:
+  // 新连接交给谁处理：参数是分配到的IO线程loop、已设为非阻塞的fd、对端地址。
+  // 不设置时默认按HTTP连接处理
+  typedef std::function<void(EventLoop *, int, const struct sockaddr_in &)>
+      NewConnCallback;
+
   Server(EventLoop *loop, int threadNum, int port);
-  ~Server() {}
+  // 监听Unix域socket，新连接的对端地址只有sin_family(AF_UNIX)有意义
+  Server(EventLoop *loop, int threadNum, const std::string &unixPath);
+  ~Server();
   EventLoop *getLoop() const { return loop_; }
   void start();
   void handNewConn();
   void handThisConn() { loop_->updatePoller(acceptChannel_); }
+  void setNewConnCallback(NewConnCallback &&cb) { newConnCallback_ = cb; }
 
  private:
   EventLoop *loop_;
@@ -20,6 +32,12 @@ class Server {
   bool started_;
   std::shared_ptr<Channel> acceptChannel_;
   int port_;
+  std::string unixPath_;
+  ino_t unixInode_;
   int listenFd_;
+  NewConnCallback newConnCallback_;
   static const int MAXFDS = 100000;
+
+  Server(EventLoop *loop, int threadNum, int port, const std::string &unixPath,
+         int listenFd);
 };
\ No newline at end of file
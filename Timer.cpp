@@ -2,6 +2,7 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <queue>
+#include "Trace.h"
 
 TimerNode::TimerNode(std::shared_ptr<HttpData> requestData, int timeout)
     : deleted_(false), SPHttpData(requestData) {
@@ -13,7 +14,11 @@ TimerNode::TimerNode(std::shared_ptr<HttpData> requestData, int timeout)
 }
 
 TimerNode::~TimerNode() {
-  if (SPHttpData) SPHttpData->handleClose();
+  // 没被clearReq过的节点析构意味着连接超时
+  if (SPHttpData) {
+    TRACE1(timer_expire, SPHttpData->getFd());
+    SPHttpData->handleClose();
+  }
 }
 
 TimerNode::TimerNode(TimerNode &tn)
@@ -41,6 +41,7 @@ class TimerManager {
   ~TimerManager();
   void addTimer(std::shared_ptr<HttpData> SPHttpData, int timeout);
   void handleExpiredEvent();
+  size_t size() const { return timerNodeQueue.size(); }
 
  private:
   typedef std::shared_ptr<TimerNode> SPTimerNode;
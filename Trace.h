@@ -0,0 +1,43 @@
+#pragma once
+// USDT静态探针，provider为webserver。
+// 有<sys/sdt.h>(systemtap-sdt-dev)时每个探针只编译成一条nop加一段ELF note，
+// 没有被perf/bpftrace附加时几乎没有开销；没有这个头文件或定义了
+// WEBSERVER_NO_USDT时宏展开为空，参数也不会被求值。
+//
+// 查看探针：  readelf -n WebServer | grep -A2 stapsdt
+// 示例：      bpftrace -e 'usdt:./WebServer:webserver:response_queued
+//                          { @[arg1] = count(); }'
+//
+// 探针及参数：
+//   accept(fd, peer_ip, peer_port)          Server接受新连接，ip/port为网络字节序
+//   conn_create(fd, http_data)              HttpData创建
+//   request_parsed(fd, method, path)        请求行和头部解析完成，method见HttpMethod
+//   response_queued(fd, status, bytes)      响应放入输出缓冲
+//   write_complete(fd, bytes)               输出缓冲全部写完
+//   timer_expire(fd)                        连接因超时被关闭
+//   conn_close(fd)                          HttpData析构，连接关闭
+//   rpc_request(message_id, method, len)    RpcServer解码出一个请求，method不以'\0'结尾
+//   rpc_response(message_id, success, us)   RpcServer发出响应及处理耗时
+
+#if !defined(WEBSERVER_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define WEBSERVER_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef WEBSERVER_HAVE_USDT
+#define TRACE1(name, a) DTRACE_PROBE1(webserver, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(webserver, name, a, b)
+#define TRACE3(name, a, b, c) DTRACE_PROBE3(webserver, name, a, b, c)
+#else
+#define TRACE1(name, a) \
+  do {                  \
+  } while (0)
+#define TRACE2(name, a, b) \
+  do {                     \
+  } while (0)
+#define TRACE3(name, a, b, c) \
+  do {                        \
+  } while (0)
+#endif
@@ -7,6 +7,8 @@
 #include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 
 /*
@@ -219,4 +221,47 @@ int socket_bind_listen(int port) {
     return -1;
   }
   return listen_fd;
+}
+
+// 同机进程之间用的Unix域socket，path是socket文件的路径。
+// 上次运行留下的socket文件会先删掉，否则bind会失败；
+// 路径上是普通文件等别的东西(errno为EEXIST)、或者还有服务器在监听(EADDRINUSE)时返回-1，不删
+int socket_bind_listen_unix(const char *path) {
+  struct sockaddr_un server_addr;
+  bzero((char *)&server_addr, sizeof(server_addr));
+  server_addr.sun_family = AF_UNIX;
+  if (strlen(path) == 0 || strlen(path) >= sizeof(server_addr.sun_path))
+    return -1;
+  strcpy(server_addr.sun_path, path);
+
+  struct stat st;
+  if (lstat(path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      errno = EEXIST;
+      return -1;
+    }
+    // 能连上说明另一个服务器正在用它
+    int probe_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe_fd == -1) return -1;
+    int ret = connect(probe_fd, (struct sockaddr *)&server_addr,
+                      sizeof(server_addr));
+    close(probe_fd);
+    if (ret == 0) {
+      errno = EADDRINUSE;
+      return -1;
+    }
+    unlink(path);
+  }
+
+  int listen_fd = 0;
+  if ((listen_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) return -1;
+  if (bind(listen_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) == -1) {
+    close(listen_fd);
+    return -1;
+  }
+  if (listen(listen_fd, 2048) == -1) {
+    close(listen_fd);
+    return -1;
+  }
+  return listen_fd;
 }
\ No newline at end of file
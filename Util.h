@@ -12,4 +12,5 @@ int setSocketNonBlocking(int fd);
 void setSocketNodelay(int fd);
 void setSocketNoLinger(int fd);
 void shutDownWR(int fd);
-int socket_bind_listen(int port);
\ No newline at end of file
+int socket_bind_listen(int port);
+int socket_bind_listen_unix(const char *path);
\ No newline at end of file
@@ -1,58 +1,162 @@
 #include "AsyncLogging.h"
 #include <assert.h>
 #include <stdio.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 #include <functional>
 #include "LogFile.h"
 
-AsyncLogging::AsyncLogging(std::string logFileName_, int flushInterval)
+AsyncLogging::AsyncLogging(std::string logFileName_, int flushInterval,
+                           int maxBuffers, OverflowPolicy policy,
+                           int arenaFlags)
     : flushInterval_(flushInterval),
+      // ǰ˹̶4黺(current/next/newBuffer1/newBuffer2)
+      maxBuffers_(maxBuffers < 4 ? 4 : maxBuffers),
+      policy_(policy),
+      sampleRate_(10),
       running_(false),
       basename_(logFileName_),
       thread_(std::bind(&AsyncLogging::threadFunc, this), "Logging"),
       mutex_(),
+      arena_(maxBuffers_, arenaFlags),
       cond_(mutex_),
-      currentBuffer_(new Buffer),
-      nextBuffer_(new Buffer),
+      notFull_(mutex_),
+      currentBuffer_(arena_.acquire()),
+      currentLines_(0),
+      nextBuffer_(arena_.acquire()),
       buffers_(),
+      backBuffer1_(arena_.acquire()),
+      backBuffer2_(arena_.acquire()),
+      sampleCounter_(0),
+      pendingDroppedLines_(0),
+      pendingDroppedBytes_(0),
+      totalDroppedLines_(0),
+      totalDroppedBytes_(0),
       latch_(1) {
   assert(logFileName_.size() > 1);
-  currentBuffer_->bzero();
-  nextBuffer_->bzero();
-  buffers_.reserve(16);
+  // arenaĻѾ㲢Ԥȱҳ
+  buffers_.reserve(maxBuffers_);
+  bufferLines_.reserve(maxBuffers_);
+}
+
+AsyncLogging::~AsyncLogging() {
+  if (running_) stop();
+}
+
+const char* AsyncLogging::policyName(OverflowPolicy policy) {
+  switch (policy) {
+    case kBlock:
+      return "block";
+    case kDropNewest:
+      return "drop-newest";
+    case kDropOldest:
+      return "drop-oldest";
+    case kSample:
+      return "sample";
+  }
+  return "unknown";
+}
+
+// nextBuffer_ٴarenaȡarena˷NULLڼ䲻ٷڴ
+AsyncLogging::BufferPtr AsyncLogging::takeBuffer_locked() {
+  BufferPtr buffer = nextBuffer_;
+  if (buffer) {
+    nextBuffer_ = NULL;
+  } else {
+    buffer = arena_.acquire();
+  }
+  return buffer;
+}
+
+void AsyncLogging::dropLine_locked(int len) {
+  ++pendingDroppedLines_;
+  pendingDroppedBytes_ += len;
+  ++totalDroppedLines_;
+  totalDroppedBytes_ += len;
 }
 
 void AsyncLogging::append(const char* logline, int len) {
   MutexLockGuard lock(mutex_);
-  if (currentBuffer_->avail() > len)
-    currentBuffer_->append(logline, len);
-  else {
-    buffers_.push_back(currentBuffer_);
-    currentBuffer_.reset();
-    if (nextBuffer_)
-      currentBuffer_ = std::move(nextBuffer_);
-    else
-      currentBuffer_.reset(new Buffer); //Զ̬
-    currentBuffer_->append(logline, len);
-    cond_.notify();
+  // ѹʱʼ
+  if (policy_ == kSample && sampleRate_ > 1 &&
+      static_cast<int>(buffers_.size()) * 2 >= maxBuffers_ &&
+      sampleCounter_++ % sampleRate_ != 0) {
+    dropLine_locked(len);
+    return;
   }
+  while (currentBuffer_->avail() <= len) {
+    BufferPtr buffer = takeBuffer_locked();
+    if (!buffer && policy_ == kDropOldest && !buffers_.empty()) {
+      // ѹɵһ飬ڳǰ˼д
+      uint64_t lines = bufferLines_.front();
+      uint64_t bytes = buffers_.front()->length();
+      pendingDroppedLines_ += lines;
+      pendingDroppedBytes_ += bytes;
+      totalDroppedLines_ += lines;
+      totalDroppedBytes_ += bytes;
+      buffer = buffers_.front();
+      buffers_.erase(buffers_.begin());
+      bufferLines_.erase(bufferLines_.begin());
+      buffer->reset();
+    }
+    if (buffer) {
+      buffers_.push_back(currentBuffer_);
+      bufferLines_.push_back(currentLines_);
+      currentBuffer_ = buffer;
+      currentLines_ = 0;
+      cond_.notify();
+      break;
+    }
+    if (policy_ == kBlock && running_) {
+      cond_.notify();
+      notFull_.wait();
+      continue;
+    }
+    dropLine_locked(len);
+    return;
+  }
+  currentBuffer_->append(logline, len);
+  ++currentLines_;
+}
+
+int AsyncLogging::formatDropMarker(char* buf, size_t size, uint64_t lines,
+                                   uint64_t bytes) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  time_t seconds = tv.tv_sec;
+  struct tm tm_time;
+  localtime_r(&seconds, &tm_time);
+  char str_t[26] = {0};
+  strftime(str_t, sizeof str_t, "%Y-%m-%d %H:%M:%S", &tm_time);
+  int len = snprintf(buf, size,
+                     "%s\nDropped %llu log messages (%llu bytes), overflow "
+                     "policy: %s\n",
+                     str_t, static_cast<unsigned long long>(lines),
+                     static_cast<unsigned long long>(bytes),
+                     policyName(policy_));
+  return len < static_cast<int>(size) ? len : static_cast<int>(size) - 1;
 }
 
 void AsyncLogging::threadFunc() {
   assert(running_ == true);
   latch_.countDown();
   LogFile output(basename_);
-  BufferPtr newBuffer1(new Buffer);
-  BufferPtr newBuffer2(new Buffer);
-  newBuffer1->bzero();
-  newBuffer2->bzero();
+  BufferPtr newBuffer1 = backBuffer1_;
+  BufferPtr newBuffer2 = backBuffer2_;
   BufferVector buffersToWrite;
-  buffersToWrite.reserve(16);
+  buffersToWrite.reserve(maxBuffers_);
+  std::vector<struct iovec> iov;
+  iov.reserve(maxBuffers_ + 1);
+  char marker[256];
   while (running_) {
     assert(newBuffer1 && newBuffer1->length() == 0);
     assert(newBuffer2 && newBuffer2->length() == 0);
     assert(buffersToWrite.empty());
 
+    uint64_t droppedLines = 0;
+    uint64_t droppedBytes = 0;
     {
       MutexLockGuard lock(mutex_);
       if (buffers_.empty())  // unusual usage!
@@ -61,38 +165,43 @@ void AsyncLogging::threadFunc() {
       }
       //?
       buffers_.push_back(currentBuffer_);
-      currentBuffer_.reset();
-
-      currentBuffer_ = std::move(newBuffer1);
+      currentBuffer_ = newBuffer1;
+      newBuffer1 = NULL;
+      currentLines_ = 0;
       buffersToWrite.swap(buffers_);
+      bufferLines_.clear();
 
       if (!nextBuffer_) {
-        nextBuffer_ = std::move(newBuffer2);
+        nextBuffer_ = newBuffer2;
+        newBuffer2 = NULL;
       }
+
+      droppedLines = pendingDroppedLines_;
+      droppedBytes = pendingDroppedBytes_;
+      pendingDroppedLines_ = 0;
+      pendingDroppedBytes_ = 0;
+      notFull_.notifyAll();
     }
 
     assert(!buffersToWrite.empty());
 
-    if (buffersToWrite.size() > 25) {
-      // char buf[256];
-      // snprintf(buf, sizeof buf, "Dropped log messages at %s, %zd larger
-      // buffers\n",
-      //          Timestamp::now().toFormattedString().c_str(),
-      //          buffersToWrite.size()-2);
-      // fputs(buf, stderr);
-      // output.append(buf, static_cast<int>(strlen(buf)));
-      buffersToWrite.erase(buffersToWrite.begin() + 2, buffersToWrite.end());
+    // ־Ϣ־±
+    iov.clear();
+    if (droppedLines > 0) {
+      int len = formatDropMarker(marker, sizeof marker, droppedLines,
+                                 droppedBytes);
+      fputs(marker, stderr);
+      struct iovec vec = {marker, static_cast<size_t>(len)};
+      iov.push_back(vec);
     }
 
+    // лһwritevֱдںˣپstdioο
     for (size_t i = 0; i < buffersToWrite.size(); ++i) {
-      // FIXME: use unbuffered stdio FILE ? or use ::writev ?
-      output.append(buffersToWrite[i]->data(), buffersToWrite[i]->length());
-    }
-    //ֱָùλ÷üɣָnewBuffer
-    if (buffersToWrite.size() > 2) {
-      // drop non-bzero-ed buffers, avoid trashing
-      buffersToWrite.resize(2);
+      struct iovec vec = {const_cast<char*>(buffersToWrite[i]->data()),
+                          static_cast<size_t>(buffersToWrite[i]->length())};
+      iov.push_back(vec);
     }
+    output.appendv(&iov[0], static_cast<int>(iov.size()));
 
     if (!newBuffer1) {
       assert(!buffersToWrite.empty());
@@ -108,8 +217,19 @@ void AsyncLogging::threadFunc() {
       newBuffer2->reset();
     }
 
+    //Ļ黹arenaͷŵ´ٷ
+    if (!buffersToWrite.empty()) {
+      MutexLockGuard lock(mutex_);
+      for (size_t i = 0; i < buffersToWrite.size(); ++i)
+        arena_.release(buffersToWrite[i]);
+      notFull_.notifyAll();
+    }
+
     buffersToWrite.clear();
     output.flush();
   }
+  // arenaʱarenaͳһ
+  backBuffer1_ = newBuffer1;
+  backBuffer2_ = newBuffer2;
   output.flush();
 }
@@ -1,8 +1,10 @@
 #pragma once
+#include <stdint.h>
 #include <functional>
 #include <string>
 #include <vector>
 #include "CountDownLatch.h"
+#include "LogBufferArena.h"
 #include "LogStream.h"
 #include "MutexLock.h"
 #include "Thread.h"
@@ -11,10 +13,20 @@
 
 class AsyncLogging : noncopyable {
  public:
-  AsyncLogging(const std::string basename, int flushInterval = 2);
-  ~AsyncLogging() {
-    if (running_) stop();
-  }
+  // 缓冲池耗尽(后端写不过来)时前端的处理策略
+  enum OverflowPolicy {
+    kBlock,       // 阻塞前端，直到后端归还缓冲
+    kDropNewest,  // 丢弃新来的日志
+    kDropOldest,  // 丢弃积压中最旧的一整块缓冲
+    kSample       // 积压过半后按采样率保留，池满后丢弃新日志
+  };
+
+  // maxBuffers块缓冲在构造时从LogBufferArena一次性分配，
+  // arenaFlags见LogBufferArena::Flags
+  AsyncLogging(const std::string basename, int flushInterval = 2,
+               int maxBuffers = 8, OverflowPolicy policy = kDropNewest,
+               int arenaFlags = 0);
+  ~AsyncLogging();
   void append(const char* logline, int len);
 
   void start() {
@@ -24,24 +36,65 @@ class AsyncLogging : noncopyable {
   }
 
   void stop() {
-    running_ = false;
+    {
+      MutexLockGuard lock(mutex_);
+      running_ = false;
+      notFull_.notifyAll();
+    }
     cond_.notify();
     thread_.join();
   }
 
+  // 需在start()之前设置
+  void setOverflowPolicy(OverflowPolicy policy) { policy_ = policy; }
+  // kSample策略下每sampleRate条日志保留一条
+  void setSampleRate(int sampleRate) { sampleRate_ = sampleRate > 0 ? sampleRate : 1; }
+
+  // 自启动以来被丢弃的日志行数/字节数
+  uint64_t droppedLines() const {
+    MutexLockGuard lock(mutex_);
+    return totalDroppedLines_;
+  }
+  uint64_t droppedBytes() const {
+    MutexLockGuard lock(mutex_);
+    return totalDroppedBytes_;
+  }
+
+  static const char* policyName(OverflowPolicy policy);
+
  private:
   void threadFunc();
-  typedef FixedBuffer<kLargeBuffer> Buffer;
-  typedef std::vector<std::shared_ptr<Buffer>> BufferVector;
-  typedef std::shared_ptr<Buffer> BufferPtr;
+  typedef LogBufferArena::Buffer Buffer;
+  // 缓冲归arena_所有，这里只是借用
+  typedef Buffer* BufferPtr;
+  typedef std::vector<BufferPtr> BufferVector;
+
+  BufferPtr takeBuffer_locked();
+  void dropLine_locked(int len);
+  int formatDropMarker(char* buf, size_t size, uint64_t lines, uint64_t bytes);
+
   const int flushInterval_;
+  const int maxBuffers_;
+  OverflowPolicy policy_;
+  int sampleRate_;
   bool running_;
   std::string basename_;
   Thread thread_;
-  MutexLock mutex_;
+  mutable MutexLock mutex_;
+  LogBufferArena arena_;  // 受mutex_保护
   Condition cond_;
+  Condition notFull_;
   BufferPtr currentBuffer_;
+  int currentLines_;
   BufferPtr nextBuffer_;
   BufferVector buffers_;
+  std::vector<int> bufferLines_;  // 与buffers_一一对应的日志行数
+  BufferPtr backBuffer1_;         // 后端的两块备用缓冲
+  BufferPtr backBuffer2_;
+  uint64_t sampleCounter_;
+  uint64_t pendingDroppedLines_;  // 尚未写入丢弃标记的部分
+  uint64_t pendingDroppedBytes_;
+  uint64_t totalDroppedLines_;
+  uint64_t totalDroppedBytes_;
   CountDownLatch latch_;
-};
\ No newline at end of file
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "noncopyable.h"
+
+// Chase-Lev work-stealing双端队列(按Le等人2013年给出的C11内存序实现)。
+// 只有一个所有者线程在底部push/pop，任意多个线程在顶部steal。
+// 所有者的push/pop在没有竞争时只有普通的load/store和一次fence，不加锁；
+// 只剩最后一个元素时所有者和小偷用CAS抢top。
+// 环形数组满了就扩容一倍，旧数组可能还有小偷在读，留到析构时再释放。
+// T必须是可以放进std::atomic的类型，一般是指针。
+template <typename T>
+class ChaseLevDeque : noncopyable {
+ public:
+  explicit ChaseLevDeque(size_t capacity = 256)
+      : top_(0), bottom_(0), array_(new Array(roundUp(capacity))) {}
+
+  ~ChaseLevDeque() {
+    delete array_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < retired_.size(); ++i) delete retired_[i];
+  }
+
+  // 只能由所有者调用
+  void push(T value) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    Array* a = array_.load(std::memory_order_relaxed);
+    if (b - t > static_cast<int64_t>(a->mask)) a = grow(a, t, b);
+    a->put(b, value);
+    // 原文是release fence加relaxed store，这里直接release store，效果相同，
+    // ThreadSanitizer也能看懂
+    bottom_.store(b + 1, std::memory_order_release);
+  }
+
+  // 只能由所有者调用，空时返回T()
+  T pop() {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    Array* a = array_.load(std::memory_order_relaxed);
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom_.store(b + 1, std::memory_order_relaxed);
+      return T();
+    }
+    T value = a->get(b);
+    if (t == b) {
+      // 最后一个元素，和小偷抢
+      if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                        std::memory_order_relaxed))
+        value = T();
+      bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+    return value;
+  }
+
+  // 任意线程调用，空或者没抢到都返回T()
+  T steal() {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if (t >= b) return T();
+    Array* a = array_.load(std::memory_order_acquire);
+    T value = a->get(t);
+    if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed))
+      return T();
+    return value;
+  }
+
+  // 并发修改时只是个近似值
+  bool empty() const {
+    return bottom_.load(std::memory_order_relaxed) <=
+           top_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  struct Array {
+    size_t mask;
+    std::atomic<T>* slots;
+
+    explicit Array(size_t capacity)
+        : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+    ~Array() { delete[] slots; }
+
+    T get(int64_t i) const {
+      return slots[static_cast<size_t>(i) & mask].load(
+          std::memory_order_relaxed);
+    }
+    void put(int64_t i, T value) {
+      slots[static_cast<size_t>(i) & mask].store(value,
+                                                 std::memory_order_relaxed);
+    }
+  };
+
+  static size_t roundUp(size_t n) {
+    size_t capacity = 16;
+    while (capacity < n) capacity <<= 1;
+    return capacity;
+  }
+
+  Array* grow(Array* old, int64_t t, int64_t b) {
+    Array* a = new Array((old->mask + 1) * 2);
+    for (int64_t i = t; i < b; ++i) a->put(i, old->get(i));
+    array_.store(a, std::memory_order_release);
+    retired_.push_back(old);
+    return a;
+  }
+
+  // top_和bottom_隔开一个cache line，小偷改top_时不打扰所有者。
+  // 不用alignas，C++11的new不保证按64字节对齐
+  std::atomic<int64_t> top_;
+  char pad_[64 - sizeof(std::atomic<int64_t>)];
+  std::atomic<int64_t> bottom_;
+  std::atomic<Array*> array_;
+  std::vector<Array*> retired_;  // 只有所有者访问
+};
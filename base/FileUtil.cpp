@@ -2,36 +2,56 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 using namespace std;
 
-AppendFile::AppendFile(string filename) : fp_(fopen(filename.c_str(), "ae")) {
-  // 用户提供缓冲区
-  setbuffer(fp_, buffer_, sizeof buffer_);
+AppendFile::AppendFile(string filename)
+    : fd_(::open(filename.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                 0644)) {
+  if (fd_ < 0)
+    fprintf(stderr, "AppendFile: open %s failed: %s\n", filename.c_str(),
+            strerror(errno));
 }
 
-AppendFile::~AppendFile() { fclose(fp_); }
+AppendFile::~AppendFile() {
+  if (fd_ >= 0) ::close(fd_);
+}
 
 void AppendFile::append(const char* logline, const size_t len) {
-  size_t n = this->write(logline, len);
-  size_t remain = len - n;
-  while (remain > 0) {
-    size_t x = this->write(logline + n, remain);
-    if (x == 0) {
-      int err = ferror(fp_);
-      if (err) fprintf(stderr, "AppendFile::append() failed !\n");
+  struct iovec iov;
+  iov.iov_base = const_cast<char*>(logline);
+  iov.iov_len = len;
+  appendv(&iov, 1);
+}
+
+void AppendFile::appendv(struct iovec* iov, int iovcnt) {
+  if (fd_ < 0) return;
+  while (iovcnt > 0) {
+    ssize_t n = ::writev(fd_, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      fprintf(stderr, "AppendFile::appendv() failed: %s\n", strerror(errno));
       break;
     }
-    n += x;
-    remain = len - n;
+    // 跳过已经写完的块，部分写的块调整起点后继续
+    size_t written = static_cast<size_t>(n);
+    while (iovcnt > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --iovcnt;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
   }
 }
 
-void AppendFile::flush() { fflush(fp_); }
-
-size_t AppendFile::write(const char* logline, size_t len) {
-  return fwrite_unlocked(logline, 1, len, fp_);
-}
\ No newline at end of file
+void AppendFile::sync() {
+  if (fd_ >= 0) ::fdatasync(fd_);
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include <sys/uio.h>
 #include <string>
 #include "noncopyable.h"
 
@@ -7,12 +8,15 @@ class AppendFile : noncopyable {
  public:
   explicit AppendFile(std::string filename);
   ~AppendFile();
-  // append 会向文件写
+  // append 直接write到内核，不再经过stdio缓冲区多拷贝一次
   void append(const char *logline, const size_t len);
-  void flush();
+  // 一次writev写出多块缓冲，iov在部分写时会被修改
+  void appendv(struct iovec *iov, int iovcnt);
+  // 没有用户态缓冲，数据已经在页缓存里了
+  void flush() {}
+  // fdatasync落盘
+  void sync();
 
  private:
-  size_t write(const char *logline, size_t len);
-  FILE *fp_;
-  char buffer_[64 * 1024];
-};
\ No newline at end of file
+  int fd_;
+};
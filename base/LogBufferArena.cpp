@@ -0,0 +1,84 @@
+#include "LogBufferArena.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <new>
+
+namespace {
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+size_t roundUp(size_t n, size_t align) { return (n + align - 1) / align * align; }
+}  // namespace
+
+LogBufferArena::LogBufferArena(int count, int flags)
+    : base_(NULL),
+      stride_(0),
+      mappedSize_(0),
+      count_(count),
+      hugePages_(false),
+      locked_(false) {
+  assert(count_ > 0);
+  // 按2MB对齐，每块缓冲正好占整数个大页
+  stride_ = roundUp(sizeof(Buffer), kHugePageSize);
+  mappedSize_ = stride_ * count_;
+  void* addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (flags & kHugePages) {
+    addr = mmap(NULL, mappedSize_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    hugePages_ = (addr != MAP_FAILED);
+  }
+#endif
+  if (addr == MAP_FAILED) {
+    addr = mmap(NULL, mappedSize_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+      fprintf(stderr, "LogBufferArena: mmap %zu bytes failed: %s\n",
+              mappedSize_, strerror(errno));
+      abort();
+    }
+#ifdef MADV_HUGEPAGE
+    // 透明大页只是建议，内核不支持时忽略
+    madvise(addr, mappedSize_, MADV_HUGEPAGE);
+#endif
+  }
+  base_ = static_cast<char*>(addr);
+
+  if (flags & kLockMemory) {
+    locked_ = (mlock(base_, mappedSize_) == 0);
+    if (!locked_)
+      fprintf(stderr, "LogBufferArena: mlock %zu bytes failed: %s\n",
+              mappedSize_, strerror(errno));
+  }
+
+  free_.reserve(count_);
+  for (int i = count_ - 1; i >= 0; --i) {
+    Buffer* buffer = new (base_ + i * stride_) Buffer;
+    // 逐页写一遍，把缺页都放在启动阶段
+    buffer->bzero();
+    free_.push_back(buffer);
+  }
+}
+
+LogBufferArena::~LogBufferArena() {
+  for (int i = 0; i < count_; ++i)
+    reinterpret_cast<Buffer*>(base_ + i * stride_)->~Buffer();
+  if (locked_) munlock(base_, mappedSize_);
+  munmap(base_, mappedSize_);
+}
+
+LogBufferArena::Buffer* LogBufferArena::acquire() {
+  if (free_.empty()) return NULL;
+  Buffer* buffer = free_.back();
+  free_.pop_back();
+  return buffer;
+}
+
+void LogBufferArena::release(Buffer* buffer) {
+  assert(buffer != NULL);
+  buffer->reset();
+  free_.push_back(buffer);
+}
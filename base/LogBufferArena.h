@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "LogStream.h"
+#include "noncopyable.h"
+
+// AsyncLogging的日志缓冲区池：启动时一次性mmap出全部大缓冲并预先触页，
+// 运行期间前后端只在这里借还，不再有4MB级别的new/delete和缺页。
+// 本身不加锁，由AsyncLogging在自己的mutex_下调用。
+class LogBufferArena : noncopyable {
+ public:
+  typedef FixedBuffer<kLargeBuffer> Buffer;
+
+  enum Flags {
+    kHugePages = 1,   // 尝试MAP_HUGETLB，失败则退回普通页+MADV_HUGEPAGE
+    kLockMemory = 2   // mlock住整个区域，避免被换出
+  };
+
+  LogBufferArena(int count, int flags = 0);
+  ~LogBufferArena();
+
+  // 没有空闲缓冲时返回NULL
+  Buffer* acquire();
+  void release(Buffer* buffer);
+
+  int capacity() const { return count_; }
+  int available() const { return static_cast<int>(free_.size()); }
+  bool hugePages() const { return hugePages_; }
+  bool locked() const { return locked_; }
+
+ private:
+  char* base_;
+  size_t stride_;
+  size_t mappedSize_;
+  int count_;
+  bool hugePages_;
+  bool locked_;
+  std::vector<Buffer*> free_;
+};
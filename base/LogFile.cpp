@@ -7,10 +7,10 @@
 
 using namespace std;
 
-LogFile::LogFile(const string& basename, int flushEveryN)
+LogFile::LogFile(const string& basename, int syncInterval)
     : basename_(basename),
-      flushEveryN_(flushEveryN),
-      count_(0),
+      syncInterval_(syncInterval),
+      lastSync_(::time(NULL)),
       mutex_(new MutexLock) {
   // assert(basename.find('/') >= 0);
   file_.reset(new AppendFile(basename));
@@ -20,19 +20,22 @@ LogFile::~LogFile() {}
 
 void LogFile::append(const char* logline, int len) {
   MutexLockGuard lock(*mutex_);
-  append_unlocked(logline, len);
+  file_->append(logline, len);
 }
 
-void LogFile::flush() {
+void LogFile::appendv(struct iovec* iov, int iovcnt) {
   MutexLockGuard lock(*mutex_);
-  file_->flush();
+  file_->appendv(iov, iovcnt);
 }
 
-void LogFile::append_unlocked(const char* logline, int len) {
-  file_->append(logline, len);
-  ++count_;
-  if (count_ >= flushEveryN_) {
-    count_ = 0;
-    file_->flush();
+void LogFile::flush() {
+  MutexLockGuard lock(*mutex_);
+  file_->flush();
+  if (syncInterval_ > 0) {
+    time_t now = ::time(NULL);
+    if (now - lastSync_ >= syncInterval_) {
+      lastSync_ = now;
+      file_->sync();
+    }
   }
-}
\ No newline at end of file
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <sys/uio.h>
+#include <time.h>
 #include <memory>
 #include <string>
 #include "FileUtil.h"
@@ -9,21 +11,21 @@
 // TODO 提供自动归档功能
 class LogFile : noncopyable {
  public:
-  // 每被append flushEveryN次，flush一下，会往文件写，只不过，文件也是带缓冲区的
-  LogFile(const std::string& basename, int flushEveryN = 1024);
+  // 写入直接进内核页缓存，flush时每隔syncInterval秒fdatasync一次落盘，
+  // syncInterval为0表示完全交给内核回写
+  LogFile(const std::string& basename, int syncInterval = 3);
   ~LogFile();
 
   void append(const char* logline, int len);
+  void appendv(struct iovec* iov, int iovcnt);
   void flush();
   bool rollFile();
 
  private:
-  void append_unlocked(const char* logline, int len);
-
   const std::string basename_;
-  const int flushEveryN_;
+  const int syncInterval_;
 
-  int count_;
+  time_t lastSync_;
   std::unique_ptr<MutexLock> mutex_;
   std::unique_ptr<AppendFile> file_;
-};
\ No newline at end of file
+};
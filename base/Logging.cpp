@@ -12,10 +12,16 @@ static pthread_once_t once_control_ = PTHREAD_ONCE_INIT;
 static AsyncLogging *AsyncLogger_;
 
 std::string Logger::logFileName_ = "./WebServer.log";
+AsyncLogging::OverflowPolicy Logger::overflowPolicy_ = AsyncLogging::kDropNewest;
+int Logger::maxBuffers_ = 8;
+int Logger::arenaFlags_ = 0;
 
 void once_init()
 {
-    AsyncLogger_ = new AsyncLogging(Logger::getLogFileName());
+    AsyncLogger_ = new AsyncLogging(Logger::getLogFileName(), 2,
+                                    Logger::getMaxBuffers(),
+                                    Logger::getOverflowPolicy(),
+                                    Logger::getBufferArenaFlags());
     AsyncLogger_->start(); 
 }
 
@@ -25,6 +31,18 @@ void output(const char* msg, int len)
     AsyncLogger_->append(msg, len);
 }
 
+uint64_t Logger::droppedLines()
+{
+    pthread_once(&once_control_, once_init);
+    return AsyncLogger_->droppedLines();
+}
+
+uint64_t Logger::droppedBytes()
+{
+    pthread_once(&once_control_, once_init);
+    return AsyncLogger_->droppedBytes();
+}
+
 Logger::Impl::Impl(const char *fileName, int line)
   : stream_(),
     line_(line),
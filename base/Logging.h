@@ -3,11 +3,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include "AsyncLogging.h"
 #include "LogStream.h"
 
 
-class AsyncLogging;
-
 class Logger {
  public:
   Logger(const char *fileName, int line);
@@ -16,6 +15,22 @@ class Logger {
 
   static void setLogFileName(std::string fileName) { logFileName_ = fileName; }
   static std::string getLogFileName() { return logFileName_; }
+  // 日志积压时的处理策略，需在第一次打log之前设置
+  static void setOverflowPolicy(AsyncLogging::OverflowPolicy policy,
+                                int maxBuffers = 8) {
+    overflowPolicy_ = policy;
+    maxBuffers_ = maxBuffers;
+  }
+  static AsyncLogging::OverflowPolicy getOverflowPolicy() {
+    return overflowPolicy_;
+  }
+  static int getMaxBuffers() { return maxBuffers_; }
+  // 日志缓冲是否使用大页/锁定内存，取值见LogBufferArena::Flags
+  static void setBufferArenaFlags(int flags) { arenaFlags_ = flags; }
+  static int getBufferArenaFlags() { return arenaFlags_; }
+  // 供监控使用的丢弃统计
+  static uint64_t droppedLines();
+  static uint64_t droppedBytes();
 
  private:
   class Impl {
@@ -29,6 +44,9 @@ class Logger {
   };
   Impl impl_;
   static std::string logFileName_;
+  static AsyncLogging::OverflowPolicy overflowPolicy_;
+  static int maxBuffers_;
+  static int arenaFlags_;
 };
 
 #define LOG Logger(__FILE__, __LINE__).stream()
\ No newline at end of file
@@ -0,0 +1,180 @@
+#include "WorkStealingPool.h"
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// 当前线程所属的线程池和下标，任务里再提交时直接进自己的队列
+__thread WorkStealingPool* t_pool = NULL;
+__thread int t_index = -1;
+
+// 注入队列一次最多搬多少个任务到自己的队列，搬过去的其他线程也能偷
+const int kInjectBatch = 16;
+
+// 睡眠前再找几轮，每轮之间让出CPU
+const int kSpinRounds = 2;
+
+void futexWait(std::atomic<uint32_t>* addr, uint32_t expected) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE,
+          expected, NULL, NULL, 0);
+}
+
+void futexWake(std::atomic<uint32_t>* addr, int count) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE,
+          count, NULL, NULL, 0);
+}
+
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(int numThreads, size_t maxQueued,
+                                   const std::string& name)
+    : maxQueued_(maxQueued),
+      name_(name),
+      running_(false),
+      queued_(0),
+      epoch_(0),
+      idle_(0) {
+  if (numThreads <= 0) {
+    fprintf(stderr, "WorkStealingPool needs at least one thread\n");
+    abort();
+  }
+  for (int i = 0; i < numThreads; ++i) {
+    Worker* worker = new Worker;
+    worker->seed = static_cast<uint32_t>(i) * 2654435761u + 1;
+    workers_.push_back(worker);
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  stop();
+  for (size_t i = 0; i < workers_.size(); ++i) delete workers_[i];
+}
+
+void WorkStealingPool::start() {
+  if (running_.exchange(true)) return;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "%d", static_cast<int>(i));
+    delete workers_[i]->thread;
+    workers_[i]->thread = new Thread(
+        std::bind(&WorkStealingPool::workerLoop, this, static_cast<int>(i)),
+        name_ + buf);
+    workers_[i]->thread->start();
+  }
+}
+
+void WorkStealingPool::stop() {
+  if (!running_.exchange(false)) return;
+  epoch_.fetch_add(1);
+  futexWake(&epoch_, static_cast<int>(workers_.size()));
+  for (size_t i = 0; i < workers_.size(); ++i) workers_[i]->thread->join();
+}
+
+bool WorkStealingPool::submit(Task task) {
+  // 先占名额再检查running_，和stop之后工作线程检查queued_配对：
+  // 这里看到还在运行，工作线程就一定会等这个任务执行完才退出。
+  // 工作线程自己提交的子任务在stop之后也接受，它退出前会把自己队列里的做完
+  bool inWorker = (t_pool == this);
+  int64_t queued = queued_.fetch_add(1);
+  if ((maxQueued_ > 0 && static_cast<size_t>(queued) >= maxQueued_) ||
+      (!running_ && !inWorker)) {
+    queued_.fetch_sub(1);
+    return false;
+  }
+
+  Task* node = new Task(std::move(task));
+  if (inWorker) {
+    workers_[t_index]->deque.push(node);
+  } else {
+    MutexLockGuard lock(injectMutex_);
+    inject_.push_back(node);
+  }
+  wakeOne();
+  return true;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+  t_pool = this;
+  t_index = index;
+  for (;;) {
+    Task* task = NULL;
+    for (int round = 0; round <= kSpinRounds && !task; ++round) {
+      if (round > 0) sched_yield();
+      task = findTask(index);
+    }
+    if (task) {
+      queued_.fetch_sub(1);
+      (*task)();
+      delete task;
+      continue;
+    }
+    if (!running_ && queued_.load() == 0) break;
+    park();
+  }
+  t_pool = NULL;
+  t_index = -1;
+}
+
+WorkStealingPool::Task* WorkStealingPool::findTask(int index) {
+  Worker* worker = workers_[index];
+  Task* task = worker->deque.pop();
+  if (!task) task = takeFromInject(worker);
+  if (!task) task = stealFromOthers(index);
+  return task;
+}
+
+WorkStealingPool::Task* WorkStealingPool::takeFromInject(Worker* worker) {
+  Task* batch[kInjectBatch];
+  int n = 0;
+  {
+    MutexLockGuard lock(injectMutex_);
+    // 按线程数均分，免得一个线程把注入队列全搬走而别的线程还要再来偷
+    size_t share = inject_.size() / workers_.size() + 1;
+    while (n < kInjectBatch && static_cast<size_t>(n) < share &&
+           !inject_.empty()) {
+      batch[n++] = inject_.front();
+      inject_.pop_front();
+    }
+  }
+  if (n == 0) return NULL;
+  // 第一个自己马上执行，其余的倒序压栈，pop出来还是先进先出的顺序
+  for (int i = n - 1; i > 0; --i) worker->deque.push(batch[i]);
+  if (n > 1) wakeOne();
+  return batch[0];
+}
+
+WorkStealingPool::Task* WorkStealingPool::stealFromOthers(int index) {
+  int count = static_cast<int>(workers_.size());
+  if (count == 1) return NULL;
+  // 从随机位置开始转一圈，免得大家都盯着同一个队列
+  Worker* self = workers_[index];
+  self->seed = self->seed * 1103515245u + 12345u;
+  int start = static_cast<int>((self->seed >> 16) % static_cast<uint32_t>(count));
+  for (int i = 0; i < count; ++i) {
+    int victim = (start + i) % count;
+    if (victim == index) continue;
+    Task* task = workers_[victim]->deque.steal();
+    if (task) return task;
+  }
+  return NULL;
+}
+
+void WorkStealingPool::park() {
+  // 先记epoch_、再登记idle_、最后看queued_，和wakeOne的顺序正好相反，
+  // 都是顺序一致的原子操作：要么这里看到新任务，要么wakeOne看到有人睡着并改了epoch_，
+  // FUTEX_WAIT发现epoch_变了会立即返回
+  uint32_t epoch = epoch_.load();
+  idle_.fetch_add(1);
+  if (queued_.load() == 0 && running_) futexWait(&epoch_, epoch);
+  idle_.fetch_sub(1);
+}
+
+void WorkStealingPool::wakeOne() {
+  if (idle_.load() == 0) return;
+  epoch_.fetch_add(1);
+  futexWake(&epoch_, 1);
+}
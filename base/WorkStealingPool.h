@@ -0,0 +1,79 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "ChaseLevDeque.h"
+#include "MutexLock.h"
+#include "Thread.h"
+#include "noncopyable.h"
+
+// 按实例使用的work-stealing线程池，可以同时建好几个，HTTP和RPC都能用。
+// 取代只有静态成员、一把锁一个环形队列的ThreadPool。
+//   - 每个工作线程有一个Chase-Lev双端队列。任务里再提交的子任务压到当前线程
+//     队列的底部，自己也从底部取，不加锁，数据还在cache里；
+//   - 其他线程(比如IO线程)提交的任务进全局注入队列，工作线程一次搬一批到自己队列；
+//   - 自己没活干时从别人队列的顶部偷；
+//   - 实在没有任务就在futex上睡眠，提交方只在有线程睡着时才做唤醒的系统调用。
+class WorkStealingPool : noncopyable {
+ public:
+  typedef std::function<void()> Task;
+
+  // maxQueued是排队(还没开始执行)任务总数的上限，0表示不限制
+  explicit WorkStealingPool(int numThreads, size_t maxQueued = 0,
+                            const std::string& name = "WorkStealingPool");
+  ~WorkStealingPool();
+
+  void start();
+
+  // 等已经排队的任务都执行完再返回，之后submit都会失败
+  void stop();
+
+  // 线程安全。超过maxQueued或者没有start/已经stop时返回false，task不会执行；
+  // 例外是stop期间任务里再提交的子任务，仍然会执行
+  bool submit(Task task);
+
+  int numThreads() const { return static_cast<int>(workers_.size()); }
+  size_t maxQueued() const { return maxQueued_; }
+
+  // 排队中的任务数，并发时只是个近似值
+  int64_t queued() const { return queued_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Worker {
+    ChaseLevDeque<Task*> deque;
+    Thread* thread;
+    uint32_t seed;  // 挑偷取对象用的随机数状态
+
+    Worker() : thread(NULL), seed(0) {}
+    ~Worker() { delete thread; }
+  };
+
+  std::vector<Worker*> workers_;
+  size_t maxQueued_;
+  std::string name_;
+  std::atomic<bool> running_;
+
+  // 所有队列里排队的任务总数。入队前先加，既用来限流，也是睡眠前检查有没有活的依据
+  std::atomic<int64_t> queued_;
+
+  MutexLock injectMutex_;
+  std::deque<Task*> inject_;
+
+  // 睡眠：睡前记下epoch_再检查queued_，唤醒方先加epoch_再FUTEX_WAKE
+  std::atomic<uint32_t> epoch_;
+  std::atomic<int> idle_;
+
+  void workerLoop(int index);
+
+  // 依次尝试：自己队列底部、注入队列(顺便搬一批)、随机挑一个别人的队列偷
+  Task* findTask(int index);
+  Task* takeFromInject(Worker* worker);
+  Task* stealFromOthers(int index);
+
+  void park();
+  void wakeOne();
+};
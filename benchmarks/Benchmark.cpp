@@ -0,0 +1,288 @@
+#include "Benchmark.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "base/Logging.h"
+
+namespace {
+
+struct BenchCase {
+  std::string name;
+  BenchFunc func;
+  int64_t arg;
+};
+
+struct BenchResult {
+  std::string name;
+  int repetition;
+  int repetitions;
+  int64_t iterations;
+  double realNs;  // 每次迭代
+  double cpuNs;
+  double itemsPerSecond;
+  double bytesPerSecond;
+  std::string label;
+};
+
+// 注册发生在静态初始化阶段，用函数内静态变量避免初始化顺序问题
+std::vector<BenchCase>& registry() {
+  static std::vector<BenchCase> cases;
+  return cases;
+}
+
+double nowSeconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+const int64_t kMaxIterations = 1000000000;
+
+BenchState runOnce(const BenchCase& bench, int64_t iterations) {
+  BenchState state(iterations, bench.arg);
+  state.resumeTiming();
+  bench.func(state);
+  state.pauseTiming();
+  return state;
+}
+
+// 按上一轮的耗时估算迭代次数，直到单轮超过minTime
+BenchState runCalibrated(const BenchCase& bench, double minTime) {
+  int64_t iterations = 1;
+  while (true) {
+    BenchState state = runOnce(bench, iterations);
+    double elapsed = state.realSeconds();
+    if (elapsed >= minTime || iterations >= kMaxIterations) return state;
+    double multiplier = elapsed > 1e-9 ? minTime * 1.4 / elapsed : 10.0;
+    if (multiplier > 10.0) multiplier = 10.0;
+    int64_t next = static_cast<int64_t>(iterations * multiplier);
+    if (next <= iterations) next = iterations + 1;
+    iterations = next < kMaxIterations ? next : kMaxIterations;
+  }
+}
+
+std::string formatRate(double value, const char* unit) {
+  static const char* const kPrefixes[] = {"", "k", "M", "G", "T"};
+  int i = 0;
+  while (value >= 1000.0 && i < 4) {
+    value /= 1000.0;
+    ++i;
+  }
+  char buf[64];
+  snprintf(buf, sizeof buf, "%.2f%s%s", value, kPrefixes[i], unit);
+  return buf;
+}
+
+void appendJsonString(std::string& out, const std::string& str) {
+  out += '"';
+  for (size_t i = 0; i < str.size(); ++i) {
+    char c = str[i];
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof esc, "\\u%04x", c);
+      out += esc;
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+bool writeJson(const char* path, const char* executable,
+               const std::vector<BenchResult>& results) {
+  char date[64];
+  time_t now = time(NULL);
+  struct tm tm_time;
+  localtime_r(&now, &tm_time);
+  strftime(date, sizeof date, "%Y-%m-%dT%H:%M:%S%z", &tm_time);
+  char host[256] = "";
+  gethostname(host, sizeof host - 1);
+
+  std::string out = "{\n  \"context\": {\n    \"date\": ";
+  appendJsonString(out, date);
+  out += ",\n    \"host_name\": ";
+  appendJsonString(out, host);
+  out += ",\n    \"executable\": ";
+  appendJsonString(out, executable);
+  char buf[512];
+  snprintf(buf, sizeof buf,
+           ",\n    \"num_cpus\": %ld,\n    \"library_build_type\": \"%s\"\n"
+           "  },\n  \"benchmarks\": [",
+           sysconf(_SC_NPROCESSORS_ONLN),
+#ifdef __OPTIMIZE__
+           "release"
+#else
+           "debug"
+#endif
+  );
+  out += buf;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    out += i == 0 ? "\n    {\n      \"name\": " : ",\n    {\n      \"name\": ";
+    appendJsonString(out, r.name);
+    out += ",\n      \"run_name\": ";
+    appendJsonString(out, r.name);
+    snprintf(buf, sizeof buf,
+             ",\n      \"run_type\": \"iteration\",\n"
+             "      \"repetitions\": %d,\n      \"repetition_index\": %d,\n"
+             "      \"threads\": 1,\n      \"iterations\": %lld,\n"
+             "      \"real_time\": %.6g,\n      \"cpu_time\": %.6g,\n"
+             "      \"time_unit\": \"ns\"",
+             r.repetitions, r.repetition, static_cast<long long>(r.iterations),
+             r.realNs, r.cpuNs);
+    out += buf;
+    if (r.itemsPerSecond > 0) {
+      snprintf(buf, sizeof buf, ",\n      \"items_per_second\": %.6g",
+               r.itemsPerSecond);
+      out += buf;
+    }
+    if (r.bytesPerSecond > 0) {
+      snprintf(buf, sizeof buf, ",\n      \"bytes_per_second\": %.6g",
+               r.bytesPerSecond);
+      out += buf;
+    }
+    if (!r.label.empty()) {
+      out += ",\n      \"label\": ";
+      appendJsonString(out, r.label);
+    }
+    out += "\n    }";
+  }
+  out += "\n  ]\n}\n";
+
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    perror(path);
+    return false;
+  }
+  fwrite(out.data(), 1, out.size(), fp);
+  fclose(fp);
+  return true;
+}
+
+void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [--filter=SUBSTR] [--min-time=SECONDS] "
+          "[--repetitions=N] [--json=FILE] [--list]\n",
+          name);
+}
+
+}  // namespace
+
+BenchState::BenchState(int64_t iterations, int64_t arg)
+    : iterations_(iterations),
+      arg_(arg),
+      items_(0),
+      bytes_(0),
+      timing_(false),
+      startReal_(0),
+      startCpu_(0),
+      real_(0),
+      cpu_(0) {}
+
+void BenchState::pauseTiming() {
+  if (!timing_) return;
+  real_ += nowSeconds(CLOCK_MONOTONIC) - startReal_;
+  cpu_ += nowSeconds(CLOCK_THREAD_CPUTIME_ID) - startCpu_;
+  timing_ = false;
+}
+
+void BenchState::resumeTiming() {
+  if (timing_) return;
+  startReal_ = nowSeconds(CLOCK_MONOTONIC);
+  startCpu_ = nowSeconds(CLOCK_THREAD_CPUTIME_ID);
+  timing_ = true;
+}
+
+BenchRegistrar::BenchRegistrar(const char* name, BenchFunc func, int64_t arg,
+                               bool hasArg) {
+  BenchCase bench;
+  bench.name = name;
+  if (hasArg) {
+    char buf[32];
+    snprintf(buf, sizeof buf, "/%lld", static_cast<long long>(arg));
+    bench.name += buf;
+  }
+  bench.func = func;
+  bench.arg = arg;
+  registry().push_back(bench);
+}
+
+int main(int argc, char* argv[]) {
+  std::string filter;
+  double minTime = 0.5;
+  int repetitions = 1;
+  const char* jsonPath = NULL;
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--filter=", 9) == 0) {
+      filter = argv[i] + 9;
+    } else if (strncmp(argv[i], "--min-time=", 11) == 0) {
+      minTime = atof(argv[i] + 11);
+    } else if (strncmp(argv[i], "--repetitions=", 14) == 0) {
+      repetitions = atoi(argv[i] + 14);
+    } else if (strncmp(argv[i], "--json=", 7) == 0) {
+      jsonPath = argv[i] + 7;
+    } else if (strcmp(argv[i], "--list") == 0) {
+      list = true;
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (repetitions < 1) repetitions = 1;
+
+  // 被测代码里的LOG不能写到当前目录去
+  Logger::setLogFileName("/dev/null");
+
+#ifndef __OPTIMIZE__
+  fprintf(stderr,
+          "***WARNING*** built without optimization, timings are not "
+          "representative (configure with -DCMAKE_BUILD_TYPE=Release)\n");
+#endif
+
+  std::vector<BenchCase>& cases = registry();
+  std::vector<BenchResult> results;
+  printf("%-36s %14s %14s %12s %s\n", "Benchmark", "Time", "CPU",
+         "Iterations", "Throughput");
+  for (size_t i = 0; i < cases.size(); ++i) {
+    const BenchCase& bench = cases[i];
+    if (!filter.empty() && bench.name.find(filter) == std::string::npos)
+      continue;
+    if (list) {
+      printf("%s\n", bench.name.c_str());
+      continue;
+    }
+    for (int rep = 0; rep < repetitions; ++rep) {
+      BenchState state = runCalibrated(bench, minTime);
+      BenchResult r;
+      r.name = bench.name;
+      r.repetition = rep;
+      r.repetitions = repetitions;
+      r.iterations = state.iterations();
+      r.realNs = state.realSeconds() * 1e9 / state.iterations();
+      r.cpuNs = state.cpuSeconds() * 1e9 / state.iterations();
+      double seconds = state.realSeconds() > 0 ? state.realSeconds() : 1e-9;
+      r.itemsPerSecond = state.items() / seconds;
+      r.bytesPerSecond = state.bytes() / seconds;
+      r.label = state.label();
+      std::string throughput;
+      if (r.itemsPerSecond > 0)
+        throughput += formatRate(r.itemsPerSecond, " items/s ");
+      if (r.bytesPerSecond > 0) throughput += formatRate(r.bytesPerSecond, "B/s ");
+      throughput += r.label;
+      printf("%-36s %11.1f ns %11.1f ns %12lld %s\n", r.name.c_str(), r.realNs,
+             r.cpuNs, static_cast<long long>(r.iterations), throughput.c_str());
+      fflush(stdout);
+      results.push_back(r);
+    }
+  }
+  if (jsonPath && !list && !writeJson(jsonPath, argv[0], results)) return 1;
+  return 0;
+}
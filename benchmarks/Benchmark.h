@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+// 一个很小的基准测试框架，不依赖第三方库。
+// 每个用例是一个 void(BenchState&) 函数，执行 state.iterations() 次被测操作；
+// 框架自动放大迭代次数直到单轮耗时超过 --min-time，再报告每次操作的耗时。
+// --json=FILE 输出和Google Benchmark相同格式的JSON，可以直接用它的compare.py
+// 对比两次结果。
+class BenchState {
+ public:
+  BenchState(int64_t iterations, int64_t arg);
+
+  int64_t iterations() const { return iterations_; }
+  // BENCHMARK_ARG注册时给出的参数，比如线程数、payload大小
+  int64_t arg() const { return arg_; }
+
+  // 准备数据等不想计入的部分用这两个函数包起来
+  void pauseTiming();
+  void resumeTiming();
+
+  // 总共处理的条数/字节数，用来算吞吐
+  void setItemsProcessed(int64_t items) { items_ = items; }
+  void setBytesProcessed(int64_t bytes) { bytes_ = bytes; }
+  void setLabel(const std::string& label) { label_ = label; }
+
+  int64_t items() const { return items_; }
+  int64_t bytes() const { return bytes_; }
+  const std::string& label() const { return label_; }
+  double realSeconds() const { return real_; }
+  double cpuSeconds() const { return cpu_; }
+
+ private:
+  int64_t iterations_;
+  int64_t arg_;
+  int64_t items_;
+  int64_t bytes_;
+  std::string label_;
+  bool timing_;
+  double startReal_;
+  double startCpu_;
+  double real_;
+  double cpu_;
+};
+
+typedef void (*BenchFunc)(BenchState&);
+
+class BenchRegistrar {
+ public:
+  BenchRegistrar(const char* name, BenchFunc func, int64_t arg, bool hasArg);
+};
+
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+#define BENCHMARK(func)                                          \
+  static BenchRegistrar BENCH_CONCAT(benchRegistrar_, __LINE__)( \
+      #func, func, 0, false)
+#define BENCHMARK_ARG(func, arg)                                 \
+  static BenchRegistrar BENCH_CONCAT(benchRegistrar_, __LINE__)( \
+      #func, func, arg, true)
+
+// 防止编译器把被测结果当作无用代码删掉
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void clobberMemory() { asm volatile("" : : : "memory"); }
@@ -0,0 +1,73 @@
+// 日志相关的用例：LogStream格式化、AsyncLogging前端、完整的LOG宏
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "base/AsyncLogging.h"
+#include "base/LogStream.h"
+#include "base/Logging.h"
+#include "base/Thread.h"
+
+namespace {
+
+void BM_LogStreamFormat(BenchState& state) {
+  LogStream stream;
+  std::string path = "/index.html";
+  int64_t bytes = 0;
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    stream.resetBuffer();
+    stream << "GET " << path << " status=" << 200 << " bytes=" << i
+           << " latency=" << 0.125 * static_cast<double>(i & 1023) << "ms";
+    bytes += stream.buffer().length();
+    doNotOptimize(stream.buffer().data());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(bytes);
+}
+BENCHMARK(BM_LogStreamFormat);
+
+// arg个线程同时append 128字节的日志行，后端写/dev/null。
+// 只统计前端append的耗时，不含stop()时等后端写完的时间
+void BM_AsyncLoggingAppend(BenchState& state) {
+  int producers = static_cast<int>(state.arg());
+  char line[128];
+  memset(line, 'x', sizeof line);
+  line[sizeof line - 1] = '\n';
+
+  state.pauseTiming();
+  AsyncLogging log("/dev/null", 2, 8, AsyncLogging::kBlock);
+  log.start();
+  int64_t perThread = state.iterations() / producers;
+  std::vector<std::shared_ptr<Thread>> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.push_back(std::make_shared<Thread>(
+        [&log, &line, perThread]() {
+          for (int64_t i = 0; i < perThread; ++i)
+            log.append(line, sizeof line);
+        },
+        "BenchLogger"));
+  }
+  state.resumeTiming();
+
+  for (size_t p = 0; p < threads.size(); ++p) threads[p]->start();
+  for (size_t p = 0; p < threads.size(); ++p) threads[p]->join();
+
+  state.pauseTiming();
+  log.stop();
+  state.setItemsProcessed(perThread * producers);
+  state.setBytesProcessed(perThread * producers * sizeof line);
+  if (log.droppedLines() > 0) state.setLabel("dropped lines!");
+}
+BENCHMARK_ARG(BM_AsyncLoggingAppend, 1);
+BENCHMARK_ARG(BM_AsyncLoggingAppend, 4);
+
+// 完整的LOG宏：Logger构造、格式化时间和源文件位置、交给全局AsyncLogging
+void BM_LoggerLogLine(BenchState& state) {
+  for (int64_t i = 0; i < state.iterations(); ++i)
+    LOG << "request fd=" << 42 << " path=/hello status=" << 200;
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LoggerLogLine);
+
+}  // namespace
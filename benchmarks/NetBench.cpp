@@ -0,0 +1,134 @@
+// 网络层相关的用例：HttpData解析、TimerManager、跨线程queueInLoop
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "HttpData.h"
+#include "Timer.h"
+#include "base/Thread.h"
+
+namespace {
+
+const char kRequest[] =
+    "GET /hello HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8080\r\n"
+    "User-Agent: MicroBench\r\n"
+    "Accept: */*\r\n"
+    "Connection: Keep-Alive\r\n"
+    "\r\n";
+
+void drain(int fd) {
+  char buf[64 * 1024];
+  while (read(fd, buf, sizeof buf) > 0) {
+  }
+}
+
+// 一次迭代 = 往socketpair写arg个pipeline请求，跑一轮EventLoop
+// (epoll_wait、HttpData解析并回写响应、定时器维护)，再把响应读掉。
+void BM_HttpDataParseHello(BenchState& state) {
+  int depth = static_cast<int>(state.arg());
+  std::string batch;
+  for (int i = 0; i < depth; ++i) batch += kRequest;
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) < 0) {
+    perror("socketpair");
+    return;
+  }
+  state.pauseTiming();
+  EventLoop loop;
+  std::shared_ptr<HttpData> conn(new HttpData(&loop, fds[0]));
+  conn->getChannel()->setHolder(conn);
+  conn->newEvent();
+  EventLoop::Functor quit = std::bind(&EventLoop::quit, &loop);
+  state.resumeTiming();
+
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    if (write(fds[1], batch.data(), batch.size()) !=
+        static_cast<ssize_t>(batch.size()))
+      abort();
+    // 本轮回调阶段执行quit，loop()只跑一轮就返回
+    loop.queueInLoop(EventLoop::Functor(quit));
+    loop.loop();
+    drain(fds[1]);
+  }
+
+  state.pauseTiming();
+  conn->seperateTimer();
+  loop.removeFromPoller(conn->getChannel());
+  conn.reset();
+  close(fds[1]);
+  state.setItemsProcessed(state.iterations() * depth);
+  state.setBytesProcessed(state.iterations() * batch.size());
+}
+BENCHMARK_ARG(BM_HttpDataParseHello, 1);
+BENCHMARK_ARG(BM_HttpDataParseHello, 16);
+
+// 每个请求都会经历的"摘掉旧定时器、挂上新定时器"，每1024次清理一次堆
+void BM_TimerAddCancel(BenchState& state) {
+  const int kConns = 1024;
+  state.pauseTiming();
+  EventLoop loop;
+  std::vector<std::shared_ptr<HttpData>> conns;
+  for (int i = 0; i < kConns; ++i)
+    conns.push_back(std::make_shared<HttpData>(&loop, open("/dev/null", O_RDONLY)));
+  TimerManager timers;
+  state.resumeTiming();
+
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::shared_ptr<HttpData>& conn = conns[i & (kConns - 1)];
+    conn->seperateTimer();
+    timers.addTimer(conn, 5000 + static_cast<int>(i & 63));
+    if ((i & (kConns - 1)) == kConns - 1) timers.handleExpiredEvent();
+  }
+
+  state.pauseTiming();
+  for (int i = 0; i < kConns; ++i) conns[i]->seperateTimer();
+  timers.handleExpiredEvent();
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TimerAddCancel);
+
+// arg个线程一起往另一个loop线程投递回调，测到所有回调执行完为止
+void BM_QueueInLoopCrossThread(BenchState& state) {
+  int producers = static_cast<int>(state.arg());
+  state.pauseTiming();
+  EventLoopThread loopThread;
+  EventLoop* loop = loopThread.startLoop();
+  std::atomic<int64_t> done(0);
+  // 每个线程至少投递一个回调：等到回调执行完，说明loop()已经跑起来了，
+  // 析构时的quit()不会被loop()开头的quit_ = false覆盖掉
+  int64_t perThread = (state.iterations() + producers - 1) / producers;
+  int64_t total = perThread * producers;
+  std::vector<std::shared_ptr<Thread>> threads;
+  for (int p = 0; p < producers; ++p) {
+    threads.push_back(std::make_shared<Thread>(
+        [loop, &done, perThread]() {
+          for (int64_t i = 0; i < perThread; ++i)
+            loop->queueInLoop([&done]() {
+              done.store(done.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_release);
+            });
+        },
+        "BenchProducer"));
+  }
+  state.resumeTiming();
+
+  for (size_t p = 0; p < threads.size(); ++p) threads[p]->start();
+  for (size_t p = 0; p < threads.size(); ++p) threads[p]->join();
+  while (done.load(std::memory_order_acquire) < total) sched_yield();
+
+  state.pauseTiming();
+  state.setItemsProcessed(total);
+}
+BENCHMARK_ARG(BM_QueueInLoopCrossThread, 1);
+BENCHMARK_ARG(BM_QueueInLoopCrossThread, 4);
+
+}  // namespace
@@ -0,0 +1,409 @@
+// RPC编解码用例，依赖jsoncpp，找不到jsoncpp时不编译这个文件
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Benchmark.h"
+#include "rpc/Crc32c.h"
+#include "rpc/JsonProtocolHandler.h"
+#include "rpc/MsgpackProtocolHandler.h"
+#include "rpc/RpcCompression.h"
+#include "rpc/RpcPendingTable.h"
+
+namespace {
+
+// 构造一个params约为size字节的JSON对象
+std::string makeParams(int64_t size) {
+  std::string params = "{\"user\":\"bench\",\"data\":\"";
+  params.append(static_cast<size_t>(size), 'a');
+  params += "\"}";
+  return params;
+}
+
+RpcRequest makeRequest(int64_t size) {
+  RpcRequest request("echo", makeParams(size));
+  request.setMessageId(12345);
+  return request;
+}
+
+// 下面几个函数对各个协议处理器通用，每个协议再包一层注册
+void encodeRequest(BenchState& state, RpcProtocolHandler& handler) {
+  RpcRequest request = makeRequest(state.arg());
+  int64_t bytes = 0;
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::string frame = handler.encodeRequest(request);
+    bytes += frame.size();
+    doNotOptimize(frame.data());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(bytes);
+}
+
+void decodeRequest(BenchState& state, RpcProtocolHandler& handler) {
+  std::string frame = handler.encodeRequest(makeRequest(state.arg()));
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::unique_ptr<RpcRequest> request = handler.decodeRequest(frame);
+    if (!request) abort();
+    doNotOptimize(request.get());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(state.iterations() * frame.size());
+}
+
+// 只在帧上解析出method/params的位置，不构造RpcRequest
+void decodeRequestView(BenchState& state, RpcProtocolHandler& handler) {
+  std::string frame = handler.encodeRequest(makeRequest(state.arg()));
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    RpcRequestView view;
+    if (!handler.decodeRequestView(frame, view)) abort();
+    doNotOptimize(view.params.data());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(state.iterations() * frame.size());
+}
+
+void encodeResponse(BenchState& state, RpcProtocolHandler& handler) {
+  RpcResponse response(12345, makeParams(state.arg()));
+  int64_t bytes = 0;
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::string frame = handler.encodeResponse(response);
+    bytes += frame.size();
+    doNotOptimize(frame.data());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(bytes);
+}
+
+void decodeResponse(BenchState& state, RpcProtocolHandler& handler) {
+  std::string frame =
+      handler.encodeResponse(RpcResponse(12345, makeParams(state.arg())));
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::unique_ptr<RpcResponse> response = handler.decodeResponse(frame);
+    if (!response) abort();
+    doNotOptimize(response.get());
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(state.iterations() * frame.size());
+}
+
+// 每个用例跑小(64B)、中(4KB)、大(1MB)三种payload。
+// 一次展开注册三个，不能用按行号命名的BENCHMARK_ARG
+#define CODEC_BENCHMARKS(name, Handler, op)                                   \
+  void BM_##name(BenchState& state) {                                         \
+    Handler handler;                                                          \
+    op(state, handler);                                                       \
+  }                                                                           \
+  BenchRegistrar name##Small("BM_" #name, BM_##name, 64, true);               \
+  BenchRegistrar name##Medium("BM_" #name, BM_##name, 4096, true);            \
+  BenchRegistrar name##Large("BM_" #name, BM_##name, 1 << 20, true)
+
+CODEC_BENCHMARKS(JsonEncodeRequest, JsonProtocolHandler, encodeRequest);
+CODEC_BENCHMARKS(JsonDecodeRequest, JsonProtocolHandler, decodeRequest);
+CODEC_BENCHMARKS(JsonDecodeRequestView, JsonProtocolHandler, decodeRequestView);
+CODEC_BENCHMARKS(JsonEncodeResponse, JsonProtocolHandler, encodeResponse);
+CODEC_BENCHMARKS(JsonDecodeResponse, JsonProtocolHandler, decodeResponse);
+
+CODEC_BENCHMARKS(MsgpackEncodeRequest, MsgpackProtocolHandler, encodeRequest);
+CODEC_BENCHMARKS(MsgpackDecodeRequest, MsgpackProtocolHandler, decodeRequest);
+CODEC_BENCHMARKS(MsgpackDecodeRequestView, MsgpackProtocolHandler, decodeRequestView);
+CODEC_BENCHMARKS(MsgpackEncodeResponse, MsgpackProtocolHandler, encodeResponse);
+CODEC_BENCHMARKS(MsgpackDecodeResponse, MsgpackProtocolHandler, decodeResponse);
+
+// arg个64字节的小请求：逐个编成单独的帧，还是编成一个BATCH帧。每个请求算一项
+std::vector<RpcRequest> makeRequests(int64_t count) {
+  std::vector<RpcRequest> requests;
+  for (int64_t i = 0; i < count; ++i) {
+    requests.push_back(makeRequest(64));
+    requests.back().setMessageId(static_cast<uint32_t>(i + 1));
+  }
+  return requests;
+}
+
+void encodeSeparate(BenchState& state, RpcProtocolHandler& handler) {
+  std::vector<RpcRequest> requests = makeRequests(state.arg());
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::string output;
+    for (size_t j = 0; j < requests.size(); ++j)
+      output += handler.encodeRequest(requests[j]);
+    doNotOptimize(output.data());
+  }
+  state.setItemsProcessed(state.iterations() * state.arg());
+}
+
+void encodeBatch(BenchState& state, RpcProtocolHandler& handler) {
+  std::vector<RpcRequest> requests = makeRequests(state.arg());
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::string output = handler.encodeRequestBatch(requests);
+    doNotOptimize(output.data());
+  }
+  state.setItemsProcessed(state.iterations() * state.arg());
+}
+
+// 服务端的解码：逐帧decodeRequestView，还是一次decodeRequestBatch
+void decodeSeparate(BenchState& state, RpcProtocolHandler& handler) {
+  std::vector<RpcRequest> requests = makeRequests(state.arg());
+  std::vector<std::string> frames;
+  for (size_t j = 0; j < requests.size(); ++j)
+    frames.push_back(handler.encodeRequest(requests[j]));
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    for (size_t j = 0; j < frames.size(); ++j) {
+      RpcRequestView view;
+      if (!handler.decodeRequestView(frames[j], view)) abort();
+      doNotOptimize(view.params.data());
+    }
+  }
+  state.setItemsProcessed(state.iterations() * state.arg());
+}
+
+void decodeBatch(BenchState& state, RpcProtocolHandler& handler) {
+  std::string frame = handler.encodeRequestBatch(makeRequests(state.arg()));
+  std::vector<RpcRequestView> views;
+  std::vector<std::unique_ptr<RpcRequest>> owned;
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    if (!handler.decodeRequestBatch(frame, views, owned)) abort();
+    doNotOptimize(views.data());
+  }
+  state.setItemsProcessed(state.iterations() * state.arg());
+}
+
+#define BATCH_BENCHMARK(name, Handler, op) \
+  void BM_##name(BenchState& state) {      \
+    Handler handler;                       \
+    op(state, handler);                    \
+  }                                        \
+  BENCHMARK_ARG(BM_##name, 16)
+
+BATCH_BENCHMARK(JsonEncodeSeparate, JsonProtocolHandler, encodeSeparate);
+BATCH_BENCHMARK(JsonEncodeBatch, JsonProtocolHandler, encodeBatch);
+BATCH_BENCHMARK(JsonDecodeSeparate, JsonProtocolHandler, decodeSeparate);
+BATCH_BENCHMARK(JsonDecodeBatch, JsonProtocolHandler, decodeBatch);
+BATCH_BENCHMARK(MsgpackEncodeSeparate, MsgpackProtocolHandler, encodeSeparate);
+BATCH_BENCHMARK(MsgpackEncodeBatch, MsgpackProtocolHandler, encodeBatch);
+BATCH_BENCHMARK(MsgpackDecodeSeparate, MsgpackProtocolHandler, decodeSeparate);
+BATCH_BENCHMARK(MsgpackDecodeBatch, MsgpackProtocolHandler, decodeBatch);
+
+// 方法分发：在帧上解出请求，再找到对应的方法。注册了arg个方法，调用中间那个。
+// 按名字是RpcServer原来的unordered_map<string>查找，按编号是rpc.methods之后的下标访问
+struct DispatchTable {
+  std::vector<std::string> names;  // 下标就是方法编号，0号不用
+  std::unordered_map<std::string, uint32_t> ids;
+
+  explicit DispatchTable(int64_t count) : names(1) {
+    for (int64_t i = 0; i < count; ++i) {
+      std::string name = "method" + std::to_string(i);
+      ids[name] = static_cast<uint32_t>(names.size());
+      names.push_back(name);
+    }
+  }
+};
+
+void dispatch(BenchState& state, RpcProtocolHandler& handler, bool byId) {
+  DispatchTable table(state.arg());
+  uint32_t methodId = static_cast<uint32_t>(table.names.size() / 2);
+  RpcRequest request(table.names[methodId], makeParams(64));
+  request.setMessageId(12345);
+  if (byId) request.setMethodId(methodId);
+  std::string frame = handler.encodeRequest(request);
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    RpcRequestView view;
+    if (!handler.decodeRequestView(frame, view)) abort();
+    uint32_t id;
+    if (view.methodId != 0) {
+      if (view.methodId >= table.names.size()) abort();
+      id = view.methodId;
+    } else {
+      auto it = table.ids.find(std::string(view.method));
+      if (it == table.ids.end()) abort();
+      id = it->second;
+    }
+    doNotOptimize(&table.names[id]);
+  }
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(state.iterations() * frame.size());
+}
+
+void dispatchByName(BenchState& state, RpcProtocolHandler& handler) {
+  dispatch(state, handler, false);
+}
+
+void dispatchById(BenchState& state, RpcProtocolHandler& handler) {
+  dispatch(state, handler, true);
+}
+
+#define DISPATCH_BENCHMARK(name, Handler, op) \
+  void BM_##name(BenchState& state) {         \
+    Handler handler;                          \
+    op(state, handler);                       \
+  }                                           \
+  BENCHMARK_ARG(BM_##name, 32)
+
+DISPATCH_BENCHMARK(JsonDispatchByName, JsonProtocolHandler, dispatchByName);
+DISPATCH_BENCHMARK(JsonDispatchById, JsonProtocolHandler, dispatchById);
+DISPATCH_BENCHMARK(MsgpackDispatchByName, MsgpackProtocolHandler, dispatchByName);
+DISPATCH_BENCHMARK(MsgpackDispatchById, MsgpackProtocolHandler, dispatchById);
+
+// 校验和：旧的累加哈希、CRC32C(运行时选择硬件或软件实现)、CRC32C纯软件
+void checksum(BenchState& state, uint32_t (*func)(const char*, size_t)) {
+  std::string data(static_cast<size_t>(state.arg()), 'x');
+  for (int64_t i = 0; i < state.iterations(); ++i)
+    doNotOptimize(func(data.data(), data.size()));
+  state.setBytesProcessed(state.iterations() * data.size());
+}
+
+uint32_t legacyChecksum(const char* data, size_t len) {
+  return rpcChecksum(kRpcLegacyVersion, data, len);
+}
+
+void BM_ChecksumLegacy(BenchState& state) { checksum(state, legacyChecksum); }
+BENCHMARK_ARG(BM_ChecksumLegacy, 64);
+BENCHMARK_ARG(BM_ChecksumLegacy, 4096);
+BENCHMARK_ARG(BM_ChecksumLegacy, 1 << 20);
+
+void BM_Crc32c(BenchState& state) { checksum(state, crc32c); }
+BENCHMARK_ARG(BM_Crc32c, 64);
+BENCHMARK_ARG(BM_Crc32c, 4096);
+BENCHMARK_ARG(BM_Crc32c, 1 << 20);
+
+void BM_Crc32cSoftware(BenchState& state) { checksum(state, crc32cSoftware); }
+BENCHMARK_ARG(BM_Crc32cSoftware, 64);
+BENCHMARK_ARG(BM_Crc32cSoftware, 4096);
+BENCHMARK_ARG(BM_Crc32cSoftware, 1 << 20);
+
+// 消息体压缩：整帧压缩/解压，消息体是一串像业务数据的JSON记录(有重复但不是全相同的字节)。
+// 不到阈值的帧只解析消息头就返回，BM_CompressBelowThreshold看这部分开销。
+// 算法没有编译进来时压缩直接返回false，label里注明
+std::string makeRecordsFrame(int64_t size) {
+  std::string result = "[";
+  uint32_t x = 12345;
+  while (result.size() < static_cast<size_t>(size)) {
+    x = x * 1103515245 + 12345;
+    result += "{\"id\":" + std::to_string(x % 100000) + ",\"name\":\"user" +
+              std::to_string(x % 977) + "\",\"score\":" +
+              std::to_string((x >> 8) % 1000) + "},";
+  }
+  result.back() = ']';
+  MsgpackProtocolHandler handler;
+  return handler.encodeResponse(RpcResponse(12345, result));
+}
+
+// 没编进去的算法不注册，免得空跑出一条假结果
+#if defined(RPC_HAVE_LZ4) || defined(RPC_HAVE_ZSTD)
+void compress(BenchState& state, RpcCompression codec) {
+  const std::string frame = makeRecordsFrame(state.arg());
+  size_t compressedSize = frame.size();
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    std::string copy = frame;
+    compressRpcFrame(copy, codec, 1024);
+    compressedSize = copy.size();
+    doNotOptimize(copy.data());
+  }
+  state.setBytesProcessed(state.iterations() * frame.size());
+  char label[32];
+  snprintf(label, sizeof label, "ratio %.2f",
+           static_cast<double>(frame.size()) / compressedSize);
+  state.setLabel(label);
+}
+
+void decompress(BenchState& state, RpcCompression codec) {
+  std::string frame = makeRecordsFrame(state.arg());
+  size_t rawSize = frame.size();
+  if (!compressRpcFrame(frame, codec, 1024)) abort();
+  std::string out;
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    if (!decompressRpcFrame(frame, out)) abort();
+    doNotOptimize(out.data());
+  }
+  state.setBytesProcessed(state.iterations() * rawSize);
+}
+#endif
+
+void BM_CompressBelowThreshold(BenchState& state) {
+  std::string frame = makeRecordsFrame(state.arg());
+  for (int64_t i = 0; i < state.iterations(); ++i)
+    doNotOptimize(compressRpcFrame(frame, RpcCompression::LZ4, 4096));
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_CompressBelowThreshold, 256);
+
+#ifdef RPC_HAVE_LZ4
+void BM_CompressLz4(BenchState& state) { compress(state, RpcCompression::LZ4); }
+BENCHMARK_ARG(BM_CompressLz4, 4096);
+BENCHMARK_ARG(BM_CompressLz4, 1 << 20);
+
+void BM_DecompressLz4(BenchState& state) { decompress(state, RpcCompression::LZ4); }
+BENCHMARK_ARG(BM_DecompressLz4, 4096);
+BENCHMARK_ARG(BM_DecompressLz4, 1 << 20);
+#endif
+
+#ifdef RPC_HAVE_ZSTD
+void BM_CompressZstd(BenchState& state) { compress(state, RpcCompression::ZSTD); }
+BENCHMARK_ARG(BM_CompressZstd, 4096);
+BENCHMARK_ARG(BM_CompressZstd, 1 << 20);
+
+void BM_DecompressZstd(BenchState& state) { decompress(state, RpcCompression::ZSTD); }
+BENCHMARK_ARG(BM_DecompressZstd, 4096);
+BENCHMARK_ARG(BM_DecompressZstd, 1 << 20);
+#endif
+
+// 未完成请求表：登记一个请求再按messageId取走，表里始终另有arg个请求在等。
+// BM_PendingMap是RpcClient原来的做法，unordered_map + mutex，每个请求new一个带promise的对象
+struct MapPendingRequest {
+  uint32_t messageId;
+  std::promise<RpcResponse> promise;
+  RpcCallback callback;
+};
+
+void BM_PendingMap(BenchState& state) {
+  std::mutex mutex;
+  std::unordered_map<uint32_t, std::unique_ptr<MapPendingRequest>> pending;
+  uint32_t nextId = 1;
+  auto add = [&]() {
+    auto request = std::make_unique<MapPendingRequest>();
+    request->messageId = nextId++;
+    request->callback = [](const RpcResponse&) {};
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t id = request->messageId;
+    pending[id] = std::move(request);
+    return id;
+  };
+  for (int64_t i = 0; i < state.arg(); ++i) add();
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    uint32_t id = add();
+    std::unique_ptr<MapPendingRequest> request;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      auto it = pending.find(id);
+      request = std::move(it->second);
+      pending.erase(it);
+    }
+    doNotOptimize(request.get());
+  }
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_PendingMap, 0);
+BENCHMARK_ARG(BM_PendingMap, 256);
+
+void BM_PendingTable(BenchState& state) {
+  RpcPendingTable table(12);
+  auto add = [&]() {
+    RpcPendingRequest* request = table.claim();
+    request->callback = [](const RpcResponse&) {};
+    uint32_t id = request->messageId;
+    table.publish(request);
+    return id;
+  };
+  for (int64_t i = 0; i < state.arg(); ++i) add();
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    RpcPendingRequest* request = table.take(add());
+    doNotOptimize(request);
+    table.release(request);
+  }
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_PendingTable, 0);
+BENCHMARK_ARG(BM_PendingTable, 256);
+
+}  // namespace
@@ -0,0 +1,121 @@
+// RPC传输层用例：同一进程里起RpcServer，RpcClient同步调用echo，
+// 对比本机TCP、Unix域socket和共享内存环的往返延迟。依赖jsoncpp，和RpcCodecBench一起编译
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include "Benchmark.h"
+#include "EventLoop.h"
+#include "EventLoopThread.h"
+#include "rpc/RpcClient.h"
+#include "rpc/RpcConfig.h"
+#include "rpc/RpcServer.h"
+
+namespace {
+
+const int kTcpPort = 47123;
+
+const std::string& unixPath() {
+  static const std::string path =
+      "/tmp/microbench-rpc-" + std::to_string(getpid()) + ".sock";
+  return path;
+}
+
+// 服务端线程不会退出，socket文件在进程退出时删掉
+struct SocketFileRemover {
+  ~SocketFileRemover() { unlink(unixPath().c_str()); }
+};
+
+// 每种监听方式起一个服务端，第一次用到时启动，跑到进程退出。
+// echo方法在IO线程里直接返回参数
+void ensureServer(bool unixSocket) {
+  static bool started[2] = {false, false};
+  if (started[unixSocket]) return;
+  started[unixSocket] = true;
+  if (unixSocket) {
+    static SocketFileRemover remover;
+  }
+  std::promise<void> ready;
+  std::future<void> readyFuture = ready.get_future();
+  std::thread([unixSocket, &ready]() {
+    EventLoop loop;
+    std::unique_ptr<RpcServer> server =
+        unixSocket ? std::make_unique<RpcServer>(&loop, unixPath())
+                   : std::make_unique<RpcServer>(&loop, kTcpPort);
+    server->registerMethod("echo",
+                           [](const std::string& params) { return params; });
+    server->start();
+    ready.set_value();
+    loop.loop();
+  }).detach();
+  readyFuture.wait();
+}
+
+// RpcClient构造时读transport_type，配置只能从文件加载，这里写一个临时文件
+void setTransport(const char* type) {
+  char path[] = "/tmp/microbench-rpc-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) abort();
+  std::string line = std::string("transport_type=") + type + "\n";
+  if (write(fd, line.data(), line.size()) != static_cast<ssize_t>(line.size()))
+    abort();
+  close(fd);
+  RpcConfig::getInstance().loadConfig(path);
+  unlink(path);
+}
+
+// 一次迭代 = 一次call()，params约为arg字节。
+// 延迟包括调用方线程、客户端loop线程、服务端IO线程之间的三次唤醒
+void roundTrip(BenchState& state, const std::string& host,
+               const char* transport) {
+  state.pauseTiming();
+  ensureServer(host != "127.0.0.1");
+  setTransport(transport);
+  std::string params = "{\"data\":\"";
+  params.append(static_cast<size_t>(state.arg()), 'a');
+  params += "\"}";
+
+  EventLoopThread loopThread;
+  EventLoop* loop = loopThread.startLoop();
+  {
+    RpcClient client(loop, host, kTcpPort);
+    // 第一次调用等连接建立(和共享内存握手)完成，不计时
+    if (!client.connect() || !client.call("echo", params).isSuccess()) {
+      fprintf(stderr, "%s: echo failed\n", transport);
+      abort();
+    }
+    state.resumeTiming();
+    for (int64_t i = 0; i < state.iterations(); ++i) {
+      RpcResponse response = client.call("echo", params);
+      doNotOptimize(response);
+    }
+    state.pauseTiming();
+  }
+  setTransport("TCP");
+  state.setItemsProcessed(state.iterations());
+  state.setBytesProcessed(state.iterations() * 2 *
+                          static_cast<int64_t>(params.size()));
+}
+
+void BM_RpcRoundTripTcp(BenchState& state) {
+  roundTrip(state, "127.0.0.1", "TCP");
+}
+BENCHMARK_ARG(BM_RpcRoundTripTcp, 64);
+BENCHMARK_ARG(BM_RpcRoundTripTcp, 16384);
+
+void BM_RpcRoundTripUnix(BenchState& state) {
+  roundTrip(state, "unix:" + unixPath(), "UNIX");
+}
+BENCHMARK_ARG(BM_RpcRoundTripUnix, 64);
+BENCHMARK_ARG(BM_RpcRoundTripUnix, 16384);
+
+void BM_RpcRoundTripShm(BenchState& state) {
+  roundTrip(state, "unix:" + unixPath(), "SHM");
+}
+BENCHMARK_ARG(BM_RpcRoundTripShm, 64);
+BENCHMARK_ARG(BM_RpcRoundTripShm, 16384);
+
+}  // namespace
@@ -0,0 +1,135 @@
+// 线程池用例：旧的静态ThreadPool和base/WorkStealingPool对比
+//   Throughput  主线程连续提交arg个线程的池，每个任务只给计数器加1，等全部执行完
+//   Latency     提交一个任务、等它执行完再提交下一个，测一次唤醒往返
+//   Spawn       只有WorkStealingPool：任务在工作线程里再派生子任务，走自己的双端队列
+#include <sched.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "Benchmark.h"
+#include "ThreadPool.h"
+#include "base/WorkStealingPool.h"
+
+namespace {
+
+const int kQueueSize = 65535;
+
+// ThreadPool全是静态成员，destroy之后锁也销毁了，不能再create，
+// 所以整个进程只建一次，线程数取第一次用到时的arg
+void ensureThreadPool(int threads) {
+  static bool created = false;
+  if (!created) {
+    ThreadPool::threadpool_create(threads, kQueueSize);
+    created = true;
+  }
+}
+
+void waitFor(const std::atomic<int64_t>& counter, int64_t target) {
+  while (counter.load(std::memory_order_acquire) < target) sched_yield();
+}
+
+void increment(std::atomic<int64_t>* counter) {
+  counter->fetch_add(1, std::memory_order_release);
+}
+
+void threadPoolTask(std::atomic<int64_t>* counter, std::shared_ptr<void>) {
+  increment(counter);
+}
+
+void BM_ThreadPoolThroughput(BenchState& state) {
+  ensureThreadPool(static_cast<int>(state.arg()));
+  std::atomic<int64_t> done(0);
+  std::function<void(std::shared_ptr<void>)> task =
+      std::bind(threadPoolTask, &done, std::placeholders::_1);
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    // 队列满时只能重试
+    while (ThreadPool::threadpool_add(std::shared_ptr<void>(), task) ==
+           THREADPOOL_QUEUE_FULL)
+      sched_yield();
+  }
+  waitFor(done, state.iterations());
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_ThreadPoolThroughput, 4);
+
+void BM_WorkStealingThroughput(BenchState& state) {
+  state.pauseTiming();
+  WorkStealingPool pool(static_cast<int>(state.arg()));
+  pool.start();
+  std::atomic<int64_t> done(0);
+  state.resumeTiming();
+
+  for (int64_t i = 0; i < state.iterations(); ++i)
+    pool.submit(std::bind(increment, &done));
+  waitFor(done, state.iterations());
+
+  state.pauseTiming();
+  pool.stop();
+  state.resumeTiming();
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_WorkStealingThroughput, 1);
+BENCHMARK_ARG(BM_WorkStealingThroughput, 4);
+
+void BM_ThreadPoolLatency(BenchState& state) {
+  ensureThreadPool(static_cast<int>(state.arg()));
+  std::atomic<int64_t> done(0);
+  std::function<void(std::shared_ptr<void>)> task =
+      std::bind(threadPoolTask, &done, std::placeholders::_1);
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    ThreadPool::threadpool_add(std::shared_ptr<void>(), task);
+    waitFor(done, i + 1);
+  }
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_ThreadPoolLatency, 4);
+
+void BM_WorkStealingLatency(BenchState& state) {
+  state.pauseTiming();
+  WorkStealingPool pool(static_cast<int>(state.arg()));
+  pool.start();
+  std::atomic<int64_t> done(0);
+  state.resumeTiming();
+
+  for (int64_t i = 0; i < state.iterations(); ++i) {
+    pool.submit(std::bind(increment, &done));
+    waitFor(done, i + 1);
+  }
+
+  state.pauseTiming();
+  pool.stop();
+  state.resumeTiming();
+  state.setItemsProcessed(state.iterations());
+}
+BENCHMARK_ARG(BM_WorkStealingLatency, 4);
+
+// 二叉树式派生：每个任务派生两个子任务，直到叶子；叶子数等于iterations向上取整到2的幂
+void spawnTree(WorkStealingPool* pool, std::atomic<int64_t>* leaves, int depth) {
+  if (depth == 0) {
+    increment(leaves);
+    return;
+  }
+  pool->submit(std::bind(spawnTree, pool, leaves, depth - 1));
+  pool->submit(std::bind(spawnTree, pool, leaves, depth - 1));
+}
+
+void BM_WorkStealingSpawn(BenchState& state) {
+  int depth = 0;
+  while ((int64_t(1) << depth) < state.iterations()) ++depth;
+  state.pauseTiming();
+  WorkStealingPool pool(static_cast<int>(state.arg()));
+  pool.start();
+  std::atomic<int64_t> leaves(0);
+  state.resumeTiming();
+
+  pool.submit(std::bind(spawnTree, &pool, &leaves, depth));
+  waitFor(leaves, int64_t(1) << depth);
+
+  state.pauseTiming();
+  pool.stop();
+  state.resumeTiming();
+  state.setItemsProcessed(int64_t(2) << depth);
+}
+BENCHMARK_ARG(BM_WorkStealingSpawn, 4);
+
+}  // namespace
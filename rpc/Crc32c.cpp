@@ -0,0 +1,110 @@
+#include "Crc32c.h"
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define RPC_CRC32C_X86 1
+#endif
+
+namespace {
+
+const uint32_t kCrc32cPoly = 0x82f63b78;  // 0x1edc6f41按位反转
+
+// table[0]是普通的逐字节查表；table[k][b]表示字节b后面再跟k个0字节时的crc，
+// 这样一次可以并行查8个字节
+struct Crc32cTables {
+    uint32_t table[8][256];
+
+    constexpr Crc32cTables() : table() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ kCrc32cPoly : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                uint32_t prev = table[k - 1][i];
+                table[k][i] = (prev >> 8) ^ table[0][prev & 0xff];
+            }
+        }
+    }
+};
+
+constexpr Crc32cTables kTables;
+
+uint32_t extendSoftware(uint32_t crc, const uint8_t* p, size_t len) {
+    const auto& t = kTables.table;
+    while (len >= 8) {
+        // 逐字节拼成整数，和主机字节序无关，小端机器上编译器会合并成一次load
+        uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+                             static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+        uint32_t hi = static_cast<uint32_t>(p[4]) | static_cast<uint32_t>(p[5]) << 8 |
+                      static_cast<uint32_t>(p[6]) << 16 | static_cast<uint32_t>(p[7]) << 24;
+        crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = t[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef RPC_CRC32C_X86
+// 只有这个函数允许生成SSE4.2指令，其余代码仍按默认的目标架构编译，
+// 不支持的CPU上不会走到这里
+__attribute__((target("sse4.2"))) uint32_t extendHardware(uint32_t crc, const uint8_t* p,
+                                                          size_t len) {
+    uint64_t crc64 = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = static_cast<uint32_t>(crc64);
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+typedef uint32_t (*ExtendFunc)(uint32_t crc, const uint8_t* p, size_t len);
+
+ExtendFunc chooseExtend() {
+#ifdef RPC_CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        return extendHardware;
+    }
+#endif
+    return extendSoftware;
+}
+
+ExtendFunc extendFunc() {
+    static const ExtendFunc func = chooseExtend();
+    return func;
+}
+
+}  // namespace
+
+uint32_t crc32cExtend(uint32_t crc, const char* data, size_t len) {
+    return ~extendFunc()(~crc, reinterpret_cast<const uint8_t*>(data), len);
+}
+
+uint32_t crc32c(const char* data, size_t len) {
+    return crc32cExtend(0, data, len);
+}
+
+uint32_t crc32cSoftware(const char* data, size_t len) {
+    return ~extendSoftware(~0u, reinterpret_cast<const uint8_t*>(data), len);
+}
+
+bool crc32cHardwareAccelerated() {
+    return extendFunc() != extendSoftware;
+}
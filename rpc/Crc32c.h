@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C(Castagnoli多项式，和iSCSI、ext4、SCTP相同)。
+// 第一次调用时检测CPU：支持SSE4.2就用crc32指令，否则退回slicing-by-8查表。
+uint32_t crc32c(const char* data, size_t len);
+
+// 在已有的crc上继续计算，crc32c(a+b) == crc32cExtend(crc32c(a), b)
+uint32_t crc32cExtend(uint32_t crc, const char* data, size_t len);
+
+// 纯软件实现，和硬件实现结果一致，用于对照测试和基准
+uint32_t crc32cSoftware(const char* data, size_t len);
+
+// 当前进程是否使用了硬件指令
+bool crc32cHardwareAccelerated();
@@ -5,10 +5,245 @@
 #include <ctime>
 #include "../base/Logging.h"
 
-std::string JsonProtocolHandler::encodeRequest(const RpcRequest& request) {
+namespace {
+
+// 轻量的JSON扫描器，只做RPC需要的事：遍历顶层对象的字段，给出每个值的原始文本。
+// 嵌套的值整体跳过，不做完整的语法校验，params的内容留给方法自己解析
+class JsonScanner {
+public:
+    explicit JsonScanner(std::string_view text)
+        : p_(text.data()), end_(text.data() + text.size()) {}
+    
+    // visitor(key, rawValue)返回false时停止并返回false。
+    // key不含引号，rawValue是值的原始文本，字符串值带引号
+    template <typename Visitor>
+    bool scanObject(Visitor&& visitor) {
+        return scanFields(visitor) && atEnd();
+    }
+    
+    // 遍历顶层数组，元素必须是对象，直接扫描它的字段，不先整体跳过一遍。
+    // field(key, rawValue)同scanObject，返回false表示放弃这个元素剩下的字段；
+    // element(rawElement, complete)在每个元素结束时调用，complete为false说明field中途放弃了。
+    // element返回false时停止并返回false
+    template <typename Field, typename Element>
+    bool scanObjectArray(Field&& field, Element&& element) {
+        skipSpaces();
+        if (!consume('[')) {
+            return false;
+        }
+        skipSpaces();
+        if (consume(']')) {
+            return atEnd();
+        }
+        while (true) {
+            skipSpaces();
+            const char* elementStart = p_;
+            bool complete = true;
+            if (!scanFields([&](std::string_view key, std::string_view value) {
+                    return complete = field(key, value);
+                })) {
+                // 语法错误直接失败；field放弃时从元素开头整体跳过
+                if (complete) {
+                    return false;
+                }
+                p_ = elementStart;
+                if (!skipValue()) {
+                    return false;
+                }
+            }
+            if (!element(std::string_view(elementStart, p_ - elementStart), complete)) {
+                return false;
+            }
+            skipSpaces();
+            if (consume(',')) {
+                continue;
+            }
+            return consume(']') && atEnd();
+        }
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+    
+    // 扫描一个对象，p_停在结尾的'}'之后
+    template <typename Visitor>
+    bool scanFields(Visitor&& visitor) {
+        skipSpaces();
+        if (!consume('{')) {
+            return false;
+        }
+        skipSpaces();
+        if (consume('}')) {
+            return true;
+        }
+        while (true) {
+            skipSpaces();
+            const char* keyStart = p_;
+            if (!skipString()) {
+                return false;
+            }
+            std::string_view key(keyStart + 1, p_ - keyStart - 2);
+            skipSpaces();
+            if (!consume(':')) {
+                return false;
+            }
+            skipSpaces();
+            const char* valueStart = p_;
+            if (!skipValue()) {
+                return false;
+            }
+            if (!visitor(key, std::string_view(valueStart, p_ - valueStart))) {
+                return false;
+            }
+            skipSpaces();
+            if (consume(',')) {
+                continue;
+            }
+            return consume('}');
+        }
+    }
+    
+    bool atEnd() {
+        skipSpaces();
+        return p_ == end_;
+    }
+    
+    void skipSpaces() {
+        while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r' || *p_ == '\n')) {
+            ++p_;
+        }
+    }
+    
+    bool consume(char c) {
+        if (p_ != end_ && *p_ == c) {
+            ++p_;
+            return true;
+        }
+        return false;
+    }
+    
+    // 跳过一个带引号的字符串，p_停在结尾引号之后
+    bool skipString() {
+        if (!consume('"')) {
+            return false;
+        }
+        while (p_ != end_) {
+            char c = *p_++;
+            if (c == '\\') {
+                if (p_ == end_) {
+                    return false;
+                }
+                ++p_;
+            } else if (c == '"') {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    bool skipValue() {
+        if (p_ == end_) {
+            return false;
+        }
+        if (*p_ == '"') {
+            return skipString();
+        }
+        if (*p_ == '{' || *p_ == '[') {
+            int depth = 0;
+            while (p_ != end_) {
+                char c = *p_;
+                if (c == '"') {
+                    if (!skipString()) {
+                        return false;
+                    }
+                    continue;
+                }
+                ++p_;
+                if (c == '{' || c == '[') {
+                    ++depth;
+                } else if ((c == '}' || c == ']') && --depth == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        // 数字、true、false、null
+        const char* start = p_;
+        while (p_ != end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && *p_ != ' ' &&
+               *p_ != '\t' && *p_ != '\r' && *p_ != '\n') {
+            ++p_;
+        }
+        return p_ != start;
+    }
+};
+
+// 把原始文本形式的编号(消息id、方法编号)解析成uint32，null当作0
+bool parseId(std::string_view raw, uint32_t& id) {
+    if (raw == "null") {
+        id = 0;
+        return true;
+    }
+    if (raw.empty() || raw.size() > 10) {
+        return false;
+    }
+    uint64_t value = 0;
+    for (char c : raw) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (c - '0');
+    }
+    if (value > UINT32_MAX) {
+        return false;
+    }
+    id = static_cast<uint32_t>(value);
+    return true;
+}
+
+// 在请求对象的字段里取出method/params(以及batch元素的id)，不建Json::Value。
+// method可以是方法名，也可以是rpc.methods分配的编号。
+// method带转义或者id不是无符号整数时返回false，由调用方退回完整解析
+struct RequestFields {
+    RpcRequestView view;
+    bool readId;
+    bool hasMethod = false;
+    
+    explicit RequestFields(bool withId) : readId(withId) {}
+    
+    bool operator()(std::string_view key, std::string_view value) {
+        if (key == "method") {
+            if (!value.empty() && value.front() >= '0' && value.front() <= '9') {
+                hasMethod = parseId(value, view.methodId) && view.methodId != 0;
+                return hasMethod;
+            }
+            // 带转义的method需要还原，交给完整解析
+            if (value.size() < 2 || value.front() != '"' ||
+                value.find('\\') != std::string_view::npos) {
+                return false;
+            }
+            view.method = value.substr(1, value.size() - 2);
+            hasMethod = true;
+        } else if (key == "params") {
+            view.params = value;
+        } else if (key == "id" && readId) {
+            return parseId(value, view.messageId);
+        }
+        return true;
+    }
+};
+
+}  // namespace
+
+Json::Value JsonProtocolHandler::requestToJson(const RpcRequest& request) {
     Json::Value root;
     root["jsonrpc"] = "2.0";
-    root["method"] = request.getMethod();
+    // 有方法编号时只发编号，这是对JSON-RPC的扩展，只发给提供了rpc.methods的服务端
+    if (request.getMethodId() != 0) {
+        root["method"] = request.getMethodId();
+    } else {
+        root["method"] = request.getMethod();
+    }
     root["id"] = request.getMessageId();
     
     // 解析参数
@@ -21,21 +256,10 @@ std::string JsonProtocolHandler::encodeRequest(const RpcRequest& request) {
             root["params"] = request.getParams();
         }
     }
-    
-    std::string body = jsonToString(root);
-    
-    // 创建消息头
-    RpcMessageHeader header;
-    header.type = RpcMessageType::REQUEST;
-    header.messageId = request.getMessageId();
-    header.bodyLength = body.length();
-    header.checksum = calculateChecksum(body);
-    header.timestamp = time(nullptr);
-    
-    return createHeader(header) + body;
+    return root;
 }
 
-std::string JsonProtocolHandler::encodeResponse(const RpcResponse& response) {
+Json::Value JsonProtocolHandler::responseToJson(const RpcResponse& response) {
     Json::Value root;
     root["jsonrpc"] = "2.0";
     root["id"] = response.getMessageId();
@@ -54,33 +278,102 @@ std::string JsonProtocolHandler::encodeResponse(const RpcResponse& response) {
         error["message"] = response.getErrorMessage();
         root["error"] = error;
     }
+    return root;
+}
+
+bool JsonProtocolHandler::setRequestMethod(const Json::Value& method, RpcRequest& request) {
+    if (method.isUInt() && method.asUInt() != 0) {
+        request.setMethodId(method.asUInt());
+        return true;
+    }
+    if (method.isString()) {
+        request.setMethod(method.asString());
+        return true;
+    }
+    return false;
+}
+
+void JsonProtocolHandler::jsonToResponse(const Json::Value& root, RpcResponse& response) {
+    if (root.isMember("result")) {
+        response.setResult(jsonToString(root["result"]));
+    } else if (root.isMember("error")) {
+        Json::Value error = root["error"];
+        RpcErrorCode code = static_cast<RpcErrorCode>(error["code"].asInt());
+        std::string message = error["message"].asString();
+        response.setError(code, message);
+    }
+}
+
+std::string JsonProtocolHandler::encodeRequest(const RpcRequest& request) {
+    Json::Value root = requestToJson(request);
     
-    std::string body = jsonToString(root);
+    // 创建消息头
+    RpcMessageHeader header;
+    header.type = RpcMessageType::REQUEST;
+    header.messageId = request.getMessageId();
+    fillHeaderFormat(header, request);
+    
+    return buildFrame(header, jsonToString(root));
+}
+
+std::string JsonProtocolHandler::encodeResponse(const RpcResponse& response) {
+    Json::Value root = responseToJson(response);
     
     // 创建消息头
     RpcMessageHeader header;
     header.type = RpcMessageType::RESPONSE;
     header.messageId = response.getMessageId();
-    header.bodyLength = body.length();
-    header.checksum = calculateChecksum(body);
-    header.timestamp = time(nullptr);
+    fillHeaderFormat(header, response);
     
-    return createHeader(header) + body;
+    return buildFrame(header, jsonToString(root));
 }
 
-std::unique_ptr<RpcRequest> JsonProtocolHandler::decodeRequest(const std::string& data) {
-    if (!validateMessage(data)) {
-        return nullptr;
+std::string JsonProtocolHandler::encodeRequestBatch(const std::vector<RpcRequest>& requests) {
+    Json::Value root(Json::arrayValue);
+    for (const RpcRequest& request : requests) {
+        Json::Value item = requestToJson(request);
+        // JSON-RPC 2.0里没有id的元素是通知
+        if (request.getMessageId() == 0) {
+            item.removeMember("id");
+        }
+        root.append(item);
     }
     
-    // 解析消息头
-    RpcMessageHeader header = parseHeader(data);
-    if (header.type != RpcMessageType::REQUEST) {
+    RpcMessageHeader header;
+    header.type = RpcMessageType::BATCH;
+    header.messageId = static_cast<uint32_t>(requests.size());
+    fillHeaderFormat(header);
+    
+    return buildFrame(header, jsonToString(root));
+}
+
+std::string JsonProtocolHandler::encodeResponseBatch(const std::vector<RpcResponse>& responses) {
+    Json::Value root(Json::arrayValue);
+    for (const RpcResponse& response : responses) {
+        root.append(responseToJson(response));
+    }
+    
+    // 整批沿用第一个响应记录的请求帧格式
+    RpcMessageHeader header;
+    header.type = RpcMessageType::BATCH;
+    header.messageId = static_cast<uint32_t>(responses.size());
+    if (responses.empty()) {
+        fillHeaderFormat(header);
+    } else {
+        fillHeaderFormat(header, responses.front());
+    }
+    
+    return buildFrame(header, jsonToString(root));
+}
+
+std::unique_ptr<RpcRequest> JsonProtocolHandler::decodeRequest(const std::string& data) {
+    // 解析并校验消息头，取出消息体
+    RpcMessageHeader header;
+    std::string_view body;
+    if (!parseFrame(data, header, body) || header.type != RpcMessageType::REQUEST) {
         return nullptr;
     }
     
-    // 提取消息体
-    std::string body = data.substr(sizeof(RpcMessageHeader));
     Json::Value root = parseJson(body);
     
     if (root.isNull() || !root.isMember("method")) {
@@ -89,7 +382,9 @@ std::unique_ptr<RpcRequest> JsonProtocolHandler::decodeRequest(const std::string
     
     auto request = std::make_unique<RpcRequest>();
     request->setMessageId(header.messageId);
-    request->setMethod(root["method"].asString());
+    if (!setRequestMethod(root["method"], *request)) {
+        return nullptr;
+    }
     
     if (root.isMember("params")) {
         request->setParams(jsonToString(root["params"]));
@@ -99,18 +394,13 @@ std::unique_ptr<RpcRequest> JsonProtocolHandler::decodeRequest(const std::string
 }
 
 std::unique_ptr<RpcResponse> JsonProtocolHandler::decodeResponse(const std::string& data) {
-    if (!validateMessage(data)) {
-        return nullptr;
-    }
-    
-    // 解析消息头
-    RpcMessageHeader header = parseHeader(data);
-    if (header.type != RpcMessageType::RESPONSE) {
+    // 解析并校验消息头，取出消息体
+    RpcMessageHeader header;
+    std::string_view body;
+    if (!parseFrame(data, header, body) || header.type != RpcMessageType::RESPONSE) {
         return nullptr;
     }
     
-    // 提取消息体
-    std::string body = data.substr(sizeof(RpcMessageHeader));
     Json::Value root = parseJson(body);
     
     if (root.isNull()) {
@@ -119,58 +409,113 @@ std::unique_ptr<RpcResponse> JsonProtocolHandler::decodeResponse(const std::stri
     
     auto response = std::make_unique<RpcResponse>();
     response->setMessageId(header.messageId);
-    
-    if (root.isMember("result")) {
-        response->setResult(jsonToString(root["result"]));
-    } else if (root.isMember("error")) {
-        Json::Value error = root["error"];
-        RpcErrorCode code = static_cast<RpcErrorCode>(error["code"].asInt());
-        std::string message = error["message"].asString();
-        response->setError(code, message);
-    }
-    
+    jsonToResponse(root, *response);
     return response;
 }
 
-bool JsonProtocolHandler::validateMessage(const std::string& data) {
-    if (data.length() < sizeof(RpcMessageHeader)) {
+bool JsonProtocolHandler::decodeRequestView(std::string_view data, RpcRequestView& view) {
+    RpcMessageHeader header;
+    std::string_view body;
+    if (!parseFrame(data, header, body) || header.type != RpcMessageType::REQUEST) {
         return false;
     }
     
-    RpcMessageHeader header = parseHeader(data);
-    
-    // 验证魔数
-    if (header.magic != 0x12345678) {
+    // 只扫描顶层字段，params取原始文本，不建Json::Value；messageId以消息头为准
+    RequestFields fields(false);
+    if (!JsonScanner(body).scanObject(fields) || !fields.hasMethod) {
+        return false;
+    }
+    view = fields.view;
+    view.messageId = header.messageId;
+    return true;
+}
+
+bool JsonProtocolHandler::decodeRequestBatch(std::string_view data, std::vector<RpcRequestView>& views,
+                                             std::vector<std::unique_ptr<RpcRequest>>& owned) {
+    RpcMessageHeader header;
+    std::string_view body;
+    if (!parseFrame(data, header, body) || header.type != RpcMessageType::BATCH) {
         return false;
     }
     
-    // 验证消息长度
-    if (data.length() != sizeof(RpcMessageHeader) + header.bodyLength) {
+    views.clear();
+    RequestFields fields(true);
+    auto element = [&](std::string_view text, bool complete) {
+        bool scanned = complete && fields.hasMethod;
+        RpcRequestView view = fields.view;
+        fields = RequestFields(true);
+        if (scanned) {
+            views.push_back(view);
+            return true;
+        }
+        
+        // 零拷贝扫描不了的元素完整解析一遍，view指向owned里的字符串
+        Json::Value item = parseJson(text);
+        if (!item.isObject() || !(item["id"].isNull() || item["id"].isUInt())) {
+            return false;
+        }
+        auto request = std::make_unique<RpcRequest>();
+        request->setMessageId(item["id"].isNull() ? 0 : item["id"].asUInt());
+        if (!setRequestMethod(item["method"], *request)) {
+            return false;
+        }
+        if (item.isMember("params")) {
+            request->setParams(jsonToString(item["params"]));
+        }
+        view.messageId = request->getMessageId();
+        view.methodId = request->getMethodId();
+        view.method = request->getMethod();
+        view.params = request->getParams();
+        owned.push_back(std::move(request));
+        views.push_back(view);
+        return true;
+    };
+    bool ok = JsonScanner(body).scanObjectArray(fields, element);
+    // JSON-RPC 2.0里空数组是无效请求
+    return ok && !views.empty();
+}
+
+bool JsonProtocolHandler::decodeResponseBatch(std::string_view data, std::vector<RpcResponse>& responses) {
+    RpcMessageHeader header;
+    std::string_view body;
+    if (!parseFrame(data, header, body) || header.type != RpcMessageType::BATCH) {
         return false;
     }
     
-    // 验证校验和
-    std::string body = data.substr(sizeof(RpcMessageHeader));
-    if (header.checksum != calculateChecksum(body)) {
+    Json::Value root = parseJson(body);
+    if (!root.isArray() || root.empty()) {
         return false;
     }
     
+    responses.clear();
+    responses.reserve(root.size());
+    for (const Json::Value& item : root) {
+        if (!item.isObject() || !item["id"].isUInt()) {
+            return false;
+        }
+        RpcResponse response;
+        response.setMessageId(item["id"].asUInt());
+        jsonToResponse(item, response);
+        responses.push_back(std::move(response));
+    }
     return true;
 }
 
-uint32_t JsonProtocolHandler::calculateChecksum(const std::string& data) {
-    uint32_t checksum = 0;
-    for (char c : data) {
-        checksum = checksum * 31 + static_cast<uint32_t>(c);
-    }
-    return checksum;
+bool JsonProtocolHandler::validateMessage(const std::string& data) {
+    RpcMessageHeader header;
+    std::string_view body;
+    return parseFrame(data, header, body);
+}
+
+uint32_t JsonProtocolHandler::calculateChecksum(std::string_view data) {
+    return rpcChecksum(headerVersion_, data.data(), data.size());
 }
 
-Json::Value JsonProtocolHandler::parseJson(const std::string& data) {
+Json::Value JsonProtocolHandler::parseJson(std::string_view data) {
     Json::Value root;
     Json::Reader reader;
-    if (!reader.parse(data, root)) {
-        LOG << "Failed to parse JSON: " << data;
+    if (!reader.parse(data.data(), data.data() + data.size(), root)) {
+        LOG << "Failed to parse JSON: " << std::string(data);
         return Json::Value();
     }
     return root;
@@ -180,18 +525,4 @@ std::string JsonProtocolHandler::jsonToString(const Json::Value& json) {
     Json::StreamWriterBuilder builder;
     builder["indentation"] = "";
     return Json::writeString(builder, json);
-}
-
-RpcMessageHeader JsonProtocolHandler::parseHeader(const std::string& data) {
-    RpcMessageHeader header;
-    if (data.length() >= sizeof(RpcMessageHeader)) {
-        memcpy(&header, data.data(), sizeof(RpcMessageHeader));
-    }
-    return header;
-}
-
-std::string JsonProtocolHandler::createHeader(const RpcMessageHeader& header) {
-    std::string result(sizeof(RpcMessageHeader), '\0');
-    memcpy(&result[0], &header, sizeof(RpcMessageHeader));
-    return result;
 }
\ No newline at end of file
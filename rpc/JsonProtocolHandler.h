@@ -10,13 +10,29 @@ public:
     std::string encodeRequest(const RpcRequest& request) override;
     std::string encodeResponse(const RpcResponse& response) override;
     std::unique_ptr<RpcRequest> decodeRequest(const std::string& data) override;
+    bool decodeRequestView(std::string_view data, RpcRequestView& view) override;
     std::unique_ptr<RpcResponse> decodeResponse(const std::string& data) override;
+    
+    // 批量消息体是JSON-RPC 2.0的batch数组，每个元素带自己的id，通知不带id
+    bool supportsBatch() const override { return true; }
+    std::string encodeRequestBatch(const std::vector<RpcRequest>& requests) override;
+    std::string encodeResponseBatch(const std::vector<RpcResponse>& responses) override;
+    bool decodeRequestBatch(std::string_view data, std::vector<RpcRequestView>& views,
+                            std::vector<std::unique_ptr<RpcRequest>>& owned) override;
+    bool decodeResponseBatch(std::string_view data, std::vector<RpcResponse>& responses) override;
+    
     bool validateMessage(const std::string& data) override;
-    uint32_t calculateChecksum(const std::string& data) override;
+    uint32_t calculateChecksum(std::string_view data) override;
 
 private:
-    Json::Value parseJson(const std::string& data);
+    Json::Value parseJson(std::string_view data);
     std::string jsonToString(const Json::Value& json);
-    RpcMessageHeader parseHeader(const std::string& data);
-    std::string createHeader(const RpcMessageHeader& header);
+    
+    // 单个消息和batch元素共用的转换
+    Json::Value requestToJson(const RpcRequest& request);
+    Json::Value responseToJson(const RpcResponse& response);
+    void jsonToResponse(const Json::Value& root, RpcResponse& response);
+    
+    // method是方法名或者方法编号，两者都不是时返回false
+    bool setRequestMethod(const Json::Value& method, RpcRequest& request);
 };
\ No newline at end of file
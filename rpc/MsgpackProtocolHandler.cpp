@@ -0,0 +1,534 @@
+#include "MsgpackProtocolHandler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// ---- 编码 ----
+
+size_t strSize(size_t len) {
+    if (len < 32) return 1 + len;
+    if (len < 0x100) return 2 + len;
+    if (len < 0x10000) return 3 + len;
+    return 5 + len;
+}
+
+size_t binSize(size_t len) {
+    if (len < 0x100) return 2 + len;
+    if (len < 0x10000) return 3 + len;
+    return 5 + len;
+}
+
+size_t intSize(int32_t v) {
+    if (v >= -32 && v < 128) return 1;
+    if (v >= -128 && v < 128) return 2;
+    if (v >= -32768 && v < 32768) return 3;
+    return 5;
+}
+
+size_t uintSize(uint32_t v) {
+    if (v < 0x80) return 1;
+    if (v < 0x100) return 2;
+    if (v < 0x10000) return 3;
+    return 5;
+}
+
+size_t arraySize(size_t n) {
+    if (n < 16) return 1;
+    if (n < 0x10000) return 3;
+    return 5;
+}
+
+// MessagePack的多字节整数都是大端
+class MsgpackWriter {
+public:
+    explicit MsgpackWriter(char* buf) : p_(reinterpret_cast<uint8_t*>(buf)) {}
+
+    void array(size_t n) {
+        if (n < 16) {
+            *p_++ = static_cast<uint8_t>(0x90 | n);
+        } else if (n < 0x10000) {
+            *p_++ = 0xdc;
+            be16(static_cast<uint16_t>(n));
+        } else {
+            *p_++ = 0xdd;
+            be32(static_cast<uint32_t>(n));
+        }
+    }
+
+    void uinteger(uint32_t v) {
+        if (v < 0x80) {
+            *p_++ = static_cast<uint8_t>(v);
+        } else if (v < 0x100) {
+            *p_++ = 0xcc;
+            *p_++ = static_cast<uint8_t>(v);
+        } else if (v < 0x10000) {
+            *p_++ = 0xcd;
+            be16(static_cast<uint16_t>(v));
+        } else {
+            *p_++ = 0xce;
+            be32(v);
+        }
+    }
+
+    void integer(int32_t v) {
+        if (v >= -32 && v < 128) {
+            *p_++ = static_cast<uint8_t>(v);
+        } else if (v >= -128 && v < 128) {
+            *p_++ = 0xd0;
+            *p_++ = static_cast<uint8_t>(v);
+        } else if (v >= -32768 && v < 32768) {
+            *p_++ = 0xd1;
+            be16(static_cast<uint16_t>(v));
+        } else {
+            *p_++ = 0xd2;
+            be32(static_cast<uint32_t>(v));
+        }
+    }
+
+    void str(const std::string& s) {
+        size_t len = s.size();
+        if (len < 32) {
+            *p_++ = static_cast<uint8_t>(0xa0 | len);
+        } else if (len < 0x100) {
+            *p_++ = 0xd9;
+            *p_++ = static_cast<uint8_t>(len);
+        } else if (len < 0x10000) {
+            *p_++ = 0xda;
+            be16(static_cast<uint16_t>(len));
+        } else {
+            *p_++ = 0xdb;
+            be32(static_cast<uint32_t>(len));
+        }
+        raw(s);
+    }
+
+    void bin(const std::string& s) {
+        size_t len = s.size();
+        if (len < 0x100) {
+            *p_++ = 0xc4;
+            *p_++ = static_cast<uint8_t>(len);
+        } else if (len < 0x10000) {
+            *p_++ = 0xc5;
+            be16(static_cast<uint16_t>(len));
+        } else {
+            *p_++ = 0xc6;
+            be32(static_cast<uint32_t>(len));
+        }
+        raw(s);
+    }
+
+private:
+    uint8_t* p_;
+
+    void be16(uint16_t v) {
+        *p_++ = static_cast<uint8_t>(v >> 8);
+        *p_++ = static_cast<uint8_t>(v);
+    }
+
+    void be32(uint32_t v) {
+        *p_++ = static_cast<uint8_t>(v >> 24);
+        *p_++ = static_cast<uint8_t>(v >> 16);
+        *p_++ = static_cast<uint8_t>(v >> 8);
+        *p_++ = static_cast<uint8_t>(v);
+    }
+
+    void raw(const std::string& s) {
+        memcpy(p_, s.data(), s.size());
+        p_ += s.size();
+    }
+};
+
+// ---- 解码 ----
+
+// 在[p, end)上顺序读取，任何越界或类型不符都让ok()变为false
+class MsgpackReader {
+public:
+    MsgpackReader(const char* p, size_t len)
+        : p_(reinterpret_cast<const uint8_t*>(p)), end_(p_ + len), ok_(true) {}
+
+    bool ok() const { return ok_; }
+    bool atEnd() const { return p_ == end_; }
+
+    // 下一个值是不是无符号整数(正fixint或者uint8/16/32)
+    bool nextIsUnsigned() const {
+        return ok_ && p_ < end_ && (*p_ < 0x80 || (*p_ >= 0xcc && *p_ <= 0xce));
+    }
+
+    size_t array() {
+        if (!need(1)) return 0;
+        uint8_t b = *p_++;
+        if ((b & 0xf0) == 0x90) return b & 0x0f;
+        if (b == 0xdc && need(2)) return be16();
+        if (b == 0xdd && need(4)) return be32();
+        return fail();
+    }
+
+    int32_t integer() {
+        if (!need(1)) return 0;
+        uint8_t b = *p_++;
+        if (b < 0x80) return b;
+        if (b >= 0xe0) return static_cast<int8_t>(b);
+        switch (b) {
+            case 0xcc: return need(1) ? *p_++ : 0;
+            case 0xcd: return need(2) ? be16() : 0;
+            case 0xce: return need(4) ? static_cast<int32_t>(be32()) : 0;
+            case 0xd0: return need(1) ? static_cast<int8_t>(*p_++) : 0;
+            case 0xd1: return need(2) ? static_cast<int16_t>(be16()) : 0;
+            case 0xd2: return need(4) ? static_cast<int32_t>(be32()) : 0;
+            default: return static_cast<int32_t>(fail());
+        }
+    }
+
+    // str和bin都接受，返回的指针指向帧内的数据
+    const char* bytes(size_t& len) {
+        len = 0;
+        if (!need(1)) return nullptr;
+        uint8_t b = *p_++;
+        if ((b & 0xe0) == 0xa0) {
+            len = b & 0x1f;
+        } else if ((b == 0xd9 || b == 0xc4) && need(1)) {
+            len = *p_++;
+        } else if ((b == 0xda || b == 0xc5) && need(2)) {
+            len = be16();
+        } else if ((b == 0xdb || b == 0xc6) && need(4)) {
+            len = be32();
+        } else {
+            fail();
+            return nullptr;
+        }
+        if (!need(len)) return nullptr;
+        const char* data = reinterpret_cast<const char*>(p_);
+        p_ += len;
+        return data;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+    bool ok_;
+
+    bool need(size_t n) {
+        if (ok_ && static_cast<size_t>(end_ - p_) >= n) return true;
+        ok_ = false;
+        return false;
+    }
+
+    size_t fail() {
+        ok_ = false;
+        return 0;
+    }
+
+    uint16_t be16() {
+        uint16_t v = static_cast<uint16_t>((p_[0] << 8) | p_[1]);
+        p_ += 2;
+        return v;
+    }
+
+    uint32_t be32() {
+        uint32_t v = (static_cast<uint32_t>(p_[0]) << 24) | (static_cast<uint32_t>(p_[1]) << 16) |
+                     (static_cast<uint32_t>(p_[2]) << 8) | p_[3];
+        p_ += 4;
+        return v;
+    }
+};
+
+// 请求和响应除messageId以外的字段，单个消息和批量元素共用
+
+// 有方法编号时第一个字段写编号，否则写方法名
+
+size_t requestFieldsSize(const RpcRequest& request) {
+    size_t methodSize = request.getMethodId() != 0 ? uintSize(request.getMethodId())
+                                                   : strSize(request.getMethod().size());
+    return methodSize + binSize(request.getParams().size());
+}
+
+void writeRequestFields(MsgpackWriter& writer, const RpcRequest& request) {
+    if (request.getMethodId() != 0) {
+        writer.uinteger(request.getMethodId());
+    } else {
+        writer.str(request.getMethod());
+    }
+    writer.bin(request.getParams());
+}
+
+void readRequestFields(MsgpackReader& reader, RpcRequestView& view) {
+    if (reader.nextIsUnsigned()) {
+        view.methodId = static_cast<uint32_t>(reader.integer());
+        view.method = std::string_view();
+    } else {
+        size_t methodLength = 0;
+        const char* method = reader.bytes(methodLength);
+        view.methodId = 0;
+        view.method = std::string_view(method, methodLength);
+    }
+    size_t paramsLength = 0;
+    const char* params = reader.bytes(paramsLength);
+    view.params = std::string_view(params, paramsLength);
+}
+
+size_t responseFieldsSize(const RpcResponse& response) {
+    int32_t code = static_cast<int32_t>(response.getErrorCode());
+    return intSize(code) + (response.isSuccess() ? binSize(response.getResult().size())
+                                                 : strSize(response.getErrorMessage().size()));
+}
+
+void writeResponseFields(MsgpackWriter& writer, const RpcResponse& response) {
+    writer.integer(static_cast<int32_t>(response.getErrorCode()));
+    if (response.isSuccess()) {
+        writer.bin(response.getResult());
+    } else {
+        writer.str(response.getErrorMessage());
+    }
+}
+
+// 读取[errorCode, payload]，调用方检查reader.ok()
+void readResponseFields(MsgpackReader& reader, RpcResponse& response) {
+    size_t payloadLength = 0;
+    int32_t code = reader.integer();
+    const char* payload = reader.bytes(payloadLength);
+    if (!reader.ok()) {
+        return;
+    }
+    if (code == 0) {
+        response.setResult(std::string(payload, payloadLength));
+    } else {
+        response.setError(static_cast<RpcErrorCode>(code), std::string(payload, payloadLength));
+    }
+}
+
+}  // namespace
+
+// 消息体的长度可以提前算出来，这样消息头长度(varint时可变)也就确定了，
+// 整个帧一次分配，消息体直接写到消息头后面，再原地算校验和、回填消息头
+std::string MsgpackProtocolHandler::encodeRequest(const RpcRequest& request) {
+    RpcMessageHeader header;
+    header.type = RpcMessageType::REQUEST;
+    fillHeaderFormat(header, request);
+    header.messageId = request.getMessageId();
+    header.bodyLength = static_cast<uint32_t>(1 + requestFieldsSize(request));
+
+    char headerBuf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, headerBuf);
+    std::string frame(headerLength + header.bodyLength, '\0');
+    MsgpackWriter writer(&frame[headerLength]);
+    writer.array(2);
+    writeRequestFields(writer, request);
+
+    header.checksum = rpcFrameChecksum(header, frame.data() + headerLength);
+    encodeRpcHeader(header, &frame[0]);
+    return frame;
+}
+
+std::string MsgpackProtocolHandler::encodeResponse(const RpcResponse& response) {
+    RpcMessageHeader header;
+    header.type = RpcMessageType::RESPONSE;
+    fillHeaderFormat(header, response);
+    header.messageId = response.getMessageId();
+    header.bodyLength = static_cast<uint32_t>(1 + responseFieldsSize(response));
+
+    char headerBuf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, headerBuf);
+    std::string frame(headerLength + header.bodyLength, '\0');
+    MsgpackWriter writer(&frame[headerLength]);
+    writer.array(2);
+    writeResponseFields(writer, response);
+
+    header.checksum = rpcFrameChecksum(header, frame.data() + headerLength);
+    encodeRpcHeader(header, &frame[0]);
+    return frame;
+}
+
+// 批量帧和单个帧一样先算出整个消息体的长度，一次分配
+std::string MsgpackProtocolHandler::encodeRequestBatch(const std::vector<RpcRequest>& requests) {
+    RpcMessageHeader header;
+    header.type = RpcMessageType::BATCH;
+    fillHeaderFormat(header);
+    header.messageId = static_cast<uint32_t>(requests.size());
+    size_t bodyLength = arraySize(requests.size());
+    for (const RpcRequest& request : requests) {
+        bodyLength += 1 + uintSize(request.getMessageId()) + requestFieldsSize(request);
+    }
+    header.bodyLength = static_cast<uint32_t>(bodyLength);
+
+    char headerBuf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, headerBuf);
+    std::string frame(headerLength + header.bodyLength, '\0');
+    MsgpackWriter writer(&frame[headerLength]);
+    writer.array(requests.size());
+    for (const RpcRequest& request : requests) {
+        writer.array(3);
+        writer.uinteger(request.getMessageId());
+        writeRequestFields(writer, request);
+    }
+
+    header.checksum = rpcFrameChecksum(header, frame.data() + headerLength);
+    encodeRpcHeader(header, &frame[0]);
+    return frame;
+}
+
+std::string MsgpackProtocolHandler::encodeResponseBatch(const std::vector<RpcResponse>& responses) {
+    RpcMessageHeader header;
+    header.type = RpcMessageType::BATCH;
+    // 整批沿用第一个响应记录的请求帧格式
+    if (responses.empty()) {
+        fillHeaderFormat(header);
+    } else {
+        fillHeaderFormat(header, responses.front());
+    }
+    header.messageId = static_cast<uint32_t>(responses.size());
+    size_t bodyLength = arraySize(responses.size());
+    for (const RpcResponse& response : responses) {
+        bodyLength += 1 + uintSize(response.getMessageId()) + responseFieldsSize(response);
+    }
+    header.bodyLength = static_cast<uint32_t>(bodyLength);
+
+    char headerBuf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, headerBuf);
+    std::string frame(headerLength + header.bodyLength, '\0');
+    MsgpackWriter writer(&frame[headerLength]);
+    writer.array(responses.size());
+    for (const RpcResponse& response : responses) {
+        writer.array(3);
+        writer.uinteger(response.getMessageId());
+        writeResponseFields(writer, response);
+    }
+
+    header.checksum = rpcFrameChecksum(header, frame.data() + headerLength);
+    encodeRpcHeader(header, &frame[0]);
+    return frame;
+}
+
+std::unique_ptr<RpcRequest> MsgpackProtocolHandler::decodeRequest(const std::string& data) {
+    RpcRequestView view;
+    if (!decodeRequestView(data, view)) {
+        return nullptr;
+    }
+
+    auto request = std::make_unique<RpcRequest>();
+    request->setMessageId(view.messageId);
+    request->setMethodId(view.methodId);
+    request->setMethod(std::string(view.method));
+    request->setParams(std::string(view.params));
+    return request;
+}
+
+bool MsgpackProtocolHandler::decodeRequestView(std::string_view data, RpcRequestView& view) {
+    RpcMessageHeader header;
+    const char* body = parseBody(data, RpcMessageType::REQUEST, header);
+    if (!body) {
+        return false;
+    }
+
+    MsgpackReader reader(body, header.bodyLength);
+    RpcRequestView fields;
+    bool isPair = reader.array() == 2;
+    readRequestFields(reader, fields);
+    if (!isPair || !reader.ok() || !reader.atEnd()) {
+        return false;
+    }
+
+    view = fields;
+    view.messageId = header.messageId;
+    return true;
+}
+
+std::unique_ptr<RpcResponse> MsgpackProtocolHandler::decodeResponse(const std::string& data) {
+    RpcMessageHeader header;
+    const char* body = parseBody(data, RpcMessageType::RESPONSE, header);
+    if (!body) {
+        return nullptr;
+    }
+
+    MsgpackReader reader(body, header.bodyLength);
+    auto response = std::make_unique<RpcResponse>();
+    response->setMessageId(header.messageId);
+    bool isPair = reader.array() == 2;
+    readResponseFields(reader, *response);
+    if (!isPair || !reader.ok() || !reader.atEnd()) {
+        return nullptr;
+    }
+    return response;
+}
+
+bool MsgpackProtocolHandler::decodeRequestBatch(std::string_view data, std::vector<RpcRequestView>& views,
+                                                std::vector<std::unique_ptr<RpcRequest>>& owned) {
+    RpcMessageHeader header;
+    const char* body = parseBody(data, RpcMessageType::BATCH, header);
+    if (!body) {
+        return false;
+    }
+
+    // 元素个数来自对端，每个元素至少4字节，按消息体长度限制预留的大小
+    MsgpackReader reader(body, header.bodyLength);
+    size_t count = reader.array();
+    if (!reader.ok() || count == 0) {
+        return false;
+    }
+    views.clear();
+    views.reserve(std::min<size_t>(count, header.bodyLength / 4));
+    for (size_t i = 0; i < count; ++i) {
+        RpcRequestView view;
+        bool isTriple = reader.array() == 3;
+        view.messageId = static_cast<uint32_t>(reader.integer());
+        readRequestFields(reader, view);
+        if (!isTriple || !reader.ok()) {
+            return false;
+        }
+        views.push_back(view);
+    }
+    return reader.atEnd();
+}
+
+bool MsgpackProtocolHandler::decodeResponseBatch(std::string_view data, std::vector<RpcResponse>& responses) {
+    RpcMessageHeader header;
+    const char* body = parseBody(data, RpcMessageType::BATCH, header);
+    if (!body) {
+        return false;
+    }
+
+    MsgpackReader reader(body, header.bodyLength);
+    size_t count = reader.array();
+    if (!reader.ok() || count == 0) {
+        return false;
+    }
+    responses.clear();
+    responses.reserve(std::min<size_t>(count, header.bodyLength / 4));
+    for (size_t i = 0; i < count; ++i) {
+        RpcResponse response;
+        bool isTriple = reader.array() == 3;
+        response.setMessageId(static_cast<uint32_t>(reader.integer()));
+        readResponseFields(reader, response);
+        if (!isTriple || !reader.ok()) {
+            return false;
+        }
+        responses.push_back(std::move(response));
+    }
+    return reader.atEnd();
+}
+
+bool MsgpackProtocolHandler::validateMessage(const std::string& data) {
+    RpcMessageHeader header;
+    int headerLength = decodeRpcHeader(data.data(), data.size(), header);
+    return headerLength > 0 &&
+           data.size() == headerLength + static_cast<size_t>(header.bodyLength) &&
+           header.checksum == rpcFrameChecksum(header, data.data() + headerLength);
+}
+
+uint32_t MsgpackProtocolHandler::calculateChecksum(std::string_view data) {
+    return rpcChecksum(headerVersion_, data.data(), data.size());
+}
+
+const char* MsgpackProtocolHandler::parseBody(std::string_view data, RpcMessageType type,
+                                              RpcMessageHeader& header) {
+    int headerLength = decodeRpcHeader(data.data(), data.size(), header);
+    if (headerLength <= 0 || header.type != type ||
+        data.size() != headerLength + static_cast<size_t>(header.bodyLength)) {
+        return nullptr;
+    }
+    const char* body = data.data() + headerLength;
+    if (header.checksum != rpcFrameChecksum(header, body)) {
+        return nullptr;
+    }
+    return body;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "RpcProtocol.h"
+
+// MessagePack格式的协议处理器，编解码都是自己实现的，不依赖第三方库。
+// 消息体是一个两元素数组：
+//   请求  [method: str, params: bin]
+//         [methodId: uint, params: bin]    客户端拿到rpc.methods的编号表之后
+//   响应  [errorCode: int, result: bin]      errorCode为0
+//         [errorCode: int, message: str]     errorCode非0
+// messageId只放在消息头里。params/result按原始字节透传，不像JSON那样
+// 先解析再重新序列化；编码时直接写进帧缓冲区，解码时直接在帧上读取。
+// 批量消息(BATCH帧)的消息体是一个数组，每个元素在上面的格式前面加上messageId：
+//   请求  [messageId: uint, method: str / methodId: uint, params: bin]
+//   响应  [messageId: uint, errorCode: int, result: bin / message: str]
+class MsgpackProtocolHandler : public RpcProtocolHandler {
+public:
+    MsgpackProtocolHandler() = default;
+    ~MsgpackProtocolHandler() override = default;
+
+    std::string encodeRequest(const RpcRequest& request) override;
+    std::string encodeResponse(const RpcResponse& response) override;
+    std::unique_ptr<RpcRequest> decodeRequest(const std::string& data) override;
+    bool decodeRequestView(std::string_view data, RpcRequestView& view) override;
+    std::unique_ptr<RpcResponse> decodeResponse(const std::string& data) override;
+    bool supportsBatch() const override { return true; }
+    std::string encodeRequestBatch(const std::vector<RpcRequest>& requests) override;
+    std::string encodeResponseBatch(const std::vector<RpcResponse>& responses) override;
+    bool decodeRequestBatch(std::string_view data, std::vector<RpcRequestView>& views,
+                            std::vector<std::unique_ptr<RpcRequest>>& owned) override;
+    bool decodeResponseBatch(std::string_view data, std::vector<RpcResponse>& responses) override;
+    bool validateMessage(const std::string& data) override;
+    uint32_t calculateChecksum(std::string_view data) override;
+
+private:
+    // 校验帧并返回消息体在data中的位置，失败返回nullptr
+    const char* parseBody(std::string_view data, RpcMessageType type, RpcMessageHeader& header);
+};
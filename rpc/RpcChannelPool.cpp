@@ -0,0 +1,216 @@
+#include "RpcChannelPool.h"
+#include <climits>
+#include <future>
+#include "../base/Logging.h"
+
+RpcChannelPool::RpcChannelPool(const std::vector<EventLoop*>& loops, const std::string& serverHost,
+                               int serverPort, int connections, int maxInFlight)
+    : loops_(loops), maxInFlight_(maxInFlight), next_(0), stopped_(false), waitingCount_(0) {
+    if (loops_.empty() || connections <= 0 || maxInFlight_ <= 0) {
+        LOG << "RpcChannelPool needs at least one loop, one connection and a positive window";
+        abort();
+    }
+    for (int i = 0; i < connections; ++i) {
+        auto channel = std::make_unique<PoolChannel>();
+        channel->client = std::make_unique<RpcClient>(loops_[i % loops_.size()], serverHost, serverPort);
+        channels_.push_back(std::move(channel));
+    }
+}
+
+RpcChannelPool::~RpcChannelPool() {
+    // 先断开所有连接，未完成请求的回调会访问channels_，不能等成员析构时再做
+    disconnect();
+}
+
+void RpcChannelPool::setProtocolType(RpcProtocolType type) {
+    for (auto& channel : channels_) {
+        auto handler = RpcProtocolFactory::createHandler(type);
+        if (!handler) {
+            return;
+        }
+        channel->client->setProtocolHandler(std::move(handler));
+    }
+}
+
+bool RpcChannelPool::connect() {
+    stopped_ = false;
+    bool any = false;
+    for (auto& channel : channels_) {
+        if (channel->client->connect()) {
+            any = true;
+        }
+    }
+    return any;
+}
+
+void RpcChannelPool::disconnect() {
+    stopped_ = true;
+    for (auto& channel : channels_) {
+        channel->client->disconnect();
+    }
+    failWaiting();
+}
+
+RpcResponse RpcChannelPool::call(const std::string& method, const std::string& params,
+                                 uint32_t timeout) {
+    // 响应要靠这些loop线程处理，在里面同步等待只会卡死
+    for (EventLoop* loop : loops_) {
+        if (loop->isInLoopThread()) {
+            RpcResponse errorResponse;
+            errorResponse.setError(RpcErrorCode::INTERNAL_ERROR,
+                                   "Synchronous call in one of the pool's loop threads");
+            return errorResponse;
+        }
+    }
+
+    std::promise<RpcResponse> promise;
+    auto future = promise.get_future();
+    asyncCall(method, params, [&promise](const RpcResponse& response) { promise.set_value(response); },
+              timeout);
+    return future.get();
+}
+
+void RpcChannelPool::asyncCall(const std::string& method, const std::string& params,
+                               RpcCallback callback, uint32_t timeout) {
+    WaitingCall call{method, params, std::move(callback), timeout, std::chrono::steady_clock::now()};
+
+    bool usable = false;
+    PoolChannel* channel = acquire(usable);
+    if (channel) {
+        dispatch(channel, std::move(call));
+        return;
+    }
+    if (!usable) {
+        RpcResponse errorResponse;
+        errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "No connection available");
+        if (call.callback) call.callback(errorResponse);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex_);
+        waiting_.push_back(std::move(call));
+        ++waitingCount_;
+    }
+    // 入队之前可能刚好有请求结束，它看到的队列是空的，这里再补一次
+    drainWaiting();
+}
+
+RpcClient::Statistics RpcChannelPool::getStatistics() const {
+    RpcClient::Statistics total;
+    double totalTime = 0.0;
+    for (auto& channel : channels_) {
+        RpcClient::Statistics stats = channel->client->getStatistics();
+        total.totalCalls += stats.totalCalls;
+        total.successCalls += stats.successCalls;
+        total.errorCalls += stats.errorCalls;
+        total.timeoutCalls += stats.timeoutCalls;
+        totalTime += stats.avgResponseTime * stats.totalCalls;
+    }
+    if (total.totalCalls > 0) {
+        total.avgResponseTime = totalTime / total.totalCalls;
+    }
+    return total;
+}
+
+RpcChannelPool::PoolChannel* RpcChannelPool::acquire(bool& usable) {
+    usable = false;
+    if (stopped_) {
+        return nullptr;
+    }
+    size_t count = channels_.size();
+    size_t start = next_.fetch_add(1, std::memory_order_relaxed) % count;
+    for (;;) {
+        PoolChannel* best = nullptr;
+        int bestLoad = INT_MAX;
+        for (size_t i = 0; i < count; ++i) {
+            PoolChannel* channel = channels_[(start + i) % count].get();
+            // 断开的连接顺便重连，正在连接的也算可用，请求会在连上后发出
+            if (channel->client->isDisconnected() && !channel->client->connect()) {
+                continue;
+            }
+            usable = true;
+            int load = channel->inFlight.load(std::memory_order_relaxed);
+            if (load < bestLoad) {
+                best = channel;
+                bestLoad = load;
+            }
+        }
+        if (!best || bestLoad >= maxInFlight_) {
+            return nullptr;
+        }
+        // 被别的线程抢先占了名额就重新挑
+        if (best->inFlight.compare_exchange_weak(bestLoad, bestLoad + 1)) {
+            return best;
+        }
+    }
+}
+
+void RpcChannelPool::release(PoolChannel* channel) {
+    --channel->inFlight;
+    if (waitingCount_ > 0) {
+        drainWaiting();
+    }
+}
+
+void RpcChannelPool::dispatch(PoolChannel* channel, WaitingCall call) {
+    // 排队的时间也算在超时里
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::steady_clock::now() - call.enqueueTime).count();
+    if (waited >= static_cast<int64_t>(call.timeout)) {
+        --channel->inFlight;
+        RpcResponse timeoutResponse;
+        timeoutResponse.setError(RpcErrorCode::TIMEOUT_ERROR, "Request timeout");
+        if (call.callback) call.callback(timeoutResponse);
+        return;
+    }
+
+    RpcCallback callback = std::move(call.callback);
+    channel->client->asyncCall(call.method, call.params,
+                               [this, channel, callback](const RpcResponse& response) {
+                                   // 先归还名额，让排队的调用尽快发出去
+                                   release(channel);
+                                   if (callback) callback(response);
+                               },
+                               static_cast<uint32_t>(call.timeout - waited));
+}
+
+void RpcChannelPool::drainWaiting() {
+    while (waitingCount_ > 0) {
+        bool usable = false;
+        PoolChannel* channel = acquire(usable);
+        if (!channel) {
+            if (!usable) {
+                failWaiting();
+            }
+            return;
+        }
+
+        WaitingCall call;
+        {
+            std::lock_guard<std::mutex> lock(waitingMutex_);
+            if (waiting_.empty()) {
+                --channel->inFlight;
+                return;
+            }
+            call = std::move(waiting_.front());
+            waiting_.pop_front();
+            --waitingCount_;
+        }
+        dispatch(channel, std::move(call));
+    }
+}
+
+void RpcChannelPool::failWaiting() {
+    std::deque<WaitingCall> failed;
+    {
+        std::lock_guard<std::mutex> lock(waitingMutex_);
+        failed.swap(waiting_);
+        waitingCount_ = 0;
+    }
+    for (auto& call : failed) {
+        RpcResponse errorResponse;
+        errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "No connection available");
+        if (call.callback) call.callback(errorResponse);
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../EventLoop.h"
+#include "../base/noncopyable.h"
+#include "RpcClient.h"
+#include "RpcConfig.h"
+
+// 到同一个服务器的一组RpcClient连接，分布在多个EventLoop上。
+// 每次调用挑在途请求最少的连接；每条连接的在途请求数不超过maxInFlight，
+// 所有连接都满了就在池里排队，等有请求结束再发。
+// 各连接的messageId互相独立，响应按连接和messageId对应回请求。
+class RpcChannelPool : noncopyable {
+public:
+    // loops里的EventLoop必须在运行，并且比连接池活得久。
+    // 第i条连接使用loops[i % loops.size()]
+    RpcChannelPool(const std::vector<EventLoop*>& loops, const std::string& serverHost,
+                   int serverPort, int connections, int maxInFlight = 256);
+    ~RpcChannelPool();
+
+    // 所有连接都用type对应的协议处理器，在发起调用之前设置
+    void setProtocolType(RpcProtocolType type);
+
+    // 非阻塞地发起所有连接，至少一条连接可用时返回true
+    bool connect();
+
+    void disconnect();
+
+    // 同步调用，不能在连接池的任何一个loop线程里调用
+    RpcResponse call(const std::string& method, const std::string& params, uint32_t timeout = 5000);
+
+    // 异步调用，callback在连接所属的loop线程里执行；
+    // 连接全都不可用时直接在调用方线程里以NETWORK_ERROR回调
+    void asyncCall(const std::string& method, const std::string& params, RpcCallback callback,
+                   uint32_t timeout = 5000);
+
+    size_t size() const { return channels_.size(); }
+    int maxInFlight() const { return maxInFlight_; }
+
+    // 所有连接的统计信息之和，avgResponseTime按调用次数加权
+    RpcClient::Statistics getStatistics() const;
+
+private:
+    struct PoolChannel {
+        std::unique_ptr<RpcClient> client;
+        std::atomic<int> inFlight;  // 经过连接池发出、还没有回调的请求数
+
+        PoolChannel() : inFlight(0) {}
+    };
+
+    // 所有连接都满时排队的调用
+    struct WaitingCall {
+        std::string method;
+        std::string params;
+        RpcCallback callback;
+        uint32_t timeout;
+        std::chrono::steady_clock::time_point enqueueTime;
+    };
+
+    std::vector<EventLoop*> loops_;
+    std::vector<std::unique_ptr<PoolChannel>> channels_;
+    int maxInFlight_;
+    std::atomic<uint32_t> next_;  // 在途数相同时轮流选，避免总压在第一条上
+    std::atomic<bool> stopped_;   // disconnect之后不再自动重连
+
+    std::mutex waitingMutex_;
+    std::deque<WaitingCall> waiting_;
+    std::atomic<int> waitingCount_;  // waiting_.size()，请求结束时先看它，免得每次都加锁
+
+    // 选一条在途数最少且没满的连接并占用一个名额。
+    // 都满了返回nullptr；全部连接都不可用时usable为false
+    PoolChannel* acquire(bool& usable);
+
+    // 请求结束，归还名额并补发排队的调用
+    void release(PoolChannel* channel);
+
+    // 在已占用名额的连接上发出调用
+    void dispatch(PoolChannel* channel, WaitingCall call);
+
+    // 只要还有空闲名额就把排队的调用发出去
+    void drainWaiting();
+
+    // 排队的调用全部以NETWORK_ERROR结束
+    void failWaiting();
+};
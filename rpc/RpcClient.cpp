@@ -1,214 +1,514 @@
 #include "RpcClient.h"
 #include "JsonProtocolHandler.h"
+#include "RpcCompression.h"
+#include "RpcConfig.h"
 #include "../base/Logging.h"
 #include "../Util.h"
+#include <json/json.h>
 #include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <algorithm>
 #include <chrono>
-#include <thread>
+#include <cstring>
 #include <mutex>
 
+namespace {
+
+// max_pending_requests向上取整到2的幂后的位数。至少留16位给generation，
+// 否则槽复用得快时迟到的响应容易撞上新请求的messageId
+int pendingIndexBits() {
+    int bits = 4;
+    while (bits < 16 && (1 << bits) < RpcConfig::getInstance().getMaxPendingRequests()) {
+        ++bits;
+    }
+    return bits;
+}
+
+}  // namespace
+
 RpcClient::RpcClient(EventLoop* loop, const std::string& serverHost, int serverPort)
     : loop_(loop), serverHost_(serverHost), serverPort_(serverPort), 
-      sockfd_(-1), connected_(false), messageIdGenerator_(1) {
+      sockfd_(-1), loopback_(false), state_(kDisconnected),
+      connectionEpoch_(0), negotiated_(0),
+      pendingRequests_(pendingIndexBits()), timingWheel_(kTimerTickMs, kTimerSlots),
+      timerFd_(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      timerArmed_(false) {
+    
+    const RpcConfig& config = RpcConfig::getInstance();
+    methodIds_ = config.getMethodIds();
+    streamWindow_ = config.getStreamWindow();
+    compression_ = config.getCompression();
+    compressThreshold_ = static_cast<size_t>(std::max(config.getCompressThreshold(), 0));
+    batchMaxRequests_ = config.getBatchMaxRequests() > 0 ? config.getBatchMaxRequests() : 0;
+    batchWindowUs_ = config.getBatchWindowUs();
+    batchTimerFd_ = -1;
+    
+    const std::string kUnixPrefix = "unix:";
+    if (serverHost_.compare(0, kUnixPrefix.size(), kUnixPrefix) == 0) {
+        unixPath_ = serverHost_.substr(kUnixPrefix.size());
+    }
+    useShm_ = !unixPath_.empty() && config.getTransportType() == RpcTransportType::SHM;
+    shmRingSize_ = static_cast<size_t>(std::max(config.getShmRingSize(), 0));
     
     // 设置默认协议处理器
     protocolHandler_ = std::make_unique<JsonProtocolHandler>();
+    
+    if (timerFd_ < 0) {
+        LOG << "RpcClient failed to create timerfd";
+        abort();
+    }
+    timerChannel_ = std::make_shared<Channel>(loop_, timerFd_);
+    timerChannel_->setEvents(EPOLLIN | EPOLLET);
+    timerChannel_->setReadHandler([this]() { handleTimerTick(); });
+    timerChannel_->setConnHandler([this]() {
+        timerChannel_->setEvents(EPOLLIN | EPOLLET);
+        loop_->updatePoller(timerChannel_);
+    });
+    
+    // 只有配置了批量等待窗口才需要第二个timerfd，一次性定时，由第一个进批量的请求启动
+    if (batchMaxRequests_ > 1 && batchWindowUs_ > 0) {
+        batchTimerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (batchTimerFd_ < 0) {
+            LOG << "RpcClient failed to create batch timerfd";
+            abort();
+        }
+        batchTimerChannel_ = std::make_shared<Channel>(loop_, batchTimerFd_);
+        batchTimerChannel_->setEvents(EPOLLIN | EPOLLET);
+        batchTimerChannel_->setReadHandler([this]() { handleBatchTimer(); });
+        batchTimerChannel_->setConnHandler([this]() {
+            batchTimerChannel_->setEvents(EPOLLIN | EPOLLET);
+            loop_->updatePoller(batchTimerChannel_);
+        });
+    }
+    
+    // poller只能在loop_线程里操作
+    loop_->runInLoop([this]() {
+        loop_->addToPoller(timerChannel_);
+        if (batchTimerChannel_) {
+            loop_->addToPoller(batchTimerChannel_);
+        }
+    });
 }
 
 RpcClient::~RpcClient() {
-    disconnect();
+    runInLoopAndWait([this]() {
+        disconnectInLoop();
+        loop_->removeFromPoller(timerChannel_);
+        if (batchTimerChannel_) {
+            loop_->removeFromPoller(batchTimerChannel_);
+        }
+    });
+    close(timerFd_);
+    if (batchTimerFd_ >= 0) {
+        close(batchTimerFd_);
+    }
 }
 
 bool RpcClient::connect() {
-    if (connected_) {
+    // 多个线程可能同时发现连接断开，只让一个去连
+    int expected = kDisconnected;
+    if (!state_.compare_exchange_strong(expected, kConnecting)) {
         return true;
     }
     
-    // 创建socket
-    sockfd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (sockfd_ < 0) {
-        LOG << "Failed to create socket";
-        return false;
+    // 设置服务器地址
+    struct sockaddr_storage serverAddr = {};
+    socklen_t addrLen;
+    if (!unixPath_.empty()) {
+        struct sockaddr_un* addr = reinterpret_cast<struct sockaddr_un*>(&serverAddr);
+        if (unixPath_.size() >= sizeof addr->sun_path) {
+            LOG << "Unix socket path too long: " << unixPath_;
+            state_ = kDisconnected;
+            return false;
+        }
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, unixPath_.c_str(), unixPath_.size() + 1);
+        addrLen = sizeof(struct sockaddr_un);
+    } else {
+        struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(&serverAddr);
+        addr->sin_family = AF_INET;
+        addr->sin_port = htons(serverPort_);
+        if (inet_pton(AF_INET, serverHost_.c_str(), &addr->sin_addr) <= 0) {
+            LOG << "Invalid server address: " << serverHost_;
+            state_ = kDisconnected;
+            return false;
+        }
+        addrLen = sizeof(struct sockaddr_in);
     }
     
-    // 设置服务器地址
-    struct sockaddr_in serverAddr;
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(serverPort_);
-    if (inet_pton(AF_INET, serverHost_.c_str(), &serverAddr.sin_addr) <= 0) {
-        LOG << "Invalid server address: " << serverHost_;
-        close(sockfd_);
-        sockfd_ = -1;
+    // 创建非阻塞socket
+    int fd = socket(serverAddr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        LOG << "Failed to create socket";
+        state_ = kDisconnected;
         return false;
     }
+    if (unixPath_.empty()) {
+        setSocketNodelay(fd);
+    }
     
-    // 连接到服务器
-    if (::connect(sockfd_, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+    // 非阻塞connect一般返回EINPROGRESS(Unix域socket通常直接连上)，连接结果在loop_线程里等EPOLLOUT
+    int ret = ::connect(fd, (struct sockaddr*)&serverAddr, addrLen);
+    if (ret < 0 && errno != EINPROGRESS) {
         LOG << "Failed to connect to server " << serverHost_ << ":" << serverPort_;
-        close(sockfd_);
-        sockfd_ = -1;
+        close(fd);
+        state_ = kDisconnected;
         return false;
     }
     
-    // 设置非阻塞模式
-    setSocketNonBlocking(sockfd_);
+    // 本机连接不会在链路上出错，按配置省掉校验和
+    loopback_ = !unixPath_.empty() ||
+                (ntohl(reinterpret_cast<struct sockaddr_in*>(&serverAddr)->sin_addr.s_addr) >> 24) == 127;
+    protocolHandler_->setSkipChecksum(loopback_ && RpcConfig::getInstance().getSkipChecksumOnLoopback());
+    
+    loop_->runInLoop(std::bind(&RpcClient::connectInLoop, this, fd, ret == 0));
+    return true;
+}
+
+void RpcClient::connectInLoop(int fd, bool connected) {
+    // 排队期间已经被disconnect了
+    if (state_ == kDisconnected) {
+        close(fd);
+        return;
+    }
+    sockfd_ = fd;
+    
+    // 丢弃上一条连接残留的数据
+    decoder_ = RpcFrameDecoder();
+    outBuffer_.clear();
     
     // 创建Channel并设置回调
     channel_ = std::make_shared<Channel>(loop_, sockfd_);
+    channel_->setEvents(connected ? (EPOLLIN | EPOLLET) : (EPOLLIN | EPOLLOUT | EPOLLET));
     channel_->setReadHandler([this]() { handleRead(); });
+    channel_->setWriteHandler([this]() { handleWrite(); });
     channel_->setConnHandler([this]() { handleConnection(); });
     channel_->setErrorHandler([this]() { handleError(); });
-    
-    // 添加到事件循环
     loop_->addToPoller(channel_);
     
-    connected_ = true;
+    if (connected) {
+        onConnected();
+        flushOutput();
+    }
+}
+
+void RpcClient::onConnected() {
+    // 握手必须是socket上的第一批数据，所以在发出任何请求之前做
+    if (useShm_) {
+        shm_ = RpcShmTransport::create(shmRingSize_);
+        if (!shm_) {
+            LOG << "Failed to create shared memory ring, staying on the unix socket";
+        } else if (!shm_->sendHello(sockfd_)) {
+            LOG << "Failed to send shared memory hello to " << unixPath_;
+            shm_.reset();
+            handleError();
+            return;
+        } else {
+            shmChannel_ = std::make_shared<Channel>(loop_, shm_->wakeFd());
+            shmChannel_->setEvents(EPOLLIN | EPOLLET);
+            shmChannel_->setReadHandler([this]() { handleShmWakeup(); });
+            shmChannel_->setConnHandler([this]() {
+                if (shmChannel_) {
+                    shmChannel_->setEvents(EPOLLIN | EPOLLET);
+                    loop_->updatePoller(shmChannel_);
+                }
+            });
+            loop_->addToPoller(shmChannel_);
+        }
+    }
+    state_ = kConnected;
     LOG << "Connected to RPC server " << serverHost_ << ":" << serverPort_;
-    
-    return true;
+    if (methodIds_) {
+        fetchMethodTable();
+    }
+    if (compression_ != RpcCompression::NONE) {
+        negotiateCompression();
+    }
+}
+
+void RpcClient::fetchMethodTable() {
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        epoch = connectionEpoch_;
+    }
+    asyncCall(kRpcMethodTableMethod, "{}", [this, epoch](const RpcResponse& response) {
+        if (!response.isSuccess()) {
+            LOG << "Server has no method table, calling methods by name: " << response.getErrorMessage();
+            return;
+        }
+        Json::Value root;
+        Json::Reader reader;
+        if (!reader.parse(response.getResult(), root) || !root.isObject()) {
+            LOG << "Invalid method table from server";
+            return;
+        }
+        auto table = std::make_shared<MethodTable>();
+        table->epoch = epoch;
+        for (const std::string& name : root.getMemberNames()) {
+            const Json::Value& id = root[name];
+            if (id.isUInt() && id.asUInt() != 0) {
+                table->ids[name] = id.asUInt();
+            }
+        }
+        // 和disconnectInLoop在同一把锁下核对epoch，断线之后不会再装上旧连接的表
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (epoch == connectionEpoch_) {
+            std::atomic_store(&methodTable_, std::shared_ptr<const MethodTable>(std::move(table)));
+        }
+    });
+}
+
+void RpcClient::negotiateCompression() {
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        epoch = connectionEpoch_;
+    }
+    std::string params = std::string("[\"") + rpcCompressionName(compression_) + "\"]";
+    asyncCall(kRpcCompressionMethod, params, [this, epoch](const RpcResponse& response) {
+        if (!response.isSuccess()) {
+            LOG << "Server does not support compression: " << response.getErrorMessage();
+            return;
+        }
+        Json::Value root;
+        Json::Reader reader;
+        RpcCompression codec;
+        if (!reader.parse(response.getResult(), root) || !root.isString() ||
+            !parseRpcCompression(root.asString(), codec) || !rpcCompressionSupported(codec)) {
+            LOG << "Invalid compression from server: " << response.getResult();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (epoch == connectionEpoch_) {
+            negotiated_.store((epoch << 8) | static_cast<uint8_t>(codec), std::memory_order_release);
+        }
+    });
+}
+
+bool RpcClient::compressFrame(std::string& frame, uint64_t& epoch) const {
+    uint64_t negotiated = negotiated_.load(std::memory_order_acquire);
+    auto codec = static_cast<RpcCompression>(negotiated & 0xff);
+    epoch = negotiated >> 8;
+    return compressRpcFrame(frame, codec, compressThreshold_);
 }
 
 void RpcClient::disconnect() {
-    if (!connected_) {
+    runInLoopAndWait([this]() { disconnectInLoop(); });
+}
+
+void RpcClient::disconnectInLoop() {
+    if (state_ == kDisconnected && !channel_) {
         return;
     }
-    
-    connected_ = false;
+    state_ = kDisconnected;
     
     if (channel_) {
         loop_->removeFromPoller(channel_);
         channel_.reset();
     }
+    if (shmChannel_) {
+        loop_->removeFromPoller(shmChannel_);
+        shmChannel_.reset();
+    }
+    shm_.reset();
     
     if (sockfd_ >= 0) {
         close(sockfd_);
         sockfd_ = -1;
     }
     
-    // 清理待处理的请求
-    std::lock_guard<std::mutex> lock(pendingMutex_);
-    for (auto& pair : pendingRequests_) {
+    outBuffer_.clear();
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        pendingOutput_.clear();
+        pendingTimers_.clear();
+        pendingBatch_.clear();
+        ++connectionEpoch_;
+        std::atomic_store(&methodTable_, std::shared_ptr<const MethodTable>());
+        negotiated_.store(0, std::memory_order_release);
+    }
+    
+    // 清理待处理的请求。state_已经是kDisconnected，之后登记的请求会在startRequest里自己失败
+    std::vector<RpcPendingRequest*> pending;
+    pendingRequests_.takeAll(pending);
+    for (RpcPendingRequest* request : pending) {
+        timingWheel_.cancel(request);
+    }
+    armTimer(false);
+    for (RpcPendingRequest* request : pending) {
         RpcResponse errorResponse;
+        errorResponse.setMessageId(request->messageId);
         errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Connection closed");
-        
-        if (pair.second->isAsync && pair.second->callback) {
-            pair.second->callback(errorResponse);
-        } else {
-            pair.second->promise.set_value(errorResponse);
-        }
+        completeRequest(request, errorResponse);
     }
-    pendingRequests_.clear();
     
     LOG << "Disconnected from RPC server";
 }
 
+void RpcClient::runInLoopAndWait(std::function<void()> func) {
+    if (loop_->isInLoopThread()) {
+        func();
+        return;
+    }
+    std::promise<void> done;
+    loop_->queueInLoop([&func, &done]() {
+        func();
+        done.set_value();
+    });
+    done.get_future().wait();
+}
+
 RpcResponse RpcClient::call(const std::string& method, const std::string& params, uint32_t timeout) {
-    if (!connected_ && !connect()) {
+    // 响应和超时都要靠loop_线程处理，在loop_线程里同步等待只会卡死
+    if (loop_->isInLoopThread()) {
         RpcResponse errorResponse;
-        errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Not connected to server");
+        errorResponse.setError(RpcErrorCode::INTERNAL_ERROR, "Synchronous call in the client's loop thread");
         return errorResponse;
     }
     
-    RpcRequest request(method, params);
-    request.setMessageId(generateMessageId());
-    request.setTimeout(timeout);
-    
-    auto startTime = std::chrono::steady_clock::now();
-    
-    // 创建待处理请求
-    auto pendingRequest = std::make_unique<PendingRequest>();
-    pendingRequest->startTime = startTime;
-    pendingRequest->timeout = timeout;
-    pendingRequest->isAsync = false;
-    
-    auto future = pendingRequest->promise.get_future();
-    
-    {
-        std::lock_guard<std::mutex> lock(pendingMutex_);
-        pendingRequests_[request.getMessageId()] = std::move(pendingRequest);
-    }
-    
-    // 发送请求
-    if (!sendRequest(request)) {
-        std::lock_guard<std::mutex> lock(pendingMutex_);
-        pendingRequests_.erase(request.getMessageId());
-        
+    if (isDisconnected() && !connect()) {
         RpcResponse errorResponse;
-        errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Failed to send request");
+        errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Not connected to server");
         return errorResponse;
     }
     
-    // 等待响应
-    auto status = future.wait_for(std::chrono::milliseconds(timeout));
-    if (status == std::future_status::timeout) {
-        std::lock_guard<std::mutex> lock(pendingMutex_);
-        pendingRequests_.erase(request.getMessageId());
-        
-        RpcResponse timeoutResponse;
-        timeoutResponse.setError(RpcErrorCode::TIMEOUT_ERROR, "Request timeout");
-        updateStatistics(false, timeout);
-        return timeoutResponse;
+    RpcPendingRequest* pending = pendingRequests_.claim();
+    if (!pending) {
+        RpcResponse errorResponse;
+        errorResponse.setError(RpcErrorCode::INTERNAL_ERROR, "Too many pending requests");
+        return errorResponse;
     }
     
-    RpcResponse response = future.get();
-    
-    // 更新统计信息
-    auto endTime = std::chrono::steady_clock::now();
-    double responseTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
-    updateStatistics(response.isSuccess(), responseTime);
+    // 结果由完成方直接写进response，不需要promise
+    RpcResponse response;
+    pending->startTime = std::chrono::steady_clock::now();
+    pending->timeout = timeout;
+    pending->result = &response;
+    startRequest(pending, RpcRequest(method, params));
     
+    // 等待响应；超时由时间轮在loop线程里设置，统计信息也在那边更新
+    pending->waitReady();
+    pendingRequests_.release(pending);
     return response;
 }
 
 void RpcClient::asyncCall(const std::string& method, const std::string& params, 
                          RpcCallback callback, uint32_t timeout) {
-    if (!connected_ && !connect()) {
+    if (isDisconnected() && !connect()) {
         RpcResponse errorResponse;
         errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Not connected to server");
         if (callback) callback(errorResponse);
         return;
     }
     
-    RpcRequest request(method, params);
-    request.setMessageId(generateMessageId());
-    request.setTimeout(timeout);
-    
-    auto startTime = std::chrono::steady_clock::now();
+    RpcPendingRequest* pending = pendingRequests_.claim();
+    if (!pending) {
+        RpcResponse errorResponse;
+        errorResponse.setError(RpcErrorCode::INTERNAL_ERROR, "Too many pending requests");
+        if (callback) callback(errorResponse);
+        return;
+    }
     
-    // 创建待处理请求
-    auto pendingRequest = std::make_unique<PendingRequest>();
-    pendingRequest->startTime = startTime;
-    pendingRequest->timeout = timeout;
-    pendingRequest->isAsync = true;
-    pendingRequest->callback = callback;
+    pending->startTime = std::chrono::steady_clock::now();
+    pending->timeout = timeout;
+    pending->callback = std::move(callback);
+    startRequest(pending, RpcRequest(method, params));
+}
+
+RpcStreamPtr RpcClient::openStream(const std::string& method, const std::string& params) {
+    // 打不开时也返回一个流，已经带着错误结束了
+    auto failed = [](RpcErrorCode code, const std::string& message) {
+        auto stream = std::make_shared<RpcStream>(0, RpcMessageHeader(), 0, [](std::string) {});
+        RpcResponse errorResponse;
+        errorResponse.setError(code, message);
+        stream->onFinish(errorResponse);
+        return stream;
+    };
+    if (isDisconnected() && !connect()) {
+        return failed(RpcErrorCode::NETWORK_ERROR, "Not connected to server");
+    }
+    RpcPendingRequest* pending = pendingRequests_.claim();
+    if (!pending) {
+        return failed(RpcErrorCode::INTERNAL_ERROR, "Too many pending requests");
+    }
     
+    // 流的数据帧只能发给打开它的那条连接
+    uint64_t epoch;
     {
-        std::lock_guard<std::mutex> lock(pendingMutex_);
-        pendingRequests_[request.getMessageId()] = std::move(pendingRequest);
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        epoch = connectionEpoch_;
+    }
+    uint32_t streamId = pending->messageId;
+    auto stream = std::make_shared<RpcStream>(
+        streamId, protocolHandler_->headerFormat(), static_cast<uint32_t>(streamWindow_),
+        [this, epoch](std::string frame) { sendFrame(std::move(frame), epoch); });
+    
+    // 本端取消时服务端不再回复，直接结束等待中的请求；迟到的响应因为generation对不上会被丢掉
+    stream->setCancelCallback([this, streamId]() {
+        RpcPendingRequest* request = pendingRequests_.take(streamId);
+        if (request) {
+            RpcResponse errorResponse;
+            errorResponse.setMessageId(streamId);
+            errorResponse.setError(RpcErrorCode::CANCELLED, "Stream cancelled");
+            completeRequest(request, errorResponse);
+        }
+    });
+    
+    // 流没有超时，不挂时间轮。最终响应(或者断线)时从streams_里删掉
+    pending->startTime = std::chrono::steady_clock::now();
+    pending->timeout = 0;
+    pending->callback = [this, stream](const RpcResponse& response) {
+        {
+            std::lock_guard<std::mutex> lock(streamsMutex_);
+            streams_.erase(stream->id());
+        }
+        stream->onFinish(response);
+    };
+    {
+        std::lock_guard<std::mutex> lock(streamsMutex_);
+        streams_[streamId] = stream;
     }
     
-    // 发送请求
-    if (!sendRequest(request)) {
-        std::lock_guard<std::mutex> lock(pendingMutex_);
-        pendingRequests_.erase(request.getMessageId());
-        
+    RpcRequest request(method, params);
+    request.setStream(true);
+    if (startRequest(pending, std::move(request), false, static_cast<int64_t>(epoch))) {
+        // 打开流的请求已经排进输出，窗口更新跟在它后面
+        stream->announceWindow();
+    }
+    return stream;
+}
+
+bool RpcClient::startRequest(RpcPendingRequest* pending, RpcRequest request, bool timed,
+                             int64_t pinnedEpoch) {
+    request.setMessageId(pending->messageId);
+    request.setTimeout(pending->timeout);
+    
+    // 先登记再检查连接状态，和disconnectInLoop先改状态再takeAll正好相反：
+    // 两边都是顺序一致的原子操作，要么这里看到已断开，要么disconnectInLoop取走这个请求。
+    // 登记之后请求随时可能被结束并归还，不能再碰pending
+    uint32_t messageId = pending->messageId;
+    pendingRequests_.publish(pending);
+    if (sendRequest(std::move(request), timed, pinnedEpoch)) {
+        return true;
+    }
+    
+    // 发送失败时请求可能已经被disconnectInLoop取走并结束了
+    RpcPendingRequest* failed = pendingRequests_.take(messageId);
+    if (failed) {
         RpcResponse errorResponse;
+        errorResponse.setMessageId(messageId);
         errorResponse.setError(RpcErrorCode::NETWORK_ERROR, "Failed to send request");
-        if (callback) callback(errorResponse);
-        return;
+        completeRequest(failed, errorResponse);
     }
-    
-    // 启动超时检查
-    std::thread([this, messageId = request.getMessageId(), timeout]() {
-        std::this_thread::sleep_for(std::chrono::milliseconds(timeout));
-        handleTimeout();
-    }).detach();
+    return false;
 }
 
 void RpcClient::notify(const std::string& method, const std::string& params) {
-    if (!connected_ && !connect()) {
+    if (isDisconnected() && !connect()) {
         LOG << "Failed to send notification: not connected";
         return;
     }
@@ -216,73 +516,434 @@ void RpcClient::notify(const std::string& method, const std::string& params) {
     RpcRequest request(method, params);
     request.setMessageId(0);  // 通知消息ID为0
     
-    sendRequest(request);
+    sendRequest(std::move(request));
 }
 
-uint32_t RpcClient::generateMessageId() {
-    return messageIdGenerator_.fetch_add(1);
+bool RpcClient::applyMethodId(RpcRequest& request, uint64_t& epoch) const {
+    if (!methodIds_) {
+        return false;
+    }
+    std::shared_ptr<const MethodTable> table = std::atomic_load(&methodTable_);
+    if (!table) {
+        return false;
+    }
+    auto it = table->ids.find(request.getMethod());
+    if (it == table->ids.end()) {
+        return false;
+    }
+    request.setMethodId(it->second);
+    epoch = table->epoch;
+    return true;
 }
 
-bool RpcClient::sendRequest(const RpcRequest& request) {
+bool RpcClient::sendRequest(RpcRequest request, bool timed, int64_t pinnedEpoch) {
+    if (isDisconnected()) {
+        return false;
+    }
+    // 用了编号表的请求只能发给取表的那条连接
+    uint64_t epoch = 0;
+    bool pinned = applyMethodId(request, epoch);
+    if (pinnedEpoch >= 0) {
+        if (pinned && epoch != static_cast<uint64_t>(pinnedEpoch)) {
+            return false;
+        }
+        pinned = true;
+        epoch = static_cast<uint64_t>(pinnedEpoch);
+    }
+    // 打开流的请求要带kRpcFlagStream，不能放进批量
+    if (batching() && !request.isStream()) {
+        return queueBatched(std::move(request), timed, pinned, epoch);
+    }
+    
+    // 编码在调用方线程里做，loop_线程只负责搬运和write
     std::string encodedRequest = protocolHandler_->encodeRequest(request);
+    uint64_t codecEpoch;
+    if (compressFrame(encodedRequest, codecEpoch)) {
+        if (pinned && epoch != codecEpoch) {
+            return false;
+        }
+        pinned = true;
+        epoch = codecEpoch;
+    }
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        // 编号表(或者流、压缩算法)所属的连接已经断了，不能发给重连后的服务端
+        if (pinned && epoch != connectionEpoch_) {
+            return false;
+        }
+        wakeup = pendingOutput_.empty();
+        pendingOutput_ += encodedRequest;
+        if (timed) {
+            pendingTimers_.push_back(request.getMessageId());
+        }
+    }
+    if (wakeup) {
+        loop_->queueInLoop([this]() { flushOutput(); });
+    }
+    return true;
+}
+
+bool RpcClient::queueBatched(RpcRequest request, bool timed, bool pinned, uint64_t epoch) {
+    std::vector<RpcRequest> full;
+    bool first;
+    uint64_t batchEpoch;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (pinned && epoch != connectionEpoch_) {
+            return false;
+        }
+        batchEpoch = connectionEpoch_;
+        first = pendingBatch_.empty();
+        if (timed) {
+            pendingTimers_.push_back(request.getMessageId());
+        }
+        pendingBatch_.push_back(std::move(request));
+        if (pendingBatch_.size() >= batchMaxRequests_) {
+            full.swap(pendingBatch_);
+        }
+    }
+    
+    // 攒满了就在调用方线程里编码，和不批量时一样排进pendingOutput_。
+    // 编码期间断线的话这批请求已经被disconnectInLoop结束了，直接丢掉
+    if (!full.empty()) {
+        std::string encodedBatch = protocolHandler_->encodeRequestBatch(full);
+        uint64_t codecEpoch;
+        bool compressed = compressFrame(encodedBatch, codecEpoch);
+        bool wakeup;
+        {
+            std::lock_guard<std::mutex> lock(outputMutex_);
+            if (batchEpoch != connectionEpoch_ || (compressed && codecEpoch != batchEpoch)) {
+                return true;
+            }
+            wakeup = pendingOutput_.empty();
+            pendingOutput_ += encodedBatch;
+        }
+        if (wakeup) {
+            loop_->queueInLoop([this]() { flushOutput(); });
+        }
+        return true;
+    }
+    
+    // 批量里的第一个请求负责安排发送：没有窗口就让loop_线程尽快flush，
+    // 其间到达的请求一起带走；有窗口就启动一次性的timerfd，timerfd_settime可以在任意线程调用
+    if (!first) {
+        return true;
+    }
+    if (batchTimerFd_ < 0) {
+        loop_->queueInLoop([this]() { flushOutput(); });
+    } else {
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = batchWindowUs_ / 1000000;
+        spec.it_value.tv_nsec = (batchWindowUs_ % 1000000) * 1000;
+        timerfd_settime(batchTimerFd_, 0, &spec, nullptr);
+    }
+    return true;
+}
+
+void RpcClient::sendFrame(std::string frame, uint64_t epoch) {
+    uint64_t codecEpoch;
+    bool compressed = compressFrame(frame, codecEpoch);
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (epoch != connectionEpoch_ || (compressed && codecEpoch != epoch)) {
+            return;
+        }
+        wakeup = pendingOutput_.empty();
+        pendingOutput_ += frame;
+    }
+    if (wakeup) {
+        loop_->queueInLoop([this]() { flushOutput(); });
+    }
+}
+
+void RpcClient::handleBatchTimer() {
+    uint64_t expirations = 0;
+    if (read(batchTimerFd_, &expirations, sizeof expirations) == sizeof expirations) {
+        flushOutput();
+    }
+}
+
+void RpcClient::flushOutput() {
+    {
+        std::lock_guard<std::mutex> lock(outputMutex_);
+        if (outBuffer_.empty()) {
+            outBuffer_.swap(pendingOutput_);
+        } else {
+            outBuffer_ += pendingOutput_;
+            pendingOutput_.clear();
+        }
+        timerBatch_.swap(pendingTimers_);
+        batchOut_.swap(pendingBatch_);
+    }
+    
+    // 没攒满的批量在这里编码，只有一个请求时按普通帧发送。
+    // 协商结果只在loop_线程里更新，这里读到的一定属于当前连接
+    if (!batchOut_.empty()) {
+        std::string encoded = batchOut_.size() == 1 ? protocolHandler_->encodeRequest(batchOut_.front())
+                                                    : protocolHandler_->encodeRequestBatch(batchOut_);
+        batchOut_.clear();
+        uint64_t codecEpoch;
+        compressFrame(encoded, codecEpoch);
+        outBuffer_ += encoded;
+    }
+    
+    // 先挂时间轮再写，保证响应到达时请求已经在轮上。排队等loop的时间也算在超时里
+    if (!timerBatch_.empty()) {
+        auto now = std::chrono::steady_clock::now();
+        for (uint32_t messageId : timerBatch_) {
+            RpcPendingRequest* request = pendingRequests_.peek(messageId);
+            if (!request) {
+                continue;  // 已经因为断线结束了
+            }
+            auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              now - request->startTime).count();
+            timingWheel_.add(request, waited < request->timeout ? request->timeout - waited : 0);
+        }
+        timerBatch_.clear();
+        armTimer(!timingWheel_.empty());
+    }
     
-    ssize_t sent = writen(sockfd_, encodedRequest.c_str(), encodedRequest.length());
-    return sent == static_cast<ssize_t>(encodedRequest.length());
+    // 还在连接中就等handleWrite；已经断开的话请求由disconnectInLoop或超时结束
+    if (state_ != kConnected) {
+        if (state_ == kDisconnected) {
+            outBuffer_.clear();
+        }
+        return;
+    }
+    if (!writeOutput()) {
+        handleError();
+        return;
+    }
+    // 没写完就关注EPOLLOUT(共享内存环写满时等服务端唤醒)
+    if (!outBuffer_.empty()) {
+        handleConnection();
+    }
 }
 
 void RpcClient::handleRead() {
-    char buffer[8192];
-    ssize_t n = readn(sockfd_, buffer, sizeof(buffer));
+    // 边缘触发，一直读到EAGAIN
+    bool zero = false;
+    ssize_t n = readn(sockfd_, decoder_.buffer(), zero);
+    
+    // 先把已经完整到达的响应全部分发，再处理读错误或对端关闭
+    std::string frame;
+    RpcFrameDecoder::Status status;
+    while ((status = decoder_.nextFrame(frame)) == RpcFrameDecoder::kFrame) {
+        handleResponseFrame(frame);
+    }
     
-    if (n <= 0) {
+    if (n < 0 || zero || status == RpcFrameDecoder::kError) {
         handleError();
+    }
+}
+
+void RpcClient::handleShmWakeup() {
+    if (!shm_) {
         return;
     }
+    shm_->clearWakeup();
+    ssize_t n = shm_->read(decoder_.buffer());
     
-    std::string data(buffer, n);
-    auto response = protocolHandler_->decodeResponse(data);
+    std::string frame;
+    RpcFrameDecoder::Status status;
+    while ((status = decoder_.nextFrame(frame)) == RpcFrameDecoder::kFrame) {
+        handleResponseFrame(frame);
+    }
+    if (n < 0 || status == RpcFrameDecoder::kError) {
+        handleError();
+        return;
+    }
+    // 可能是服务端读走了请求，接着写排队的部分
+    if (shm_ && !outBuffer_.empty() && !writeOutput()) {
+        handleError();
+    }
+}
+
+bool RpcClient::writeOutput() {
+    if (!shm_) {
+        return writen(sockfd_, outBuffer_) >= 0;
+    }
+    ssize_t n = shm_->write(outBuffer_.data(), outBuffer_.size());
+    if (n < 0) {
+        return false;
+    }
+    outBuffer_.erase(0, n);
+    return true;
+}
+
+void RpcClient::handleResponseFrame(const std::string& frame) {
+    RpcMessageHeader header;
+    bool hasHeader = decodeRpcHeader(frame.data(), frame.size(), header) > 0;
+    if (hasHeader && (header.flags & kRpcFlagCompressed)) {
+        std::string inflated;
+        if (!decompressRpcFrame(frame, inflated)) {
+            LOG << "Failed to decompress RPC frame";
+            return;
+        }
+        handleResponseFrame(inflated);
+        return;
+    }
+    if (hasHeader && header.type == RpcMessageType::STREAM) {
+        handleStreamFrame(frame);
+        return;
+    }
+    if (hasHeader && header.type == RpcMessageType::BATCH) {
+        std::vector<RpcResponse> responses;
+        if (!protocolHandler_->decodeResponseBatch(frame, responses)) {
+            LOG << "Failed to decode RPC batch response";
+            return;
+        }
+        for (const RpcResponse& response : responses) {
+            handleResponse(response);
+        }
+        return;
+    }
     
+    auto response = protocolHandler_->decodeResponse(frame);
     if (response) {
         handleResponse(*response);
+    } else {
+        LOG << "Failed to decode RPC response";
+    }
+}
+
+void RpcClient::handleStreamFrame(const std::string& frame) {
+    RpcMessageHeader header;
+    RpcStreamFrame kind;
+    std::string_view payload;
+    if (!decodeRpcStreamFrame(frame, header, kind, payload)) {
+        LOG << "Failed to decode RPC stream frame";
+        return;
+    }
+    RpcStreamPtr stream;
+    {
+        std::lock_guard<std::mutex> lock(streamsMutex_);
+        auto it = streams_.find(header.messageId);
+        if (it == streams_.end()) {
+            return;  // 流已经结束
+        }
+        stream = it->second;
+    }
+    if (!stream->onFrame(kind, payload)) {
+        LOG << "Cancelling stream " << header.messageId << " after a bad frame";
+        stream->cancel();
     }
 }
 
 void RpcClient::handleResponse(const RpcResponse& response) {
-    std::lock_guard<std::mutex> lock(pendingMutex_);
-    
-    auto it = pendingRequests_.find(response.getMessageId());
-    if (it == pendingRequests_.end()) {
-        return;  // 未找到对应的请求
+    RpcPendingRequest* pendingRequest = pendingRequests_.take(response.getMessageId());
+    if (!pendingRequest) {
+        return;  // 未找到对应的请求，可能已经超时；generation不对的迟到响应也在这里丢掉
     }
+    timingWheel_.cancel(pendingRequest);
     
-    auto& pendingRequest = it->second;
-    
-    // 计算响应时间
+    // 计算响应时间，completeRequest之后槽可能已经被复用
     auto endTime = std::chrono::steady_clock::now();
     double responseTime = std::chrono::duration<double, std::milli>(
         endTime - pendingRequest->startTime).count();
     
-    if (pendingRequest->isAsync && pendingRequest->callback) {
-        pendingRequest->callback(response);
-    } else {
-        pendingRequest->promise.set_value(response);
-    }
-    
-    pendingRequests_.erase(it);
+    completeRequest(pendingRequest, response);
     updateStatistics(response.isSuccess(), responseTime);
 }
 
+void RpcClient::handleWrite() {
+    if (state_ == kConnecting) {
+        int err = 0;
+        socklen_t len = sizeof err;
+        if (getsockopt(sockfd_, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0) {
+            LOG << "Failed to connect to server " << serverHost_ << ":" << serverPort_;
+            handleError();
+            return;
+        }
+        onConnected();
+    }
+    if (state_ == kConnected && !outBuffer_.empty() && !writeOutput()) {
+        handleError();
+    }
+}
+
 void RpcClient::handleConnection() {
-    // 连接状态处理
+    // Channel::handleEvents每次都会清空events，这里重新设置：
+    // 一直关注可读，连接中或者有没写完的数据时再关注可写
+    if (state_ == kDisconnected || !channel_) {
+        return;
+    }
+    __uint32_t events = EPOLLIN | EPOLLET;
+    if (state_ == kConnecting || (!outBuffer_.empty() && !shm_)) {
+        events |= EPOLLOUT;
+    }
+    channel_->setEvents(events);
+    loop_->updatePoller(channel_);
 }
 
 void RpcClient::handleError() {
     LOG << "RPC client connection error";
-    disconnect();
+    disconnectInLoop();
 }
 
-void RpcClient::handleTimeout() {
-    cleanupTimeoutRequests();
+void RpcClient::completeRequest(RpcPendingRequest* request, const RpcResponse& response) {
+    if (request->result) {
+        *request->result = response;
+        request->setReady();
+        return;
+    }
+    // 先归还槽再回调，回调里发起的新调用可以马上用上它
+    RpcCallback callback = std::move(request->callback);
+    pendingRequests_.release(request);
+    if (callback) callback(response);
+}
+
+void RpcClient::handleTimerTick() {
+    uint64_t expirations = 0;
+    ssize_t n = read(timerFd_, &expirations, sizeof expirations);
+    if (n != sizeof expirations) {
+        return;  // 已经被armTimer(false)停掉了
+    }
+    
+    // loop卡顿时一次会读到多次到期，时间轮按次数补走
+    std::vector<RpcTimerNode*> expired;
+    for (uint64_t i = 0; i < expirations && !timingWheel_.empty(); ++i) {
+        timingWheel_.tick(expired);
+    }
+    if (timingWheel_.empty()) {
+        armTimer(false);
+    }
+    
+    // 回调里可能disconnect，槽被归还后又分给新请求，所以先把messageId都记下来
+    std::vector<uint32_t> expiredIds;
+    expiredIds.reserve(expired.size());
+    for (RpcTimerNode* node : expired) {
+        expiredIds.push_back(static_cast<RpcPendingRequest*>(node)->messageId);
+    }
+    for (uint32_t messageId : expiredIds) {
+        // take失败说明前面的回调里disconnect过，请求已经以NETWORK_ERROR结束了
+        RpcPendingRequest* request = pendingRequests_.take(messageId);
+        if (!request) {
+            continue;
+        }
+        uint32_t timeout = request->timeout;
+        RpcResponse timeoutResponse;
+        timeoutResponse.setMessageId(request->messageId);
+        timeoutResponse.setError(RpcErrorCode::TIMEOUT_ERROR, "Request timeout");
+        completeRequest(request, timeoutResponse);
+        statistics_.timeoutCalls++;
+        updateStatistics(false, timeout);
+    }
+}
+
+void RpcClient::armTimer(bool on) {
+    if (on == timerArmed_) {
+        return;
+    }
+    struct itimerspec spec = {};
+    if (on) {
+        spec.it_interval.tv_nsec = kTimerTickMs * 1000 * 1000;
+        spec.it_value = spec.it_interval;
+    }
+    timerfd_settime(timerFd_, 0, &spec, nullptr);
+    timerArmed_ = on;
 }
 
 void RpcClient::updateStatistics(bool success, double responseTime) {
@@ -298,33 +959,8 @@ void RpcClient::updateStatistics(bool success, double responseTime) {
     statistics_.avgResponseTime = totalTime / statistics_.totalCalls;
 }
 
-void RpcClient::cleanupTimeoutRequests() {
-    std::lock_guard<std::mutex> lock(pendingMutex_);
-    auto now = std::chrono::steady_clock::now();
-    
-    for (auto it = pendingRequests_.begin(); it != pendingRequests_.end();) {
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now - it->second->startTime).count();
-        
-        if (elapsed > it->second->timeout) {
-            RpcResponse timeoutResponse;
-            timeoutResponse.setMessageId(it->first);
-            timeoutResponse.setError(RpcErrorCode::TIMEOUT_ERROR, "Request timeout");
-            
-            if (it->second->isAsync && it->second->callback) {
-                it->second->callback(timeoutResponse);
-            } else {
-                it->second->promise.set_value(timeoutResponse);
-            }
-            
-            it = pendingRequests_.erase(it);
-            statistics_.timeoutCalls++;
-        } else {
-            ++it;
-        }
-    }
-}
 
 void RpcClient::setProtocolHandler(std::unique_ptr<RpcProtocolHandler> handler) {
     protocolHandler_ = std::move(handler);
+    protocolHandler_->setSkipChecksum(loopback_ && RpcConfig::getInstance().getSkipChecksumOnLoopback());
 }
\ No newline at end of file
@@ -2,43 +2,66 @@
 #include <memory>
 #include <functional>
 #include <future>
-#include <unordered_map>
 #include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "../EventLoop.h"
 #include "../Channel.h"
+#include "RpcCompression.h"
+#include "RpcFrameDecoder.h"
 #include "RpcProtocol.h"
+#include "RpcPendingTable.h"
+#include "RpcShmTransport.h"
+#include "RpcStream.h"
+#include "RpcTimingWheel.h"
 
-// RPC调用回调函数类型
-using RpcCallback = std::function<void(const RpcResponse&)>;
-
-// RPC客户端类
+// RPC客户端类，一个对象对应一条连接。
+// 调用可以来自任意线程：请求在调用方线程里编码，然后交给loop_线程发送；
+// 连接、收发、超时都在loop_线程里处理。
 class RpcClient {
 public:
+    // serverHost写成"unix:路径"时连Unix域socket，忽略serverPort；
+    // 这时transport_type配置为SHM的话，连上之后换成共享内存环(见RpcShmTransport)
     RpcClient(EventLoop* loop, const std::string& serverHost, int serverPort);
-    ~RpcClient();
+    ~RpcClient();  // 要在loop_线程里清理，析构时loop_必须还在运行
     
-    // 连接到服务器
+    // 非阻塞地发起连接，返回true表示已连上或正在连接。
+    // 连接建立之前发出的请求先放在输出缓冲里，连上后一起发送；连接失败时它们以NETWORK_ERROR结束
     bool connect();
     
-    // 断开连接
+    // 断开连接，所有未完成的请求以NETWORK_ERROR结束。
+    // 在loop_线程之外调用时会等loop_线程处理完再返回
     void disconnect();
     
-    // 同步调用RPC方法
+    // 同步调用RPC方法，不能在loop线程里调用
     RpcResponse call(const std::string& method, const std::string& params, 
                      uint32_t timeout = 5000);
     
-    // 异步调用RPC方法
+    // 异步调用RPC方法。
+    // 等待中的请求已经达到max_pending_requests时，call和asyncCall都直接以INTERNAL_ERROR失败
     void asyncCall(const std::string& method, const std::string& params, 
                    RpcCallback callback, uint32_t timeout = 5000);
     
     // 发送通知（不需要响应）
     void notify(const std::string& method, const std::string& params);
     
+    // 打开一个流式调用(服务端用registerStreamMethod注册的方法)。返回的流上可以边写边读，
+    // 最后用finish()取最终响应；打不开时返回的流已经结束，finish()直接拿到错误。
+    // 流没有超时，不用时要cancel；连接断开时以NETWORK_ERROR结束。
+    // 流的读写会阻塞，不能在loop线程里调用
+    RpcStreamPtr openStream(const std::string& method, const std::string& params);
+    
     // 设置协议处理器
     void setProtocolHandler(std::unique_ptr<RpcProtocolHandler> handler);
     
     // 检查连接状态
-    bool isConnected() const { return connected_; }
+    bool isConnected() const { return state_ == kConnected; }
+    bool isDisconnected() const { return state_ == kDisconnected; }
+    
+    // 已发出还没有结束的请求数
+    int inFlight() const { return pendingRequests_.size(); }
     
     // 获取统计信息
     struct Statistics {
@@ -55,56 +78,164 @@ private:
     EventLoop* loop_;
     std::string serverHost_;
     int serverPort_;
+    std::string unixPath_;  // 连Unix域socket时不为空
     int sockfd_;
-    bool connected_;
+    bool loopback_;  // 服务器在127.0.0.0/8或者是Unix域socket
+    
+    enum State { kDisconnected, kConnecting, kConnected };
+    std::atomic<int> state_;
     
     std::shared_ptr<Channel> channel_;
     std::unique_ptr<RpcProtocolHandler> protocolHandler_;
     
-    // 消息ID生成器
-    std::atomic<uint32_t> messageIdGenerator_;
-    
-    // 待处理的请求
-    struct PendingRequest {
-        std::promise<RpcResponse> promise;
-        RpcCallback callback;
-        std::chrono::steady_clock::time_point startTime;
-        uint32_t timeout;
-        bool isAsync;
-        
-        PendingRequest() : isAsync(false) {}
+    // 接收缓冲区，一次读可能带来多个响应，也可能只有半个
+    RpcFrameDecoder decoder_;
+    
+    // 其他线程编好的帧先追加到pendingOutput_，由loop_线程搬进outBuffer_再写。
+    // pendingOutput_从空变为非空时才唤醒一次loop，连续的调用合并成一次write。
+    // 这些帧对应请求的messageId同时记在pendingTimers_里，由loop_线程挂到时间轮上
+    std::mutex outputMutex_;
+    std::string pendingOutput_;
+    std::vector<uint32_t> pendingTimers_;
+    std::string outBuffer_;  // 只在loop_线程访问，写不完的部分等EPOLLOUT
+    std::vector<uint32_t> timerBatch_;  // 只在loop_线程访问，和pendingTimers_交换着用
+    
+    // 自动批量(batch_max_requests > 1且协议支持时打开)：请求先不编码，攒在pendingBatch_里，
+    // 由loop_线程(或者攒满时由调用方线程)编成一个BATCH帧追加到输出。
+    // batch_window_us > 0时第一个请求启动batchTimerFd_，到期再发；为0时不用这个timerfd
+    size_t batchMaxRequests_;
+    int batchWindowUs_;
+    std::vector<RpcRequest> pendingBatch_;  // 由outputMutex_保护
+    std::vector<RpcRequest> batchOut_;      // 只在loop_线程访问，和pendingBatch_交换着用
+    int batchTimerFd_;
+    std::shared_ptr<Channel> batchTimerChannel_;
+    
+    // 方法编号表(method_ids打开时)，每条连接建立后从服务端的rpc.methods取一次。
+    // 调用方线程无锁地读快照；epoch是取表时的connectionEpoch_，断线后旧表作废，
+    // 编号可能对不上重连后的服务端，所以带编号的请求入队时要确认epoch没变
+    struct MethodTable {
+        uint64_t epoch;
+        std::unordered_map<std::string, uint32_t> ids;
     };
-    
-    std::unordered_map<uint32_t, std::unique_ptr<PendingRequest>> pendingRequests_;
-    mutable std::mutex pendingMutex_;
+    bool methodIds_;
+    std::shared_ptr<const MethodTable> methodTable_;  // 用std::atomic_load/atomic_store访问
+    uint64_t connectionEpoch_;                        // 由outputMutex_保护，每次断线加1
+    
+    // 压缩(compression不为none时)：每条连接建立后用rpc.compression协商一次。
+    // 协商结果和所属的connectionEpoch_打包在一个原子变量里：低8位是算法，其余是epoch，
+    // 调用方线程无锁地读；压缩过的帧只能发给协商的那条连接，入队时和方法编号一样核对epoch
+    RpcCompression compression_;
+    size_t compressThreshold_;
+    std::atomic<uint64_t> negotiated_;
+    
+    // 打开着的流，按流的id(就是打开流那个请求的messageId)索引。
+    // 由openStream登记、在最终响应的回调里删除，loop_线程收到STREAM帧时查找
+    std::mutex streamsMutex_;
+    std::unordered_map<uint32_t, RpcStreamPtr> streams_;
+    int streamWindow_;
+    
+    // 共享内存传输：连上之后在onConnected里创建、发出握手，之后outBuffer_写进环，
+    // 响应从环里读；shmChannel_关注环的eventfd，socket只用来发现断开
+    bool useShm_;
+    size_t shmRingSize_;
+    std::unique_ptr<RpcShmTransport> shm_;
+    std::shared_ptr<Channel> shmChannel_;
+    
+    // 未完成的请求，容量由max_pending_requests配置，messageId也由它分配
+    RpcPendingTable pendingRequests_;
+    
+    // 超时由loop_上的timerfd驱动时间轮检查，有请求在等待时才启动timerfd。
+    // 时间轮只在loop_线程里访问
+    static const int kTimerTickMs = 10;
+    static const size_t kTimerSlots = 512;
+    RpcTimingWheel timingWheel_;
+    int timerFd_;
+    std::shared_ptr<Channel> timerChannel_;
+    bool timerArmed_;
     
     // 统计信息
     mutable Statistics statistics_;
     
-    // 生成消息ID
-    uint32_t generateMessageId();
-    
     // 处理接收到的数据
     void handleRead();
     
-    // 处理连接事件
+    // 共享内存环的eventfd可读：服务端写了响应或者读走了请求
+    void handleShmWakeup();
+    
+    // 把outBuffer_写到socket或者共享内存环，出错返回false
+    bool writeOutput();
+    
+    // 可写：非阻塞connect完成，或者继续写outBuffer_
+    void handleWrite();
+    
+    // 每轮事件处理的最后一步，重新设置关注的事件
     void handleConnection();
     
     // 处理错误
     void handleError();
     
-    // 发送请求
-    bool sendRequest(const RpcRequest& request);
+    // 编码请求并交给loop_线程发送，连接已经断开(或者用了上一条连接的方法编号)时返回false。
+    // timed为true时loop_线程还会把这个请求挂到时间轮上。
+    // pinnedEpoch不小于0时请求只能发到这个connectionEpoch_的连接上(流的请求和数据必须走同一条连接)
+    bool sendRequest(RpcRequest request, bool timed = false, int64_t pinnedEpoch = -1);
+    
+    // 把编好的帧交给loop_线程发送，连接已经不是epoch那条时丢掉
+    void sendFrame(std::string frame, uint64_t epoch);
+    
+    // 有编号表并且表里有这个方法时填上方法编号，返回true，epoch设为表所属的连接
+    bool applyMethodId(RpcRequest& request, uint64_t& epoch) const;
+    
+    // 自动批量打开时sendRequest走这里，把请求放进pendingBatch_
+    bool queueBatched(RpcRequest request, bool timed, bool pinned, uint64_t epoch);
+    bool batching() const { return batchMaxRequests_ > 1 && protocolHandler_->supportsBatch(); }
+    
+    // 在loop_线程里把pendingOutput_搬进outBuffer_并尝试写出
+    void flushOutput();
+    
+    void connectInLoop(int fd, bool connected);
+    
+    // 连接建立，在loop_线程里调用
+    void onConnected();
+    
+    // 异步调用rpc.methods，结果对应的连接还在时装上编号表
+    void fetchMethodTable();
+    
+    // 异步调用rpc.compression，结果对应的连接还在时记下协商的算法
+    void negotiateCompression();
+    
+    // 当前连接协商好的算法达到阈值时压缩frame并返回true。
+    // 不管压没压缩，epoch都设为协商所在的连接
+    bool compressFrame(std::string& frame, uint64_t& epoch) const;
+    void disconnectInLoop();
+    
+    // 在loop_线程里执行func，不在loop_线程时等它执行完
+    void runInLoopAndWait(std::function<void()> func);
     
     // 处理响应
     void handleResponse(const RpcResponse& response);
     
-    // 处理超时
-    void handleTimeout();
+    // 解码一个响应帧，BATCH帧里的响应逐个处理
+    void handleResponseFrame(const std::string& frame);
+    
+    // 收到STREAM帧，交给对应的流
+    void handleStreamFrame(const std::string& frame);
+    
+    // 登记已经填好的请求并发送，发送失败时以NETWORK_ERROR结束它，返回是否发送成功
+    bool startRequest(RpcPendingRequest* pending, RpcRequest request, bool timed = true,
+                      int64_t pinnedEpoch = -1);
+    
+    // 把结果交给回调或者同步等待方。异步请求在回调之前归还槽，同步请求由等待方归还
+    void completeRequest(RpcPendingRequest* request, const RpcResponse& response);
+    
+    // timerfd到期，在loop_线程里推进时间轮
+    void handleTimerTick();
+    
+    // 批量窗口到期，发出攒着的请求
+    void handleBatchTimer();
+    
+    // 启动或停止timerfd，只在loop_线程里调用
+    void armTimer(bool on);
     
     // 更新统计信息
     void updateStatistics(bool success, double responseTime);
-    
-    // 清理超时请求
-    void cleanupTimeoutRequests();
 };
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "RpcCompression.h"
+#include "RpcFrameDecoder.h"
+#include "RpcProtocol.h"
+#include <cstring>
+
+#ifdef RPC_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef RPC_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// 压缩后的消息体前面的算法字节和原始长度
+const size_t kCompressedPrefix = 5;
+
+#ifdef RPC_HAVE_LZ4
+// LZ4_compress_fast_extState用的状态，每个线程分配一次
+char* lz4State() {
+    thread_local std::string state(LZ4_sizeofState(), '\0');
+    return &state[0];
+}
+#endif
+
+#ifdef RPC_HAVE_ZSTD
+const int kZstdLevel = ZSTD_CLEVEL_DEFAULT;
+
+// zstd的上下文创建一次要分配好几百KB，每个线程留一份，线程退出时释放
+struct ZstdContexts {
+    ZSTD_CCtx* cctx = ZSTD_createCCtx();
+    ZSTD_DCtx* dctx = ZSTD_createDCtx();
+
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(cctx);
+        ZSTD_freeDCtx(dctx);
+    }
+};
+
+ZstdContexts& zstdContexts() {
+    thread_local ZstdContexts contexts;
+    return contexts;
+}
+#endif
+
+// 压缩后的最大长度，算法不支持时返回0
+size_t compressBound(RpcCompression codec, size_t len) {
+    switch (codec) {
+#ifdef RPC_HAVE_LZ4
+        case RpcCompression::LZ4:
+            return len <= LZ4_MAX_INPUT_SIZE ? LZ4_compressBound(static_cast<int>(len)) : 0;
+#endif
+#ifdef RPC_HAVE_ZSTD
+        case RpcCompression::ZSTD:
+            return ZSTD_compressBound(len);
+#endif
+        default:
+            // 两个算法都没编进来时参数只在这里出现
+            (void)len;
+            return 0;
+    }
+}
+
+// 返回压缩后的长度，失败返回0
+size_t compressBody(RpcCompression codec, const char* src, size_t len, char* dst, size_t capacity) {
+    switch (codec) {
+#ifdef RPC_HAVE_LZ4
+        case RpcCompression::LZ4: {
+            int n = LZ4_compress_fast_extState(lz4State(), src, dst, static_cast<int>(len),
+                                               static_cast<int>(capacity), 1);
+            return n > 0 ? static_cast<size_t>(n) : 0;
+        }
+#endif
+#ifdef RPC_HAVE_ZSTD
+        case RpcCompression::ZSTD: {
+            size_t n = ZSTD_compressCCtx(zstdContexts().cctx, dst, capacity, src, len, kZstdLevel);
+            return ZSTD_isError(n) ? 0 : n;
+        }
+#endif
+        default:
+            (void)src;
+            (void)len;
+            (void)dst;
+            (void)capacity;
+            return 0;
+    }
+}
+
+// 解压出的长度必须正好是rawLength
+bool decompressBody(RpcCompression codec, const char* src, size_t len, char* dst, size_t rawLength) {
+    switch (codec) {
+#ifdef RPC_HAVE_LZ4
+        case RpcCompression::LZ4:
+            return LZ4_decompress_safe(src, dst, static_cast<int>(len), static_cast<int>(rawLength)) ==
+                   static_cast<int>(rawLength);
+#endif
+#ifdef RPC_HAVE_ZSTD
+        case RpcCompression::ZSTD: {
+            size_t n = ZSTD_decompressDCtx(zstdContexts().dctx, dst, rawLength, src, len);
+            return !ZSTD_isError(n) && n == rawLength;
+        }
+#endif
+        default:
+            (void)src;
+            (void)len;
+            (void)dst;
+            (void)rawLength;
+            return false;
+    }
+}
+
+}  // namespace
+
+bool rpcCompressionSupported(RpcCompression codec) {
+    switch (codec) {
+        case RpcCompression::NONE:
+            return true;
+#ifdef RPC_HAVE_LZ4
+        case RpcCompression::LZ4:
+            return true;
+#endif
+#ifdef RPC_HAVE_ZSTD
+        case RpcCompression::ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+const char* rpcCompressionName(RpcCompression codec) {
+    switch (codec) {
+        case RpcCompression::LZ4:
+            return "lz4";
+        case RpcCompression::ZSTD:
+            return "zstd";
+        default:
+            return "none";
+    }
+}
+
+bool parseRpcCompression(std::string_view name, RpcCompression& codec) {
+    if (name == "none") {
+        codec = RpcCompression::NONE;
+    } else if (name == "lz4") {
+        codec = RpcCompression::LZ4;
+    } else if (name == "zstd") {
+        codec = RpcCompression::ZSTD;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool compressRpcFrame(std::string& frame, RpcCompression codec, size_t threshold) {
+    if (codec == RpcCompression::NONE) {
+        return false;
+    }
+    RpcMessageHeader header;
+    int headerLength = decodeRpcHeader(frame.data(), frame.size(), header);
+    if (headerLength <= 0 || (header.flags & kRpcFlagCompressed) || header.bodyLength == 0 ||
+        header.bodyLength < threshold || frame.size() != headerLength + static_cast<size_t>(header.bodyLength)) {
+        return false;
+    }
+    size_t bound = compressBound(codec, header.bodyLength);
+    if (bound == 0) {
+        return false;
+    }
+
+    // 新帧的消息头长度要等压缩完才知道(varint)，先按最长的消息头留出位置，最后把多余的部分去掉
+    std::string out(kRpcMaxHeaderLength + kCompressedPrefix + bound, '\0');
+    char* body = &out[kRpcMaxHeaderLength];
+    size_t n = compressBody(codec, frame.data() + headerLength, header.bodyLength,
+                            body + kCompressedPrefix, bound);
+    // 压不小的数据(已经压缩过的图片之类)照原样发，接收方也省得解压
+    if (n == 0 || kCompressedPrefix + n >= header.bodyLength) {
+        return false;
+    }
+    body[0] = static_cast<char>(codec);
+    for (int i = 0; i < 4; ++i) {
+        body[1 + i] = static_cast<char>(header.bodyLength >> (8 * i));
+    }
+
+    header.flags |= kRpcFlagCompressed;
+    header.bodyLength = static_cast<uint32_t>(kCompressedPrefix + n);
+    header.checksum = rpcFrameChecksum(header, body);
+    char buf[kRpcMaxHeaderLength];
+    size_t newHeaderLength = encodeRpcHeader(header, buf);
+    size_t start = kRpcMaxHeaderLength - newHeaderLength;
+    memcpy(&out[start], buf, newHeaderLength);
+    out.resize(kRpcMaxHeaderLength + header.bodyLength);
+    out.erase(0, start);
+    frame.swap(out);
+    return true;
+}
+
+bool decompressRpcFrame(std::string_view frame, std::string& out) {
+    RpcMessageHeader header;
+    int headerLength = decodeRpcHeader(frame.data(), frame.size(), header);
+    if (headerLength <= 0 || !(header.flags & kRpcFlagCompressed) || header.bodyLength < kCompressedPrefix ||
+        frame.size() != headerLength + static_cast<size_t>(header.bodyLength)) {
+        return false;
+    }
+    const char* body = frame.data() + headerLength;
+    if (header.checksum != rpcFrameChecksum(header, body)) {
+        return false;
+    }
+
+    auto codec = static_cast<RpcCompression>(body[0]);
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(body + 1);
+    uint32_t rawLength = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                         (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    // 原始长度同样受单帧上限约束，防止很小的帧解出一大块内存
+    if (!rpcCompressionSupported(codec) || codec == RpcCompression::NONE ||
+        rawLength > RpcFrameDecoder::kMaxBodyLength) {
+        return false;
+    }
+
+    size_t compressedLength = header.bodyLength - kCompressedPrefix;
+    header.flags = (header.flags & ~kRpcFlagCompressed) | kRpcFlagNoChecksum;
+    header.bodyLength = rawLength;
+    header.checksum = 0;
+    char buf[kRpcMaxHeaderLength];
+    size_t newHeaderLength = encodeRpcHeader(header, buf);
+    out.resize(newHeaderLength + rawLength);
+    memcpy(&out[0], buf, newHeaderLength);
+    return decompressBody(codec, body + kCompressedPrefix, compressedLength, &out[newHeaderLength], rawLength);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// 消息体压缩。帧头带kRpcFlagCompressed时，消息体是
+//   [算法 uint8][原始长度 uint32小端][压缩后的数据]
+// 校验和按线上(压缩后)的字节计算。压缩只改变消息体的表示，和编解码协议、消息类型无关，
+// 所以在帧编好之后、解码之前整帧处理，协议处理器看到的总是没压缩的帧。
+// 用哪种算法由客户端连上后调用内置方法rpc.compression协商，按连接生效；
+// 解压只看消息体里的算法字节，编译进来的算法都能解。
+// LZ4和zstd是可选依赖，CMake找到哪个就编译哪个(RPC_HAVE_LZ4 / RPC_HAVE_ZSTD)
+enum class RpcCompression : uint8_t {
+    NONE = 0,
+    LZ4 = 1,   // 快，适合带宽够用、只想省一点流量的场合
+    ZSTD = 2   // 压缩率高，CPU开销大一些
+};
+
+// 算法是否编译进来了，NONE总是返回true
+bool rpcCompressionSupported(RpcCompression codec);
+
+// 配置和协商里用的名字："none"、"lz4"、"zstd"
+const char* rpcCompressionName(RpcCompression codec);
+bool parseRpcCompression(std::string_view name, RpcCompression& codec);
+
+// 消息体不小于threshold字节时压缩整个帧，成功时替换frame并返回true。
+// 算法没编译进来、frame不是合法的帧、或者压缩后没有变小时frame保持原样，返回false。
+// 压缩上下文每个线程一份，反复使用
+bool compressRpcFrame(std::string& frame, RpcCompression codec, size_t threshold);
+
+// 解开带kRpcFlagCompressed的帧，out是同样版本和消息类型的普通帧。
+// 线上的校验和在这里验证，out改为带kRpcFlagNoChecksum，后面的解码不再重复计算。
+// 校验和不对、算法不支持、数据损坏或者原始长度超过上限时返回false
+bool decompressRpcFrame(std::string_view frame, std::string& out);
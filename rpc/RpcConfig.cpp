@@ -49,6 +49,8 @@ bool RpcConfig::loadConfig(const std::string& configFile) {
             else if (value == "UDP") transportType_ = RpcTransportType::UDP;
             else if (value == "HTTP") transportType_ = RpcTransportType::HTTP;
             else if (value == "WEBSOCKET") transportType_ = RpcTransportType::WEBSOCKET;
+            else if (value == "UNIX") transportType_ = RpcTransportType::UNIX;
+            else if (value == "SHM") transportType_ = RpcTransportType::SHM;
         } else if (key == "port") {
             port_ = std::stoi(value);
         } else if (key == "thread_num") {
@@ -57,6 +59,33 @@ bool RpcConfig::loadConfig(const std::string& configFile) {
             timeoutMs_ = std::stoi(value);
         } else if (key == "max_connections") {
             maxConnections_ = std::stoi(value);
+        } else if (key == "worker_threads") {
+            workerThreads_ = std::stoi(value);
+        } else if (key == "worker_queue_size") {
+            workerQueueSize_ = std::stoi(value);
+        } else if (key == "skip_checksum_on_loopback") {
+            skipChecksumOnLoopback_ = (value == "true" || value == "1");
+        } else if (key == "max_pending_requests") {
+            maxPendingRequests_ = std::stoi(value);
+        } else if (key == "batch_max_requests") {
+            batchMaxRequests_ = std::stoi(value);
+        } else if (key == "batch_window_us") {
+            batchWindowUs_ = std::stoi(value);
+        } else if (key == "stream_window") {
+            streamWindow_ = std::stoi(value);
+        } else if (key == "compression") {
+            if (!parseRpcCompression(value, compression_)) {
+                LOG << "Unknown compression: " << value;
+            } else if (!rpcCompressionSupported(compression_)) {
+                LOG << "Compression " << value << " is not compiled in, disabled";
+                compression_ = RpcCompression::NONE;
+            }
+        } else if (key == "compress_threshold") {
+            compressThreshold_ = std::stoi(value);
+        } else if (key == "shm_ring_size") {
+            shmRingSize_ = std::stoi(value);
+        } else if (key == "method_ids") {
+            methodIds_ = (value == "true" || value == "1");
         } else if (key == "log_level") {
             logLevel_ = value;
         } else if (key == "log_path") {
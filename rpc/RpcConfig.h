@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <memory>
 #include "base/noncopyable.h"
+#include "RpcCompression.h"
 
 // RPC协议类型枚举
 enum class RpcProtocolType {
@@ -20,12 +21,15 @@ enum class RpcSerializeType {
     CUSTOM_SERIALIZE = 3
 };
 
-// RPC传输层类型枚举
+// RPC传输层类型枚举。TCP和UNIX由地址决定(RpcClient的主机名写成"unix:路径"就走Unix域socket)，
+// SHM是在Unix域socket上再换成共享内存环，只有RpcClient看这个配置
 enum class RpcTransportType {
     TCP = 0,
     UDP = 1,
     HTTP = 2,
-    WEBSOCKET = 3
+    WEBSOCKET = 3,
+    UNIX = 4,
+    SHM = 5
 };
 
 // RPC配置类
@@ -46,6 +50,43 @@ public:
     int getTimeoutMs() const { return timeoutMs_; }
     int getMaxConnections() const { return maxConnections_; }
     
+    // 工作线程池的线程数和每个线程分到的排队上限(总上限为两者之积)，为0时POOLED方法也在IO线程里执行
+    int getWorkerThreads() const { return workerThreads_; }
+    int getWorkerQueueSize() const { return workerQueueSize_; }
+    
+    // 连到127.0.0.0/8或者Unix域socket时不计算消息体校验和
+    bool getSkipChecksumOnLoopback() const { return skipChecksumOnLoopback_; }
+    
+    // 每个RpcClient最多同时等待的请求数，向上取整到2的幂
+    int getMaxPendingRequests() const { return maxPendingRequests_; }
+    
+    // RpcClient自动批量：一个BATCH帧最多装多少个请求，不大于1时不合并，逐个发送。
+    // 对端是不认识BATCH帧的旧服务端时不要打开
+    int getBatchMaxRequests() const { return batchMaxRequests_; }
+    
+    // 批量的等待窗口。为0时不额外等待，只合并loop线程处理之前已经到达的请求；
+    // 大于0时第一个请求最多再等这么多微秒，攒满batch_max_requests提前发送
+    int getBatchWindowUs() const { return batchWindowUs_; }
+    
+    // RpcClient连上之后调用rpc.methods换取方法编号，之后的请求只带编号。
+    // 对端没有rpc.methods(旧服务端)时调用失败，继续按方法名发送
+    bool getMethodIds() const { return methodIds_; }
+    
+    // 每个流每个方向的接收窗口(字节)，对端最多领先这么多还没被读走的数据。
+    // 不小于协议规定的初始窗口64KB
+    int getStreamWindow() const { return streamWindow_; }
+    
+    // RpcClient连上之后用rpc.compression请求的压缩算法，NONE(默认)时不协商、不压缩
+    RpcCompression getCompression() const { return compression_; }
+    
+    // 消息体不小于这么多字节才压缩，客户端和服务端各自按自己的配置判断。
+    // 小消息压缩省不了多少流量，反而多花CPU
+    int getCompressThreshold() const { return compressThreshold_; }
+    
+    // transport_type为SHM时共享内存环每个方向的容量(字节)，向上取整到2的幂。
+    // 一帧可以比环大，分几次写过去
+    int getShmRingSize() const { return shmRingSize_; }
+    
     const std::string& getLogLevel() const { return logLevel_; }
     const std::string& getLogPath() const { return logPath_; }
     
@@ -67,6 +108,17 @@ private:
     int threadNum_ = 4;
     int timeoutMs_ = 5000;
     int maxConnections_ = 1000;
+    int workerThreads_ = 4;
+    int workerQueueSize_ = 1024;
+    bool skipChecksumOnLoopback_ = false;
+    int maxPendingRequests_ = 4096;
+    int batchMaxRequests_ = 0;
+    int batchWindowUs_ = 0;
+    bool methodIds_ = false;
+    int streamWindow_ = 256 * 1024;
+    RpcCompression compression_ = RpcCompression::NONE;
+    int compressThreshold_ = 4096;
+    int shmRingSize_ = 1024 * 1024;
     
     std::string logLevel_ = "INFO";
     std::string logPath_ = "./logs/";
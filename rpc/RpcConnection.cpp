@@ -0,0 +1,231 @@
+#include "RpcConnection.h"
+#include <errno.h>
+#include "../Metrics.h"
+#include "../Util.h"
+#include "../base/Logging.h"
+
+RpcConnection::RpcConnection(EventLoop* loop, int fd, const struct sockaddr_in& peer)
+    : loop_(loop), fd_(fd), channel_(std::make_shared<Channel>(loop, fd)), peer_(peer),
+      state_(kConnected), error_(false), compression_(RpcCompression::NONE),
+      helloPending_(peer.sin_family == AF_UNIX) {
+    // Channel的生命期不长于本对象：关闭时先从poller里摘掉，再析构
+    channel_->setReadHandler([this]() { handleRead(); });
+    channel_->setWriteHandler([this]() { handleWrite(); });
+    channel_->setConnHandler([this]() { handleConn(); });
+    channel_->setErrorHandler([this]() {
+        error_ = true;
+        handleClose();
+    });
+}
+
+RpcConnection::~RpcConnection() {
+    Metrics::add(kMetricConnClosed);
+    close(fd_);
+}
+
+void RpcConnection::connectEstablished() {
+    channel_->setEvents(EPOLLIN | EPOLLET);
+    loop_->addToPoller(channel_, 0);
+}
+
+void RpcConnection::send(const std::string& data) {
+    if (loop_->isInLoopThread()) {
+        sendInLoop(data);
+    } else {
+        loop_->queueInLoop(std::bind(&RpcConnection::sendInLoop, shared_from_this(), data));
+    }
+}
+
+void RpcConnection::send(std::string&& data) {
+    if (loop_->isInLoopThread()) {
+        sendInLoop(data);
+    } else {
+        // 流的DATA帧可能很大，直接移进投递的任务里，不再拷贝
+        loop_->queueInLoop([self = shared_from_this(), data = std::move(data)]() { self->sendInLoop(data); });
+    }
+}
+
+void RpcConnection::sendInLoop(const std::string& data) {
+    if (state_ == kDisconnected) {
+        return;
+    }
+    bool idle = outBuffer_.empty();
+    outBuffer_ += data;
+    // 前面还有没发完的数据，说明已经在等EPOLLOUT了，按顺序排队即可
+    if (!idle) {
+        return;
+    }
+    if (!writeOutput()) {
+        LOG << "RpcConnection write error, fd " << fd_;
+        error_ = true;
+    }
+    // 没发完就关注EPOLLOUT(共享内存环写满时等对端唤醒)，出错就关闭
+    if (!outBuffer_.empty() || error_) {
+        handleConn();
+    }
+}
+
+bool RpcConnection::writeOutput() {
+    if (!shm_) {
+        return writen(fd_, outBuffer_) >= 0;
+    }
+    ssize_t n = shm_->write(outBuffer_.data(), outBuffer_.size());
+    if (n < 0) {
+        return false;
+    }
+    outBuffer_.erase(0, n);
+    return true;
+}
+
+void RpcConnection::handleRead() {
+    if (helloPending_ && !receiveHello()) {
+        return;
+    }
+    if (shm_) {
+        // 握手之后对端不再往socket上写，可读只意味着关闭
+        std::string unexpected;
+        bool zero = false;
+        if (readn(fd_, unexpected, zero) < 0 || !unexpected.empty()) {
+            error_ = true;
+            return;
+        }
+        if (zero && state_ == kConnected) {
+            handleShmWakeup();  // 关闭之前写进环里的请求照样处理
+            state_ = kDisconnecting;
+        }
+        return;
+    }
+    bool zero = false;
+    ssize_t n = readn(fd_, decoder_.buffer(), zero);
+    if (n < 0) {
+        error_ = true;
+        return;
+    }
+    if (n > 0) {
+        Metrics::add(kMetricBytesIn, n);
+        decodeFrames();
+    }
+    // 对端关闭了写端，把已经排队的响应发完再关闭
+    if (zero && state_ == kConnected) {
+        state_ = kDisconnecting;
+    }
+}
+
+bool RpcConnection::receiveHello() {
+    ssize_t n = RpcShmTransport::receiveHello(fd_, decoder_.buffer(), shm_);
+    if (n < 0 && errno == EAGAIN) {
+        return false;
+    }
+    helloPending_ = false;
+    if (n < 0) {
+        LOG << "RpcConnection closing fd " << fd_ << " after a bad shared memory hello";
+        error_ = true;
+        return false;
+    }
+    if (shm_) {
+        shmChannel_ = std::make_shared<Channel>(loop_, shm_->wakeFd());
+        shmChannel_->setEvents(EPOLLIN | EPOLLET);
+        shmChannel_->setReadHandler([this]() { handleShmWakeup(); });
+        shmChannel_->setConnHandler([this]() {
+            handleConn();
+            if (state_ != kDisconnected) {
+                shmChannel_->setEvents(EPOLLIN | EPOLLET);
+                loop_->updatePoller(shmChannel_, 0);
+            }
+        });
+        loop_->addToPoller(shmChannel_, 0);
+        LOG << "RpcConnection fd " << fd_ << " switched to a " << shm_->ringSize() << "-byte shared memory ring";
+        // 客户端发完握手可能马上就往环里写了
+        handleShmWakeup();
+    } else if (n > 0) {
+        // 普通的Unix域客户端，读到的是帧的开头
+        Metrics::add(kMetricBytesIn, n);
+        decodeFrames();
+    }
+    return true;
+}
+
+void RpcConnection::handleShmWakeup() {
+    if (state_ == kDisconnected || error_) {
+        return;
+    }
+    shm_->clearWakeup();
+    ssize_t n = shm_->read(decoder_.buffer());
+    if (n < 0) {
+        LOG << "RpcConnection closing fd " << fd_ << " after a corrupted shared memory ring";
+        error_ = true;
+        return;
+    }
+    if (n > 0) {
+        Metrics::add(kMetricBytesIn, n);
+        decodeFrames();
+    }
+    // 可能是对端读走了响应，接着写排队的部分
+    if (!outBuffer_.empty() && !error_ && !writeOutput()) {
+        error_ = true;
+    }
+}
+
+void RpcConnection::handleWrite() {
+    if (state_ == kDisconnected || error_) {
+        return;
+    }
+    if (!writeOutput()) {
+        LOG << "RpcConnection write error, fd " << fd_;
+        error_ = true;
+    }
+}
+
+// 每轮事件处理的最后一步，根据当前状态决定关注哪些事件或关闭连接
+void RpcConnection::handleConn() {
+    if (state_ == kDisconnected) {
+        return;
+    }
+    // 共享内存连接的对端关闭之后就不会再读环了，排队的响应不用再等
+    if (error_ || (state_ == kDisconnecting && (outBuffer_.empty() || shm_))) {
+        handleClose();
+        return;
+    }
+    __uint32_t& events = channel_->getEvents();
+    events = EPOLLET;
+    if (state_ == kConnected) {
+        events |= EPOLLIN;
+    }
+    if (!outBuffer_.empty() && !shm_) {
+        events |= EPOLLOUT;
+    }
+    loop_->updatePoller(channel_, 0);
+}
+
+void RpcConnection::handleClose() {
+    if (state_ == kDisconnected) {
+        return;
+    }
+    state_ = kDisconnected;
+    RpcConnectionPtr guard(shared_from_this());  // closeCallback里可能释放最后一个引用
+    loop_->removeFromPoller(channel_);
+    if (shmChannel_) {
+        loop_->removeFromPoller(shmChannel_);
+    }
+    if (closeCallback_) {
+        closeCallback_(guard);
+    }
+}
+
+void RpcConnection::decodeFrames() {
+    std::string_view frame;
+    while (state_ != kDisconnected && !error_) {
+        RpcFrameDecoder::Status status = decoder_.nextFrame(frame);
+        if (status == RpcFrameDecoder::kNeedMore) {
+            break;
+        }
+        if (status == RpcFrameDecoder::kError) {
+            LOG << "RpcConnection closing fd " << fd_ << " after a bad frame";
+            error_ = true;
+            break;
+        }
+        if (frameCallback_) {
+            frameCallback_(shared_from_this(), frame);
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <netinet/in.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include "../Channel.h"
+#include "../EventLoop.h"
+#include "../base/noncopyable.h"
+#include "RpcCompression.h"
+#include "RpcFrameDecoder.h"
+#include "RpcProtocol.h"
+#include "RpcShmTransport.h"
+#include "RpcStream.h"
+
+class RpcConnection;
+using RpcConnectionPtr = std::shared_ptr<RpcConnection>;
+
+// 凑齐一个完整帧(消息头+消息体)时回调，frame包含消息头。
+// frame直接指向接收缓冲区，只在回调期间有效，需要保留的数据要自己拷贝
+using RpcFrameCallback = std::function<void(const RpcConnectionPtr&, std::string_view frame)>;
+using RpcCloseCallback = std::function<void(const RpcConnectionPtr&)>;
+
+// 一条RPC连接，地位和HttpData相同：持有fd、Channel和收发缓冲区，
+// 读写都在所属EventLoop的线程里进行。
+// TCP上的数据可能一帧分几次到达，也可能一次读到好几帧，
+// 由RpcFrameDecoder切分，每凑齐一帧交给frameCallback。
+// Unix域连接上客户端可以先发共享内存的握手消息(见RpcShmTransport)，
+// 之后收发改走共享内存环，socket只用来发现对端关闭。
+class RpcConnection : noncopyable, public std::enable_shared_from_this<RpcConnection> {
+public:
+    RpcConnection(EventLoop* loop, int fd, const struct sockaddr_in& peer);
+    ~RpcConnection();
+
+    void setFrameCallback(RpcFrameCallback cb) { frameCallback_ = std::move(cb); }
+    void setCloseCallback(RpcCloseCallback cb) { closeCallback_ = std::move(cb); }
+
+    // 注册到所属loop的poller，在loop线程里调用
+    void connectEstablished();
+
+    // 线程安全，不在loop线程时转到loop线程里发送
+    void send(const std::string& data);
+    void send(std::string&& data);
+
+    EventLoop* getLoop() const { return loop_; }
+    int getFd() const { return fd_; }
+    const struct sockaddr_in& getPeer() const { return peer_; }
+    bool isLocal() const { return peer_.sin_family == AF_UNIX; }
+    bool connected() const { return state_ == kConnected; }
+
+    // 这条连接上还没结束的流，按流的id索引，只在loop线程里访问
+    std::unordered_map<uint32_t, RpcStreamPtr>& streams() { return streams_; }
+
+    // 客户端通过rpc.compression协商的压缩算法，发给它的帧用这个算法压缩。
+    // 响应可能在工作线程里编码，所以是原子的
+    RpcCompression compression() const { return compression_.load(std::memory_order_relaxed); }
+    void setCompression(RpcCompression codec) { compression_.store(codec, std::memory_order_relaxed); }
+
+private:
+    enum State { kConnected, kDisconnecting, kDisconnected };
+
+    EventLoop* loop_;
+    int fd_;
+    std::shared_ptr<Channel> channel_;
+    struct sockaddr_in peer_;
+    State state_;
+    bool error_;
+
+    RpcFrameDecoder decoder_;
+    std::string outBuffer_;
+    std::unordered_map<uint32_t, RpcStreamPtr> streams_;
+    std::atomic<RpcCompression> compression_;
+
+    // Unix域连接在收到第一批数据之前helloPending_为true；收到握手消息之后shm_不为空，
+    // shmChannel_关注它的eventfd
+    bool helloPending_;
+    std::unique_ptr<RpcShmTransport> shm_;
+    std::shared_ptr<Channel> shmChannel_;
+
+    RpcFrameCallback frameCallback_;
+    RpcCloseCallback closeCallback_;
+
+    void handleRead();
+    void handleWrite();
+    void handleConn();
+    void handleClose();
+    void sendInLoop(const std::string& data);
+
+    // 把outBuffer_写到socket或者共享内存环，出错返回false
+    bool writeOutput();
+
+    // 读Unix域连接上的第一批数据，是握手消息就换到共享内存环。返回false表示这次不用再读socket了
+    bool receiveHello();
+
+    // 共享内存环的eventfd可读：对端写了请求或者读走了响应
+    void handleShmWakeup();
+
+    // 切出收到的所有完整帧并回调
+    void decodeFrames();
+};
@@ -0,0 +1,54 @@
+#include "RpcFrameDecoder.h"
+#include "../base/Logging.h"
+
+RpcFrameDecoder::Status RpcFrameDecoder::nextFrame(std::string& frame) {
+    ssize_t length = frameLength();
+    if (length <= 0) {
+        return length == 0 ? kNeedMore : kError;
+    }
+    frame.assign(buffer_, readPos_, length);
+    readPos_ += length;
+    return kFrame;
+}
+
+RpcFrameDecoder::Status RpcFrameDecoder::nextFrame(std::string_view& frame) {
+    ssize_t length = frameLength();
+    if (length <= 0) {
+        return length == 0 ? kNeedMore : kError;
+    }
+    frame = std::string_view(buffer_.data() + readPos_, length);
+    readPos_ += length;
+    return kFrame;
+}
+
+ssize_t RpcFrameDecoder::frameLength() {
+    size_t readable = readableBytes();
+    RpcMessageHeader header;
+    int headerLength = decodeRpcHeader(buffer_.data() + readPos_, readable, header);
+    if (headerLength == 0) {
+        compact();
+        return 0;
+    }
+    if (headerLength < 0 || header.bodyLength > kMaxBodyLength) {
+        LOG << "RpcFrameDecoder bad frame header, bodyLength " << header.bodyLength;
+        return -1;
+    }
+
+    size_t frameLength = headerLength + header.bodyLength;
+    if (readable < frameLength) {
+        compact();
+        return 0;
+    }
+    return static_cast<ssize_t>(frameLength);
+}
+
+// 已处理的数据攒到一半以上再整体前移，避免每帧都搬动后面的数据
+void RpcFrameDecoder::compact() {
+    if (readPos_ == buffer_.size()) {
+        buffer_.clear();
+        readPos_ = 0;
+    } else if (readPos_ > buffer_.size() / 2) {
+        buffer_.erase(0, readPos_);
+        readPos_ = 0;
+    }
+}
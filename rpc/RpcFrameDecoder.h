@@ -0,0 +1,41 @@
+#pragma once
+#include <sys/types.h>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include "RpcProtocol.h"
+
+// 按RpcMessageHeader切分字节流的增量解码器，RpcConnection和RpcClient共用。
+// 用法：readn直接追加到buffer()，然后反复调用nextFrame直到不再返回kFrame。
+// 不完整的帧留在缓冲区里等下次读；已经取走的数据攒到一定量才整体前移。
+class RpcFrameDecoder {
+public:
+    enum Status {
+        kNeedMore,  // 缓冲区里没有完整的帧了
+        kFrame,     // 取出了一帧
+        kError      // 魔数不对或长度超限，连接应当关闭
+    };
+
+    // 单帧消息体上限，防止对端用伪造的长度让缓冲区无限增长
+    static const uint32_t kMaxBodyLength = 64 * 1024 * 1024;
+
+    RpcFrameDecoder() : readPos_(0) {}
+
+    std::string& buffer() { return buffer_; }
+    size_t readableBytes() const { return buffer_.size() - readPos_; }
+
+    // 取出下一个完整帧(消息头+消息体)放到frame里
+    Status nextFrame(std::string& frame);
+
+    // 同上，但frame直接指向缓冲区，不拷贝。
+    // 只在下一次调用nextFrame或往buffer()里追加数据之前有效
+    Status nextFrame(std::string_view& frame);
+
+private:
+    std::string buffer_;
+    size_t readPos_;  // buffer_中还没处理的数据从这里开始
+
+    // 返回下一帧的长度，没有完整的帧返回0，出错返回-1
+    ssize_t frameLength();
+    void compact();
+};
@@ -0,0 +1,114 @@
+#include "RpcPendingTable.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+long futex(std::atomic<uint32_t>* addr, int op, uint32_t val) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), op, val, nullptr, nullptr, 0);
+}
+
+}  // namespace
+
+void RpcPendingRequest::waitReady() {
+    // 被EINTR打断或者是槽上一轮的迟到唤醒，都回来重新看一次
+    while (ready_.load(std::memory_order_acquire) == 0) {
+        futex(&ready_, FUTEX_WAIT_PRIVATE, 0);
+    }
+}
+
+void RpcPendingRequest::setReady() {
+    ready_.store(1, std::memory_order_release);
+    // 唤醒之后这个槽可能马上就被等待方归还、被别人占走，这里不能再碰它的字段
+    futex(&ready_, FUTEX_WAKE_PRIVATE, 1);
+}
+
+RpcPendingTable::RpcPendingTable(int indexBits)
+    : indexBits_(indexBits),
+      indexMask_((1u << indexBits) - 1),
+      slots_(new RpcPendingRequest[indexMask_ + 1]),
+      freeHead_(0),
+      size_(0) {
+    // 所有槽串成空闲栈，下标小的在栈顶
+    for (uint32_t i = 0; i <= indexMask_; ++i) {
+        slots_[i].nextFree_.store(i + 1 <= indexMask_ ? i + 2 : 0, std::memory_order_relaxed);
+    }
+    freeHead_.store(1, std::memory_order_relaxed);
+}
+
+RpcPendingRequest* RpcPendingTable::claim() {
+    uint64_t head = freeHead_.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t top = static_cast<uint32_t>(head);
+        if (top == 0) {
+            return nullptr;
+        }
+        // 读到的nextFree_可能已经过时(这个槽刚被别人弹出又压回)，那样的话版本号也变了，CAS会失败
+        uint32_t next = slots_[top - 1].nextFree_.load(std::memory_order_relaxed);
+        uint64_t newHead = ((head >> 32) + 1) << 32 | next;
+        if (freeHead_.compare_exchange_weak(head, newHead, std::memory_order_acquire,
+                                            std::memory_order_acquire)) {
+            break;
+        }
+    }
+
+    uint32_t index = static_cast<uint32_t>(head) - 1;
+    RpcPendingRequest* request = &slots_[index];
+    // generation从1开始并跳过0，保证messageId不会是通知用的0
+    uint32_t generation = (request->generation_ + 1) & (0xffffffffu >> indexBits_);
+    request->generation_ = generation == 0 ? 1 : generation;
+    request->messageId = request->generation_ << indexBits_ | index;
+    request->ready_.store(0, std::memory_order_relaxed);
+    return request;
+}
+
+void RpcPendingTable::publish(RpcPendingRequest* request) {
+    ++size_;
+    // 和RpcClient检查连接状态配对，必须是顺序一致的，见RpcClient::startRequest
+    request->owner_.store(request->messageId);
+}
+
+RpcPendingRequest* RpcPendingTable::take(uint32_t messageId) {
+    RpcPendingRequest* request = &slots_[messageId & indexMask_];
+    uint32_t expected = messageId;
+    if (messageId == 0 || !request->owner_.compare_exchange_strong(expected, 0)) {
+        return nullptr;
+    }
+    --size_;
+    return request;
+}
+
+void RpcPendingTable::takeAll(std::vector<RpcPendingRequest*>& taken) {
+    for (uint32_t i = 0; i <= indexMask_; ++i) {
+        uint32_t messageId = slots_[i].owner_.load();
+        if (messageId != 0 && take(messageId)) {
+            taken.push_back(&slots_[i]);
+        }
+    }
+}
+
+RpcPendingRequest* RpcPendingTable::peek(uint32_t messageId) {
+    RpcPendingRequest* request = &slots_[messageId & indexMask_];
+    if (messageId == 0 || request->owner_.load() != messageId) {
+        return nullptr;
+    }
+    return request;
+}
+
+void RpcPendingTable::release(RpcPendingRequest* request) {
+    // 回调可能捕获了大对象，归还前先释放
+    request->callback = nullptr;
+    request->result = nullptr;
+
+    uint32_t index = static_cast<uint32_t>(request - slots_.get());
+    uint64_t head = freeHead_.load(std::memory_order_relaxed);
+    for (;;) {
+        request->nextFree_.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        uint64_t newHead = ((head >> 32) + 1) << 32 | (index + 1);
+        if (freeHead_.compare_exchange_weak(head, newHead, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "../base/noncopyable.h"
+#include "RpcProtocol.h"
+#include "RpcTimingWheel.h"
+
+// RPC调用回调函数类型
+using RpcCallback = std::function<void(const RpcResponse&)>;
+
+// 一个未完成的请求，就是RpcPendingTable里的一个槽，同时挂在时间轮上等超时
+struct RpcPendingRequest : RpcTimerNode {
+    uint32_t messageId = 0;
+    uint32_t timeout = 0;
+    std::chrono::steady_clock::time_point startTime;
+    RpcCallback callback;           // 异步调用的回调
+    RpcResponse* result = nullptr;  // 同步调用：结果直接写到等待方栈上的对象里
+
+    // 同步调用：完成方写好result后置1并唤醒，等待方醒来后负责release
+    void waitReady();
+    void setReady();
+
+private:
+    friend class RpcPendingTable;
+    std::atomic<uint32_t> owner_{0};     // 登记后等于messageId，空闲或者已被取走时为0
+    std::atomic<uint32_t> ready_{0};
+    std::atomic<uint32_t> nextFree_{0};  // 空闲栈里下一个槽的下标+1，0表示栈底
+    uint32_t generation_ = 0;
+};
+
+// 按messageId索引的定长槽数组，代替 unordered_map + mutex + promise。
+// messageId = generation << indexBits | 下标，同一个槽每复用一次generation加1，
+// 迟到的响应或者超时后才到的响应带着旧generation，自然对不上。
+// 占槽、登记、取走、归还都是O(1)，不加锁也不分配内存：
+//   claim    从无锁空闲栈弹出一个槽并分配messageId，满了返回nullptr
+//   publish  调用方填好字段后登记，之后take才能拿到它
+//   take     对owner_做一次CAS，响应、超时、断线、发送失败谁先CAS成功谁独占这个请求
+//   release  槽回到空闲栈
+// generation有32 - indexBits位，同一个槽要复用这么多次之后才会重号。
+class RpcPendingTable : noncopyable {
+public:
+    explicit RpcPendingTable(int indexBits);
+
+    size_t capacity() const { return indexMask_ + 1; }
+
+    // 已登记还没被取走的请求数
+    int size() const { return size_; }
+
+    RpcPendingRequest* claim();
+    void publish(RpcPendingRequest* request);
+
+    // messageId对应的请求还在等待时取走它，调用方从此独占，否则返回nullptr
+    RpcPendingRequest* take(uint32_t messageId);
+
+    // 取走所有还在等待的请求，追加到taken，断开连接时用
+    void takeAll(std::vector<RpcPendingRequest*>& taken);
+
+    // 不取走，只看messageId对应的请求是否还在等待
+    RpcPendingRequest* peek(uint32_t messageId);
+
+    void release(RpcPendingRequest* request);
+
+private:
+    int indexBits_;
+    uint32_t indexMask_;
+    std::unique_ptr<RpcPendingRequest[]> slots_;  // 槽里有atomic，不能放进要搬家的vector
+    // 空闲栈顶：高32位是每次修改都加1的版本号，防ABA；低32位是下标+1
+    std::atomic<uint64_t> freeHead_;
+    std::atomic<int> size_;
+};
@@ -1,8 +1,210 @@
 #include "RpcProtocol.h"
 #include "JsonProtocolHandler.h"
+#include "MsgpackProtocolHandler.h"
+#include "Crc32c.h"
 #include <sstream>
 #include "../base/Logging.h"
 
+namespace {
+
+void storeLe16(uint8_t* p, uint16_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+}
+
+void storeLe32(uint8_t* p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+uint16_t loadLe16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+uint32_t loadLe32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+size_t storeVarint32(uint8_t* p, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+// 返回消耗的字节数；数据不够返回0；超过5字节或溢出32位返回-1
+int loadVarint32(const uint8_t* p, size_t len, uint32_t& v) {
+    v = 0;
+    for (size_t i = 0; i < 5; ++i) {
+        if (i == len) {
+            return 0;
+        }
+        uint32_t byte = p[i];
+        if (i == 4 && byte > 0x0f) {
+            return -1;
+        }
+        v |= (byte & 0x7f) << (7 * i);
+        if (!(byte & 0x80)) {
+            return static_cast<int>(i + 1);
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+size_t encodeRpcHeader(const RpcMessageHeader& header, char* buf) {
+    uint8_t* p = reinterpret_cast<uint8_t*>(buf);
+    storeLe16(p, kRpcMagic);
+    p[2] = static_cast<uint8_t>((header.version << 4) | (static_cast<uint8_t>(header.type) & 0x0f));
+    p[3] = header.flags;
+    size_t pos = 4;
+    if (header.flags & kRpcFlagVarint) {
+        pos += storeVarint32(p + pos, header.messageId);
+        pos += storeVarint32(p + pos, header.bodyLength);
+    } else {
+        storeLe32(p + 4, header.messageId);
+        storeLe32(p + 8, header.bodyLength);
+        pos = 12;
+    }
+    storeLe32(p + pos, header.checksum);
+    return pos + 4;
+}
+
+int decodeRpcHeader(const char* data, size_t len, RpcMessageHeader& header) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(data);
+    if (len < 4) {
+        return 0;
+    }
+    if (loadLe16(p) != kRpcMagic) {
+        return -1;
+    }
+    header.version = p[2] >> 4;
+    header.type = static_cast<RpcMessageType>(p[2] & 0x0f);
+    header.flags = p[3];
+    if (header.version != kRpcVersion && header.version != kRpcLegacyVersion) {
+        return -1;
+    }
+
+    if (!(header.flags & kRpcFlagVarint)) {
+        if (len < kRpcFixedHeaderLength) {
+            return 0;
+        }
+        header.messageId = loadLe32(p + 4);
+        header.bodyLength = loadLe32(p + 8);
+        header.checksum = loadLe32(p + 12);
+        return static_cast<int>(kRpcFixedHeaderLength);
+    }
+
+    size_t pos = 4;
+    int n = loadVarint32(p + pos, len - pos, header.messageId);
+    if (n <= 0) {
+        return n;
+    }
+    pos += n;
+    n = loadVarint32(p + pos, len - pos, header.bodyLength);
+    if (n <= 0) {
+        return n;
+    }
+    pos += n;
+    if (len - pos < 4) {
+        return 0;
+    }
+    header.checksum = loadLe32(p + pos);
+    return static_cast<int>(pos + 4);
+}
+
+uint32_t rpcChecksum(uint8_t version, const char* data, size_t len) {
+    if (version != kRpcLegacyVersion) {
+        return crc32c(data, len);
+    }
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < len; ++i) {
+        checksum = checksum * 31 + static_cast<uint32_t>(data[i]);
+    }
+    return checksum;
+}
+
+uint32_t rpcFrameChecksum(const RpcMessageHeader& header, const char* body) {
+    if (header.flags & kRpcFlagNoChecksum) {
+        return 0;
+    }
+    return rpcChecksum(header.version, body, header.bodyLength);
+}
+
+// RpcProtocolHandler实现
+std::string RpcProtocolHandler::buildFrame(RpcMessageHeader& header, const std::string& body) {
+    header.bodyLength = static_cast<uint32_t>(body.size());
+    header.checksum = rpcFrameChecksum(header, body.data());
+    
+    char buf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, buf);
+    std::string frame;
+    frame.reserve(headerLength + body.size());
+    frame.append(buf, headerLength);
+    frame += body;
+    return frame;
+}
+
+bool RpcProtocolHandler::parseFrame(std::string_view data, RpcMessageHeader& header,
+                                    std::string_view& body) {
+    int headerLength = decodeRpcHeader(data.data(), data.size(), header);
+    if (headerLength <= 0) {
+        return false;
+    }
+    
+    // 验证消息长度
+    if (data.size() != headerLength + static_cast<size_t>(header.bodyLength)) {
+        return false;
+    }
+    
+    // 验证校验和
+    body = data.substr(headerLength);
+    return header.checksum == rpcFrameChecksum(header, body.data());
+}
+
+std::string encodeRpcStreamFrame(const RpcMessageHeader& format, uint32_t streamId,
+                                 RpcStreamFrame kind, std::string_view payload) {
+    RpcMessageHeader header;
+    header.version = format.version;
+    header.type = RpcMessageType::STREAM;
+    header.flags = format.flags & (kRpcFlagVarint | kRpcFlagNoChecksum);
+    header.messageId = streamId;
+    header.bodyLength = static_cast<uint32_t>(1 + payload.size());
+    
+    // 消息头长度和校验和无关，先编一遍确定长度，消息体直接写在后面，算完校验和再回填
+    char buf[kRpcMaxHeaderLength];
+    size_t headerLength = encodeRpcHeader(header, buf);
+    std::string frame(headerLength + header.bodyLength, '\0');
+    frame[headerLength] = static_cast<char>(kind);
+    payload.copy(&frame[headerLength + 1], payload.size());
+    header.checksum = rpcFrameChecksum(header, &frame[headerLength]);
+    encodeRpcHeader(header, &frame[0]);
+    return frame;
+}
+
+bool decodeRpcStreamFrame(std::string_view data, RpcMessageHeader& header,
+                          RpcStreamFrame& kind, std::string_view& payload) {
+    int headerLength = decodeRpcHeader(data.data(), data.size(), header);
+    if (headerLength <= 0 || header.type != RpcMessageType::STREAM || header.bodyLength == 0 ||
+        data.size() != headerLength + static_cast<size_t>(header.bodyLength)) {
+        return false;
+    }
+    const char* body = data.data() + headerLength;
+    if (header.checksum != rpcFrameChecksum(header, body)) {
+        return false;
+    }
+    kind = static_cast<RpcStreamFrame>(body[0]);
+    payload = std::string_view(body + 1, header.bodyLength - 1);
+    return true;
+}
+
 // RpcRequest实现
 std::string RpcRequest::serialize() const {
     std::ostringstream oss;
@@ -130,9 +332,7 @@ std::unique_ptr<RpcProtocolHandler> RpcProtocolFactory::createHandler(RpcProtoco
             LOG << "Protobuf protocol handler not implemented yet";
             return nullptr;
         case RpcProtocolType::MSGPACK:
-            // TODO: 实现MessagePack处理器
-            LOG << "MessagePack protocol handler not implemented yet";
-            return nullptr;
+            return std::make_unique<MsgpackProtocolHandler>();
         case RpcProtocolType::CUSTOM:
             // TODO: 支持自定义协议处理器
             LOG << "Custom protocol handler not implemented yet";
@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <cstdint>
@@ -18,6 +19,8 @@ enum class RpcErrorCode : int32_t {
     NETWORK_ERROR = -7,
     SERIALIZE_ERROR = -8,
     DESERIALIZE_ERROR = -9,
+    SERVER_BUSY = -10,  // 工作线程池的队列满了，请求没有执行，可以稍后重试
+    CANCELLED = -11,    // 流被取消
     CUSTOM_ERROR = -100
 };
 
@@ -26,24 +29,91 @@ enum class RpcMessageType : uint8_t {
     REQUEST = 1,
     RESPONSE = 2,
     NOTIFICATION = 3,
-    HEARTBEAT = 4
+    HEARTBEAT = 4,
+    BATCH = 5,          // 一帧里装多个请求或多个响应，messageId为元素个数
+    STREAM = 6          // 流的数据和控制帧，messageId为流的id，格式见RpcStreamFrame
 };
 
-// RPC消息头结构
+// 线上消息头，所有多字节字段都是小端，逐字节编解码，和编译器的对齐、主机字节序无关。
+// 定长格式(16字节)：
+//   0  uint16 magic       kRpcMagic，线上字节为 'R' 'P'
+//   2  uint8  version<<4 | type   version决定校验和算法，见rpcChecksum
+//   3  uint8  flags       RpcHeaderFlag
+//   4  uint32 messageId
+//   8  uint32 bodyLength
+//  12  uint32 checksum
+// flags带kRpcFlagVarint时messageId和bodyLength改用varint(LEB128)编码，
+// 消息头缩短为10~18字节，其余字段位置不变。
+const uint16_t kRpcMagic = 0x5052;
+const uint8_t kRpcVersion = 3;        // 当前版本，校验和为CRC32C
+const uint8_t kRpcLegacyVersion = 2;  // 旧版本，校验和为31进制累加哈希，仍然可以收发
+const size_t kRpcFixedHeaderLength = 16;
+const size_t kRpcMaxHeaderLength = 18;
+
+// 消息头标志位
+enum RpcHeaderFlag : uint8_t {
+    kRpcFlagCompressed = 0x01,  // 消息体经过压缩，格式见RpcCompression.h
+    kRpcFlagStream = 0x02,      // 请求帧带这个标志表示打开一个流，messageId就是流的id
+    kRpcFlagVarint = 0x04,      // messageId和bodyLength用varint编码
+    kRpcFlagNoChecksum = 0x08   // 不计算校验和，checksum字段为0，只用于可信的本机连接
+};
+
+// 解码后的消息头，只是普通的值，不和线上格式对应
 struct RpcMessageHeader {
-    uint32_t magic;          // 魔数，用于协议识别
-    uint32_t version;        // 协议版本
+    uint8_t version;         // 协议版本
     RpcMessageType type;     // 消息类型
+    uint8_t flags;           // RpcHeaderFlag的组合
     uint32_t messageId;      // 消息ID
     uint32_t bodyLength;     // 消息体长度
     uint32_t checksum;       // 校验和
-    uint64_t timestamp;      // 时间戳
     
     RpcMessageHeader() 
-        : magic(0x12345678), version(1), type(RpcMessageType::REQUEST),
-          messageId(0), bodyLength(0), checksum(0), timestamp(0) {}
+        : version(kRpcVersion), type(RpcMessageType::REQUEST), flags(0),
+          messageId(0), bodyLength(0), checksum(0) {}
+};
+
+// 把消息头编码到buf，buf至少kRpcMaxHeaderLength字节，返回写入的长度
+size_t encodeRpcHeader(const RpcMessageHeader& header, char* buf);
+
+// 直接从接收缓冲区里解析消息头，不要求对齐。
+// 返回消息头长度；数据还不够返回0；魔数、版本或varint不合法返回-1
+int decodeRpcHeader(const char* data, size_t len, RpcMessageHeader& header);
+
+// 消息体校验和，直接在缓冲区上计算。
+// kRpcLegacyVersion用旧的累加哈希，之后的版本都用CRC32C
+uint32_t rpcChecksum(uint8_t version, const char* data, size_t len);
+
+// 按消息头的版本和标志位计算消息体的校验和，带kRpcFlagNoChecksum时为0。
+// 编码时填进header.checksum，解码时和header.checksum比较
+uint32_t rpcFrameChecksum(const RpcMessageHeader& header, const char* body);
+
+// 流式调用。客户端发一个带kRpcFlagStream的REQUEST帧打开流，之后双方在同一条连接上
+// 用STREAM帧收发数据，服务端最后照常回一个RESPONSE帧(messageId为流的id)结束这个流。
+// STREAM帧的消息体第一个字节是下面的类型，后面是类型相关的内容，和编解码协议无关：
+//   DATA           一段数据，原样透传，长度计入对端的流量窗口
+//   HALF_CLOSE     客户端不再发送DATA
+//   CANCEL         客户端放弃这个流，服务端不再回复
+//   WINDOW_UPDATE  uint32小端，接收方又腾出了这么多字节，发送方窗口相应增加
+// 每个流每个方向的窗口初始都是kRpcStreamInitialWindow字节，
+// 发送方用完窗口就停下来等WINDOW_UPDATE，所以一个流占用的缓冲不会超过接收方给出的窗口
+enum class RpcStreamFrame : uint8_t {
+    DATA = 1,
+    HALF_CLOSE = 2,
+    CANCEL = 3,
+    WINDOW_UPDATE = 4
 };
 
+const uint32_t kRpcStreamInitialWindow = 64 * 1024;
+const uint32_t kRpcStreamMaxFrame = 64 * 1024;  // 一个DATA帧最多带的字节数
+
+// 编码一个STREAM帧，版本和标志位(varint、不算校验和)取自format
+std::string encodeRpcStreamFrame(const RpcMessageHeader& format, uint32_t streamId,
+                                 RpcStreamFrame kind, std::string_view payload);
+
+// 解析并校验一个完整的STREAM帧，payload指向帧内数据
+bool decodeRpcStreamFrame(std::string_view data, RpcMessageHeader& header,
+                          RpcStreamFrame& kind, std::string_view& payload);
+
 // RPC请求消息
 class RpcRequest {
 public:
@@ -56,8 +126,16 @@ public:
     void setParams(const std::string& params) { params_ = params; }
     void setTimeout(uint32_t timeout) { timeout_ = timeout; }
     
+    // 服务端分配的方法编号(见rpc.methods)，非0时线上只带编号不带方法名
+    void setMethodId(uint32_t id) { methodId_ = id; }
+    
+    // 打开流的请求，编码时消息头带kRpcFlagStream
+    void setStream(bool stream) { stream_ = stream; }
+    bool isStream() const { return stream_; }
+    
     uint32_t getMessageId() const { return messageId_; }
     const std::string& getMethod() const { return method_; }
+    uint32_t getMethodId() const { return methodId_; }
     const std::string& getParams() const { return params_; }
     uint32_t getTimeout() const { return timeout_; }
     
@@ -69,6 +147,8 @@ private:
     uint32_t messageId_ = 0;
     std::string method_;
     std::string params_;
+    uint32_t methodId_ = 0;
+    bool stream_ = false;
     uint32_t timeout_ = 5000;  // 默认5秒超时
 };
 
@@ -80,12 +160,21 @@ public:
         : messageId_(messageId), result_(result), errorCode_(RpcErrorCode::SUCCESS) {}
     
     void setMessageId(uint32_t id) { messageId_ = id; }
-    void setResult(const std::string& result) { result_ = result; }
+    void setResult(std::string result) { result_ = std::move(result); }
     void setError(RpcErrorCode code, const std::string& message) {
         errorCode_ = code;
         errorMessage_ = message;
     }
     
+    // 响应沿用请求帧的版本和kRpcFlagNoChecksum，这样老版本的客户端也能收到
+    // 它认识的校验和。不设置(version为0)时用协议处理器自己的配置
+    void setFrameFormat(uint8_t version, uint8_t flags) {
+        frameVersion_ = version;
+        frameFlags_ = flags;
+    }
+    uint8_t getFrameVersion() const { return frameVersion_; }
+    uint8_t getFrameFlags() const { return frameFlags_; }
+    
     uint32_t getMessageId() const { return messageId_; }
     const std::string& getResult() const { return result_; }
     RpcErrorCode getErrorCode() const { return errorCode_; }
@@ -102,8 +191,28 @@ private:
     std::string result_;
     RpcErrorCode errorCode_ = RpcErrorCode::SUCCESS;
     std::string errorMessage_;
+    uint8_t frameVersion_ = 0;
+    uint8_t frameFlags_ = 0;
+};
+
+// 请求的零拷贝表示：method和params直接指向帧内的字节。
+// 只在解码所用的帧存活期间有效，需要保存的话自行拷贝
+struct RpcRequestView {
+    uint32_t messageId = 0;
+    uint32_t methodId = 0;    // 非0时按编号分发，method为空
+    std::string_view method;
+    std::string_view params;
 };
 
+// 内置方法，返回服务端的方法编号表，JSON对象{"方法名": 编号, ...}。
+// "rpc."开头的方法名按JSON-RPC 2.0的约定留给框架自己用
+const char* const kRpcMethodTableMethod = "rpc.methods";
+
+// 内置方法，协商这条连接上的压缩算法。params是按优先顺序排列的算法名数组，如["zstd","lz4"]，
+// 结果是服务端选中的算法名(JSON字符串)，都不支持时为"none"。
+// 之后双方发出的帧在消息体达到compress_threshold时用这个算法压缩
+const char* const kRpcCompressionMethod = "rpc.compression";
+
 // RPC协议处理器基类
 class RpcProtocolHandler : noncopyable {
 public:
@@ -118,14 +227,88 @@ public:
     // 解码请求
     virtual std::unique_ptr<RpcRequest> decodeRequest(const std::string& data) = 0;
     
+    // 解码成指向帧内数据的视图，不分配内存。
+    // 协议不支持、或者这一帧没法零拷贝解码(比如method里有转义字符)时返回false，
+    // 调用方应退回decodeRequest
+    virtual bool decodeRequestView(std::string_view data, RpcRequestView& view) { return false; }
+    
     // 解码响应
     virtual std::unique_ptr<RpcResponse> decodeResponse(const std::string& data) = 0;
     
+    // 批量消息：多个请求(或响应)编进一个BATCH帧，只有一个消息头、算一次校验和。
+    // messageId为0的请求是通知，服务端不在批量响应里回复它。
+    // 协议不支持批量时supportsBatch返回false，编码返回空串，解码返回false
+    virtual bool supportsBatch() const { return false; }
+    virtual std::string encodeRequestBatch(const std::vector<RpcRequest>& requests) { return std::string(); }
+    virtual std::string encodeResponseBatch(const std::vector<RpcResponse>& responses) { return std::string(); }
+    
+    // 解码批量请求，views按顺序指向帧内数据。个别元素没法零拷贝解码时完整解码到owned里，
+    // 对应的view指向owned中的字符串
+    virtual bool decodeRequestBatch(std::string_view data, std::vector<RpcRequestView>& views,
+                                    std::vector<std::unique_ptr<RpcRequest>>& owned) { return false; }
+    virtual bool decodeResponseBatch(std::string_view data, std::vector<RpcResponse>& responses) { return false; }
+    
     // 验证消息完整性
     virtual bool validateMessage(const std::string& data) = 0;
     
-    // 计算校验和
-    virtual uint32_t calculateChecksum(const std::string& data) = 0;
+    // 按编码使用的版本计算校验和，直接在调用方的缓冲区上计算
+    virtual uint32_t calculateChecksum(std::string_view data) = 0;
+    
+    // 编码时用varint表示messageId和bodyLength，小消息每帧能省几个字节。
+    // 只影响编码，解码时根据标志位自动识别
+    void setVarintHeader(bool on) {
+        headerFlags_ = on ? (headerFlags_ | kRpcFlagVarint) : (headerFlags_ & ~kRpcFlagVarint);
+    }
+    
+    // 编码时使用的协议版本。对端还是老版本时设为kRpcLegacyVersion，
+    // 解码时两个版本都接受
+    void setHeaderVersion(uint8_t version) { headerVersion_ = version; }
+    
+    // 编码时不计算校验和，只在可信的本机连接上打开。
+    // 对端按标志位跳过校验，服务端的响应也会跟着跳过
+    void setSkipChecksum(bool on) {
+        headerFlags_ = on ? (headerFlags_ | kRpcFlagNoChecksum) : (headerFlags_ & ~kRpcFlagNoChecksum);
+    }
+    
+    // 编码时使用的版本和标志位，STREAM帧照这个格式编码
+    RpcMessageHeader headerFormat() const {
+        RpcMessageHeader header;
+        fillHeaderFormat(header);
+        return header;
+    }
+
+protected:
+    uint8_t headerVersion_ = kRpcVersion;
+    uint8_t headerFlags_ = 0;
+    
+    // 按处理器的配置填写消息头的版本和标志位
+    void fillHeaderFormat(RpcMessageHeader& header) const {
+        header.version = headerVersion_;
+        header.flags |= headerFlags_;
+    }
+    
+    void fillHeaderFormat(RpcMessageHeader& header, const RpcRequest& request) const {
+        fillHeaderFormat(header);
+        if (request.isStream()) {
+            header.flags |= kRpcFlagStream;
+        }
+    }
+    
+    // 响应优先沿用请求帧的格式
+    void fillHeaderFormat(RpcMessageHeader& header, const RpcResponse& response) const {
+        fillHeaderFormat(header);
+        if (response.getFrameVersion() != 0) {
+            header.version = response.getFrameVersion();
+            header.flags = (header.flags & ~kRpcFlagNoChecksum) |
+                           (response.getFrameFlags() & kRpcFlagNoChecksum);
+        }
+    }
+    
+    // 填好header的长度和校验和，拼出完整的帧，版本和标志位由调用方先填好
+    std::string buildFrame(RpcMessageHeader& header, const std::string& body);
+    
+    // 解析并校验一个完整的帧，成功时返回消息头和指向帧内消息体的视图
+    bool parseFrame(std::string_view data, RpcMessageHeader& header, std::string_view& body);
 };
 
 // 协议工厂类
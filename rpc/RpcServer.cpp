@@ -1,15 +1,36 @@
 #include "RpcServer.h"
 #include "JsonProtocolHandler.h"
+#include "RpcCompression.h"
+#include "../Trace.h"
 #include "../base/Logging.h"
+#include <algorithm>
 #include <chrono>
+#include <json/json.h>
 
-RpcServer::RpcServer(EventLoop* loop, int port) 
-    : loop_(loop), server_(std::make_unique<Server>(loop, 4, port)) {
+RpcServer::RpcServer(EventLoop* loop, int port)
+    : RpcServer(loop, std::make_unique<Server>(loop, 4, port)) {
+    LOG << "RpcServer created on port " << port;
+}
+
+RpcServer::RpcServer(EventLoop* loop, const std::string& unixPath)
+    : RpcServer(loop, std::make_unique<Server>(loop, 4, unixPath)) {
+    LOG << "RpcServer created on " << unixPath;
+}
+
+RpcServer::RpcServer(EventLoop* loop, std::unique_ptr<Server> server)
+    : loop_(loop), server_(std::move(server)), methodTable_(1) {
     
     // 设置默认协议处理器
     protocolHandler_ = std::make_unique<JsonProtocolHandler>();
     
-    LOG << "RpcServer created on port " << port;
+    // 内置方法，客户端连上之后调用它换取方法编号
+    registerMethod(kRpcMethodTableMethod, [this](const std::string&) { return methodTableJson(); });
+    
+    // 新连接交给RpcConnection，而不是默认的HttpData
+    server_->setNewConnCallback(
+        [this](EventLoop* ioLoop, int fd, const struct sockaddr_in& peer) {
+            handleNewConnection(ioLoop, fd, peer);
+        });
 }
 
 RpcServer::~RpcServer() {
@@ -18,87 +39,456 @@ RpcServer::~RpcServer() {
 
 void RpcServer::start() {
     LOG << "Starting RPC Server...";
+    // 配置文件一般在构造之后才加载，所以工作线程池到这里才创建。
+    // 排队总数上限按每个线程worker_queue_size算
+    const RpcConfig& config = RpcConfig::getInstance();
+    if (!workerPool_ && config.getWorkerThreads() > 0 && config.getWorkerQueueSize() > 0) {
+        size_t maxQueued = static_cast<size_t>(config.getWorkerThreads()) * config.getWorkerQueueSize();
+        workerPool_ = std::make_unique<WorkStealingPool>(config.getWorkerThreads(), maxQueued, "RpcWorker");
+        workerPool_->start();
+    }
+    compressThreshold_ = static_cast<size_t>(std::max(config.getCompressThreshold(), 0));
     server_->start();
 }
 
 void RpcServer::stop() {
     LOG << "Stopping RPC Server...";
-    // 服务器停止逻辑
+    // 已经排队的POOLED请求执行完再返回，响应照常投递给各自的IO线程
+    if (workerPool_) {
+        workerPool_->stop();
+    }
 }
 
-void RpcServer::registerMethod(const std::string& methodName, RpcMethodHandler handler) {
-    methods_[methodName] = handler;
-    LOG << "Registered RPC method: " << methodName;
+uint32_t RpcServer::registerMethod(const std::string& methodName, RpcMethodHandler handler,
+                                   RpcExecution execution) {
+    return addMethod(methodName, MethodEntry{methodName, std::move(handler), nullptr, execution, nullptr});
+}
+
+uint32_t RpcServer::registerViewMethod(const std::string& methodName, RpcViewMethodHandler handler,
+                                       RpcExecution execution) {
+    return addMethod(methodName, MethodEntry{methodName, nullptr, std::move(handler), execution, nullptr});
+}
+
+uint32_t RpcServer::registerStreamMethod(const std::string& methodName, RpcStreamMethodHandler handler) {
+    return addMethod(methodName,
+                     MethodEntry{methodName, nullptr, nullptr, RpcExecution::POOLED, std::move(handler)});
+}
+
+uint32_t RpcServer::addMethod(const std::string& methodName, MethodEntry entry) {
+    auto it = methodIds_.find(methodName);
+    uint32_t methodId;
+    if (it != methodIds_.end()) {
+        methodId = it->second;
+        methodTable_[methodId] = std::move(entry);
+    } else {
+        methodId = static_cast<uint32_t>(methodTable_.size());
+        methodTable_.push_back(std::move(entry));
+        methodIds_[methodName] = methodId;
+    }
+    LOG << "Registered RPC method: " << methodName << " #" << methodId;
+    return methodId;
 }
 
 void RpcServer::unregisterMethod(const std::string& methodName) {
-    auto it = methods_.find(methodName);
-    if (it != methods_.end()) {
-        methods_.erase(it);
+    auto it = methodIds_.find(methodName);
+    if (it != methodIds_.end() && methodTable_[it->second].registered()) {
+        MethodEntry& entry = methodTable_[it->second];
+        entry.handler = nullptr;
+        entry.viewHandler = nullptr;
+        entry.streamHandler = nullptr;
         LOG << "Unregistered RPC method: " << methodName;
     }
 }
 
+std::string RpcServer::methodTableJson() const {
+    Json::Value table(Json::objectValue);
+    for (size_t i = 1; i < methodTable_.size(); ++i) {
+        if (methodTable_[i].registered()) {
+            table[methodTable_[i].name] = static_cast<Json::UInt>(i);
+        }
+    }
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+    return Json::writeString(builder, table);
+}
+
 void RpcServer::setProtocolHandler(std::unique_ptr<RpcProtocolHandler> handler) {
     protocolHandler_ = std::move(handler);
     LOG << "Protocol handler updated";
 }
 
-void RpcServer::handleNewConnection(std::shared_ptr<Channel> channel) {
-    // 设置读取回调处理RPC请求
-    channel->setReadHandler([this, channel]() {
-        // 读取数据并处理RPC请求
-        // 这里需要与现有的HttpData集成
+void RpcServer::handleNewConnection(EventLoop* loop, int fd, const struct sockaddr_in& peer) {
+    auto conn = std::make_shared<RpcConnection>(loop, fd, peer);
+    conn->setFrameCallback([this](const RpcConnectionPtr& c, std::string_view frame) {
+        handleRpcRequest(c, frame);
     });
+    conn->setCloseCallback([this](const RpcConnectionPtr& c) { removeConnection(c); });
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex_);
+        connections_[fd] = conn;
+    }
+    loop->queueInLoop(std::bind(&RpcConnection::connectEstablished, conn));
+}
+
+void RpcServer::removeConnection(const RpcConnectionPtr& conn) {
+    // 还在执行的流方法阻塞在read/write上的话，让它们返回
+    for (auto& item : conn->streams()) {
+        item.second->onAbort();
+    }
+    conn->streams().clear();
+    
+    std::lock_guard<std::mutex> lock(connectionsMutex_);
+    auto it = connections_.find(conn->getFd());
+    if (it != connections_.end() && it->second == conn) {
+        connections_.erase(it);
+    }
+}
+
+void RpcServer::handleRpcRequest(const RpcConnectionPtr& conn, std::string_view data) {
+    auto startTime = std::chrono::steady_clock::now();
+    
+    // 帧头已经由RpcFrameDecoder检查过，这里只为了拿到版本和标志位，响应沿用同样的格式
+    RpcMessageHeader header;
+    decodeRpcHeader(data.data(), data.size(), header);
+    
+    // 压缩过的帧先整帧解开，后面的解码照常进行；响应的格式仍然按原来的header
+    std::string inflated;
+    if (header.flags & kRpcFlagCompressed) {
+        if (!decompressRpcFrame(data, inflated)) {
+            RpcResponse errorResponse;
+            errorResponse.setError(RpcErrorCode::PARSE_ERROR, "Failed to decompress request");
+            errorResponse.setFrameFormat(header.version, header.flags);
+            sendRpcResponse(conn, errorResponse);
+            updateStatistics(false, 0.0);
+            return;
+        }
+        data = inflated;
+    }
+    
+    if (header.type == RpcMessageType::BATCH) {
+        handleRpcBatch(conn, data, header);
+        return;
+    }
+    if (header.type == RpcMessageType::STREAM) {
+        handleStreamFrame(conn, data);
+        return;
+    }
+    
+    // 解码请求：优先在帧上原地解析，协议处理器不支持(或JSON里method带转义)时
+    // 再走完整解码，此时view指向request里的字符串
+    RpcRequestView view;
+    std::unique_ptr<RpcRequest> request;
+    if (!protocolHandler_->decodeRequestView(data, view)) {
+        request = protocolHandler_->decodeRequest(std::string(data));
+        if (!request) {
+            RpcResponse errorResponse;
+            errorResponse.setError(RpcErrorCode::PARSE_ERROR, "Failed to parse request");
+            errorResponse.setFrameFormat(header.version, header.flags);
+            sendRpcResponse(conn, errorResponse);
+            updateStatistics(false, 0.0);
+            return;
+        }
+        view.messageId = request->getMessageId();
+        view.methodId = request->getMethodId();
+        view.method = request->getMethod();
+        view.params = request->getParams();
+    }
+    
+    RpcResponse response;
+    const MethodEntry* pooled = runMethod(conn, view, response);
+    if (pooled && pooled->streamHandler) {
+        startStream(conn, view, header, *pooled, startTime);
+        return;
+    }
+    if (pooled) {
+        // params指向接收缓冲区，只在这次回调里有效，交给工作线程前要拷贝；
+        // entry也拷一份，执行期间方法被取消注册也不受影响
+        uint32_t messageId = view.messageId;
+        uint8_t version = header.version;
+        uint8_t flags = header.flags;
+        bool queued = workerPool_->submit(
+            [this, conn, entry = *pooled, messageId, params = std::string(view.params), version, flags,
+             startTime]() {
+                RpcResponse response = invokeMethod(messageId, entry, params);
+                response.setFrameFormat(version, flags);
+                finishRequest(conn, response, startTime);
+            });
+        if (queued) {
+            return;
+        }
+        response.setMessageId(messageId);
+        response.setError(RpcErrorCode::SERVER_BUSY, "Server busy");
+    }
+    
+    response.setFrameFormat(header.version, header.flags);
+    finishRequest(conn, response, startTime);
+}
+
+const RpcServer::MethodEntry* RpcServer::runMethod(const RpcConnectionPtr& conn, const RpcRequestView& view,
+                                                   RpcResponse& response) {
+    // 协商压缩要改连接的状态，不走方法表
+    if (view.methodId == 0 && view.method == kRpcCompressionMethod) {
+        response = negotiateCompression(conn, view);
+        return nullptr;
+    }
+    
+    // 带编号的请求直接下标访问；按名字调用时方法名一般很短，构造查找用的key不会分配内存(SSO)
+    const MethodEntry* found = nullptr;
+    if (view.methodId != 0) {
+        if (view.methodId < methodTable_.size()) {
+            found = &methodTable_[view.methodId];
+        }
+    } else {
+        auto it = methodIds_.find(std::string(view.method));
+        if (it != methodIds_.end()) {
+            found = &methodTable_[it->second];
+        }
+    }
+    
+    // 没有探针时TRACE3展开为空，方法名直接写在参数里，不留只给探针用的变量
+    TRACE3(rpc_request, view.messageId,
+           found ? found->name.data() : view.method.data(),
+           found ? found->name.size() : view.method.size());
+    
+    if (!found || !found->registered()) {
+        response.setMessageId(view.messageId);
+        if (view.methodId != 0) {
+            response.setError(RpcErrorCode::METHOD_NOT_FOUND,
+                              "Method #" + std::to_string(view.methodId) + " not found");
+        } else {
+            response.setError(RpcErrorCode::METHOD_NOT_FOUND,
+                              "Method '" + std::string(view.method) + "' not found");
+        }
+        return nullptr;
+    }
+    
+    const MethodEntry& entry = *found;
+    if (entry.streamHandler || (entry.execution == RpcExecution::POOLED && workerPool_)) {
+        return &entry;
+    }
+    response = invokeMethod(view.messageId, entry, view.params);
+    return nullptr;
+}
+
+void RpcServer::startStream(const RpcConnectionPtr& conn, const RpcRequestView& view,
+                            const RpcMessageHeader& header, const MethodEntry& entry,
+                            std::chrono::steady_clock::time_point startTime) {
+    uint32_t streamId = view.messageId;
+    RpcResponse response;
+    response.setMessageId(streamId);
+    response.setFrameFormat(header.version, header.flags);
+    
+    if (!(header.flags & kRpcFlagStream)) {
+        response.setError(RpcErrorCode::INVALID_REQUEST, "Method '" + entry.name + "' is a stream method");
+    } else if (!workerPool_) {
+        response.setError(RpcErrorCode::INTERNAL_ERROR, "Stream methods need worker threads");
+    } else if (streamId == 0 || conn->streams().count(streamId)) {
+        response.setError(RpcErrorCode::INVALID_REQUEST, "Invalid stream id");
+    } else {
+        // STREAM帧沿用打开流的请求帧的版本和标志位
+        auto stream = std::make_shared<RpcStream>(
+            streamId, header, static_cast<uint32_t>(RpcConfig::getInstance().getStreamWindow()),
+            [this, conn](std::string frame) { sendFrame(conn, std::move(frame)); });
+        uint8_t version = header.version;
+        uint8_t flags = header.flags;
+        bool queued = workerPool_->submit(
+            [this, conn, stream, entry, params = std::string(view.params), version, flags, startTime]() {
+                RpcResponse response;
+                response.setMessageId(stream->id());
+                try {
+                    response.setResult(entry.streamHandler(params, *stream));
+                } catch (const std::exception& e) {
+                    response.setError(RpcErrorCode::INTERNAL_ERROR, e.what());
+                }
+                if (stream->cancelled()) {
+                    response.setError(RpcErrorCode::CANCELLED, "Stream cancelled");
+                }
+                response.setFrameFormat(version, flags);
+                
+                conn->getLoop()->runInLoop([conn, stream]() {
+                    auto it = conn->streams().find(stream->id());
+                    if (it != conn->streams().end() && it->second == stream) {
+                        conn->streams().erase(it);
+                    }
+                });
+                // 客户端取消了或者连接已经断开，不用回复
+                if (stream->aborted()) {
+                    recordRequest(response, startTime);
+                    return;
+                }
+                finishRequest(conn, response, startTime);
+            });
+        if (queued) {
+            // 在IO线程里登记，客户端的STREAM帧也在这个线程里处理，不会早于登记
+            conn->streams()[streamId] = stream;
+            stream->announceWindow();
+            return;
+        }
+        response.setError(RpcErrorCode::SERVER_BUSY, "Server busy");
+    }
+    finishRequest(conn, response, startTime);
+}
+
+void RpcServer::handleStreamFrame(const RpcConnectionPtr& conn, std::string_view data) {
+    RpcMessageHeader header;
+    RpcStreamFrame kind;
+    std::string_view payload;
+    if (!decodeRpcStreamFrame(data, header, kind, payload)) {
+        LOG << "Invalid stream frame";
+        return;
+    }
+    
+    // 流已经结束时迟到的帧直接丢掉
+    auto it = conn->streams().find(header.messageId);
+    if (it == conn->streams().end()) {
+        return;
+    }
+    RpcStreamPtr stream = it->second;
+    if (kind == RpcStreamFrame::CANCEL) {
+        conn->streams().erase(it);
+    }
+    if (!stream->onFrame(kind, payload)) {
+        // 超出窗口之类的协议错误，取消这个流，处理函数返回后回复CANCELLED
+        LOG << "Cancelling stream " << header.messageId << " after a bad frame";
+        stream->cancel();
+    }
 }
 
-void RpcServer::handleRpcRequest(std::shared_ptr<Channel> channel, const std::string& data) {
+void RpcServer::handleRpcBatch(const RpcConnectionPtr& conn, std::string_view data,
+                               const RpcMessageHeader& header) {
     auto startTime = std::chrono::steady_clock::now();
     
-    // 解码请求
-    auto request = protocolHandler_->decodeRequest(data);
-    if (!request) {
+    std::vector<RpcRequestView> views;
+    std::vector<std::unique_ptr<RpcRequest>> owned;
+    if (!protocolHandler_->decodeRequestBatch(data, views, owned)) {
         RpcResponse errorResponse;
-        errorResponse.setError(RpcErrorCode::PARSE_ERROR, "Failed to parse request");
-        sendRpcResponse(channel, errorResponse);
+        errorResponse.setError(RpcErrorCode::PARSE_ERROR, "Failed to parse batch request");
+        errorResponse.setFrameFormat(header.version, header.flags);
+        sendRpcResponse(conn, errorResponse);
         updateStatistics(false, 0.0);
         return;
     }
     
-    // 处理方法调用
-    RpcResponse response = processMethodCall(*request);
+    auto batch = std::make_shared<BatchContext>();
+    batch->conn = conn;
+    batch->responses.resize(views.size());
+    batch->remaining = views.size();
+    batch->startTime = startTime;
+    batch->frameVersion = header.version;
+    batch->frameFlags = header.flags;
+    
+    for (size_t i = 0; i < views.size(); ++i) {
+        const RpcRequestView& view = views[i];
+        RpcResponse& response = batch->responses[i];
+        const MethodEntry* pooled = runMethod(conn, view, response);
+        if (pooled && pooled->streamHandler) {
+            // 流只能单独打开，不能放在批量里
+            response.setMessageId(view.messageId);
+            response.setError(RpcErrorCode::INVALID_REQUEST, "Method '" + pooled->name + "' is a stream method");
+            pooled = nullptr;
+        }
+        if (pooled) {
+            // 工作线程只写自己的槽，槽的地址在resize之后不再变化
+            uint32_t messageId = view.messageId;
+            bool queued = workerPool_->submit(
+                [this, batch, i, entry = *pooled, messageId, params = std::string(view.params)]() {
+                    batch->responses[i] = invokeMethod(messageId, entry, params);
+                    finishBatchItem(batch, i);
+                });
+            if (queued) {
+                continue;
+            }
+            response.setMessageId(messageId);
+            response.setError(RpcErrorCode::SERVER_BUSY, "Server busy");
+        }
+        finishBatchItem(batch, i);
+    }
+}
+
+void RpcServer::finishBatchItem(const std::shared_ptr<BatchContext>& batch, size_t index) {
+    recordRequest(batch->responses[index], batch->startTime);
     
-    // 发送响应
-    sendRpcResponse(channel, response);
+    // acq_rel保证最后一个完成的线程看得到其他线程写进各自槽里的响应
+    if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
     
-    // 更新统计信息
+    // JSON-RPC 2.0的约定：通知(messageId为0)不回复，整批都是通知时什么也不发
+    std::vector<RpcResponse> responses;
+    responses.reserve(batch->responses.size());
+    for (RpcResponse& response : batch->responses) {
+        if (response.getMessageId() != 0) {
+            // 响应沿用BATCH帧的版本和标志位
+            response.setFrameFormat(batch->frameVersion, batch->frameFlags);
+            responses.push_back(std::move(response));
+        }
+    }
+    if (responses.empty()) {
+        return;
+    }
+    sendFrame(batch->conn, protocolHandler_->encodeResponseBatch(responses));
+}
+
+void RpcServer::finishRequest(const RpcConnectionPtr& conn, const RpcResponse& response,
+                              std::chrono::steady_clock::time_point startTime) {
+    // 不在连接所属的IO线程时，send会把编好的数据投递过去
+    sendRpcResponse(conn, response);
+    recordRequest(response, startTime);
+}
+
+void RpcServer::recordRequest(const RpcResponse& response,
+                              std::chrono::steady_clock::time_point startTime) {
     auto endTime = std::chrono::steady_clock::now();
+    TRACE3(rpc_response, response.getMessageId(), response.isSuccess(),
+           std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime).count());
     double responseTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
     updateStatistics(response.isSuccess(), responseTime);
 }
 
-void RpcServer::sendRpcResponse(std::shared_ptr<Channel> channel, const RpcResponse& response) {
-    std::string encodedResponse = protocolHandler_->encodeResponse(response);
-    
-    // 通过channel发送响应
-    // 这里需要与现有的网络层集成
-    // channel->send(encodedResponse);
+void RpcServer::sendRpcResponse(const RpcConnectionPtr& conn, const RpcResponse& response) {
+    sendFrame(conn, protocolHandler_->encodeResponse(response));
+}
+
+void RpcServer::sendFrame(const RpcConnectionPtr& conn, std::string frame) {
+    compressRpcFrame(frame, conn->compression(), compressThreshold_);
+    conn->send(std::move(frame));
 }
 
-RpcResponse RpcServer::processMethodCall(const RpcRequest& request) {
+RpcResponse RpcServer::negotiateCompression(const RpcConnectionPtr& conn, const RpcRequestView& view) {
     RpcResponse response;
-    response.setMessageId(request.getMessageId());
+    response.setMessageId(view.messageId);
     
-    auto it = methods_.find(request.getMethod());
-    if (it == methods_.end()) {
-        response.setError(RpcErrorCode::METHOD_NOT_FOUND, 
-                         "Method '" + request.getMethod() + "' not found");
+    Json::Value names;
+    Json::Reader reader;
+    if (!reader.parse(view.params.data(), view.params.data() + view.params.size(), names) || !names.isArray()) {
+        response.setError(RpcErrorCode::INVALID_PARAMS, "Expected an array of compression names");
         return response;
     }
+    // 按客户端给的顺序选第一个编译进来的算法
+    RpcCompression chosen = RpcCompression::NONE;
+    for (const Json::Value& name : names) {
+        RpcCompression codec;
+        if (name.isString() && parseRpcCompression(name.asString(), codec) && rpcCompressionSupported(codec)) {
+            chosen = codec;
+            break;
+        }
+    }
+    conn->setCompression(chosen);
+    response.setResult(std::string("\"") + rpcCompressionName(chosen) + "\"");
+    return response;
+}
+
+RpcResponse RpcServer::invokeMethod(uint32_t messageId, const MethodEntry& entry,
+                                    std::string_view params) {
+    RpcResponse response;
+    response.setMessageId(messageId);
     
     try {
-        std::string result = it->second(request.getParams());
-        response.setResult(result);
+        if (entry.viewHandler) {
+            response.setResult(entry.viewHandler(params));
+        } else {
+            response.setResult(entry.handler(std::string(params)));
+        }
     } catch (const std::exception& e) {
         response.setError(RpcErrorCode::INTERNAL_ERROR, e.what());
     }
@@ -107,6 +497,7 @@ RpcResponse RpcServer::processMethodCall(const RpcRequest& request) {
 }
 
 void RpcServer::updateStatistics(bool success, double responseTime) {
+    std::lock_guard<std::mutex> lock(statisticsMutex_);
     statistics_.totalRequests++;
     if (success) {
         statistics_.successRequests++;
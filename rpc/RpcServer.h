@@ -1,19 +1,43 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <unordered_map>
 #include <memory>
+#include <string_view>
+#include <vector>
 #include "../EventLoop.h"
 #include "../Server.h"
+#include <mutex>
+#include "RpcConnection.h"
 #include "RpcProtocol.h"
 #include "RpcConfig.h"
+#include "../base/WorkStealingPool.h"
 
 // RPC方法处理函数类型
 using RpcMethodHandler = std::function<std::string(const std::string&)>;
 
+// 直接拿到帧内params的处理函数，省掉一次拷贝；params只在调用期间有效
+using RpcViewMethodHandler = std::function<std::string(std::string_view)>;
+
+// 流式方法：在工作线程里执行，通过stream边读客户端发来的数据、边写结果，
+// 返回值是流结束时最终响应的result
+using RpcStreamMethodHandler = std::function<std::string(const std::string& params, RpcStream& stream)>;
+
+// 方法在哪里执行。INLINE直接在收到请求的IO线程里执行，适合很快的方法；
+// POOLED交给工作线程池，执行完由连接所属的IO线程发送响应，慢方法不会拖住同一个loop上的其他连接。
+// 工作线程池满时POOLED方法不执行，直接回复SERVER_BUSY
+enum class RpcExecution {
+    INLINE,
+    POOLED
+};
+
 // RPC服务器类
 class RpcServer {
 public:
     RpcServer(EventLoop* loop, int port);
+    // 监听Unix域socket，给同机的调用方用。客户端可以在上面再换成共享内存环(见RpcShmTransport)
+    RpcServer(EventLoop* loop, const std::string& unixPath);
     ~RpcServer();
     
     // 启动RPC服务器
@@ -22,10 +46,19 @@ public:
     // 停止RPC服务器
     void stop();
     
-    // 注册RPC方法
-    void registerMethod(const std::string& methodName, RpcMethodHandler handler);
+    // 注册RPC方法，返回分配给它的方法编号(从1开始)，同名方法重复注册沿用原来的编号。
+    // 客户端通过内置方法rpc.methods拿到编号表后按编号调用，省掉按名字查找。
+    // POOLED的处理函数会在工作线程里并发调用，要自己保证线程安全
+    uint32_t registerMethod(const std::string& methodName, RpcMethodHandler handler,
+                            RpcExecution execution = RpcExecution::INLINE);
+    uint32_t registerViewMethod(const std::string& methodName, RpcViewMethodHandler handler,
+                                RpcExecution execution = RpcExecution::INLINE);
+    
+    // 注册流式方法，客户端用RpcClient::openStream调用。
+    // 处理函数总是在工作线程池里执行(worker_threads为0时拒绝打开流)，write在对端窗口用完时会阻塞
+    uint32_t registerStreamMethod(const std::string& methodName, RpcStreamMethodHandler handler);
     
-    // 取消注册RPC方法
+    // 取消注册RPC方法，编号保留，再次注册时还用它
     void unregisterMethod(const std::string& methodName);
     
     // 设置协议处理器
@@ -40,28 +73,110 @@ public:
         double avgResponseTime = 0.0;
     };
     
-    Statistics getStatistics() const { return statistics_; }
+    Statistics getStatistics() const {
+        std::lock_guard<std::mutex> lock(statisticsMutex_);
+        return statistics_;
+    }
 
 private:
     EventLoop* loop_;
     std::unique_ptr<Server> server_;
     std::unique_ptr<RpcProtocolHandler> protocolHandler_;
-    std::unordered_map<std::string, RpcMethodHandler> methods_;
+
+    // 三种处理函数只有一个非空，都为空表示已经取消注册
+    struct MethodEntry {
+        std::string name;
+        RpcMethodHandler handler;
+        RpcViewMethodHandler viewHandler;
+        RpcExecution execution = RpcExecution::INLINE;
+        RpcStreamMethodHandler streamHandler;
+        
+        bool registered() const { return handler || viewHandler || streamHandler; }
+    };
+    
+    // 按方法编号下标访问，0号不用；按名字调用时先在methodIds_里查编号
+    std::vector<MethodEntry> methodTable_;
+    std::unordered_map<std::string, uint32_t> methodIds_;
+    
+    RpcServer(EventLoop* loop, std::unique_ptr<Server> server);
+    
+    // 分配(或沿用)编号并填好表项
+    uint32_t addMethod(const std::string& methodName, MethodEntry entry);
+    
+    // rpc.methods的结果：{"方法名": 编号, ...}
+    std::string methodTableJson() const;
+    
+    // 消息体达到这个长度的响应按连接协商的算法压缩，start时从配置读取
+    size_t compressThreshold_ = 4096;
+    
+    // 执行POOLED方法，start时按worker_threads/worker_queue_size创建，没配置时为空
+    std::unique_ptr<WorkStealingPool> workerPool_;
+    
+    // 所有存活的连接，按fd索引；连接分布在各个IO线程，增删需要加锁
+    std::unordered_map<int, RpcConnectionPtr> connections_;
+    std::mutex connectionsMutex_;
     
-    // 统计信息
+    // 统计信息，各个IO线程都会更新
     mutable Statistics statistics_;
+    mutable std::mutex statisticsMutex_;
     
-    // 处理新连接
-    void handleNewConnection(std::shared_ptr<Channel> channel);
+    // 处理新连接，在accept线程里调用
+    void handleNewConnection(EventLoop* loop, int fd, const struct sockaddr_in& peer);
     
-    // 处理RPC请求
-    void handleRpcRequest(std::shared_ptr<Channel> channel, const std::string& data);
+    // 连接关闭，在连接所属的IO线程里调用
+    void removeConnection(const RpcConnectionPtr& conn);
+    
+    // 处理RPC请求，data是一个完整的帧
+    void handleRpcRequest(const RpcConnectionPtr& conn, std::string_view data);
+    
+    // 一个批量请求的执行状态。每个元素的响应写进自己的槽，POOLED的元素在工作线程里完成，
+    // remaining减到0的一方把整批响应编成一个BATCH帧发出去
+    struct BatchContext {
+        RpcConnectionPtr conn;
+        std::vector<RpcResponse> responses;
+        std::atomic<size_t> remaining;
+        std::chrono::steady_clock::time_point startTime;
+        uint8_t frameVersion;
+        uint8_t frameFlags;
+    };
+    
+    // 处理BATCH帧，元素按顺序分发，INLINE的方法在当前线程里依次执行
+    void handleRpcBatch(const RpcConnectionPtr& conn, std::string_view data,
+                        const RpcMessageHeader& header);
+    
+    // 批量里的一个元素完成了
+    void finishBatchItem(const std::shared_ptr<BatchContext>& batch, size_t index);
+    
+    // 按编号或名字查找方法。找不到时填好错误响应；INLINE的方法直接执行，结果写进response。
+    // 这两种情况返回nullptr；方法要交给工作线程池或者是流式方法时不执行，返回它的MethodEntry。
+    // 内置的rpc.compression也在这里处理
+    const MethodEntry* runMethod(const RpcConnectionPtr& conn, const RpcRequestView& view, RpcResponse& response);
+    
+    // rpc.compression：从客户端给的算法里选一个，之后发给这条连接的帧都用它压缩
+    RpcResponse negotiateCompression(const RpcConnectionPtr& conn, const RpcRequestView& view);
+    
+    // 打开流并交给工作线程执行，打不开时直接回复错误
+    void startStream(const RpcConnectionPtr& conn, const RpcRequestView& view, const RpcMessageHeader& header,
+                     const MethodEntry& entry, std::chrono::steady_clock::time_point startTime);
+    
+    // 处理STREAM帧，在连接所属的IO线程里调用
+    void handleStreamFrame(const RpcConnectionPtr& conn, std::string_view data);
     
     // 发送RPC响应
-    void sendRpcResponse(std::shared_ptr<Channel> channel, const RpcResponse& response);
+    void sendRpcResponse(const RpcConnectionPtr& conn, const RpcResponse& response);
+    
+    // 按连接协商的算法压缩后发送一个编好的帧，可以在任意线程调用
+    void sendFrame(const RpcConnectionPtr& conn, std::string frame);
+    
+    // 调用处理函数，异常转成INTERNAL_ERROR
+    RpcResponse invokeMethod(uint32_t messageId, const MethodEntry& entry, std::string_view params);
+    
+    // 发送响应并记录耗时，可以在工作线程里调用
+    void finishRequest(const RpcConnectionPtr& conn, const RpcResponse& response,
+                       std::chrono::steady_clock::time_point startTime);
     
-    // 处理方法调用
-    RpcResponse processMethodCall(const RpcRequest& request);
+    // 记录trace和统计信息
+    void recordRequest(const RpcResponse& response, std::chrono::steady_clock::time_point startTime);
     
     // 更新统计信息
     void updateStatistics(bool success, double responseTime);
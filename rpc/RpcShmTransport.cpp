@@ -0,0 +1,337 @@
+#include "RpcShmTransport.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace {
+
+const char kHelloMagic[8] = {'S', 'H', 'M', 'R', 'P', 'C', '0', '1'};
+const uint32_t kLayoutMagic = 0x4d485352;  // "RSHM"
+const uint32_t kLayoutVersion = 1;
+
+// 控制块占第一页，两个环的数据区从页边界开始
+const size_t kControlSize = 4096;
+const size_t kMinRingSize = 4096;
+const size_t kMaxRingSize = size_t(1) << 30;
+
+// 握手带过去的描述符：共享内存、服务端的eventfd、客户端的eventfd
+const size_t kFdCount = 3;
+
+// 一次read最多读这么多圈
+const size_t kMaxReadRounds = 4;
+
+void copyIn(char* ring, size_t size, uint64_t pos, const char* src, size_t n) {
+    size_t offset = static_cast<size_t>(pos & (size - 1));
+    size_t first = std::min(n, size - offset);
+    memcpy(ring + offset, src, first);
+    memcpy(ring, src + first, n - first);
+}
+
+void copyOut(char* dst, const char* ring, size_t size, uint64_t pos, size_t n) {
+    size_t offset = static_cast<size_t>(pos & (size - 1));
+    size_t first = std::min(n, size - offset);
+    memcpy(dst, ring + offset, first);
+    memcpy(dst + first, ring, n - first);
+}
+
+}  // namespace
+
+// 一个方向的控制块。位置只增不减，对容量取模得到数据区里的偏移。
+// 写端和读端各改各的缓存行，互不干扰
+struct RpcShmTransport::RingControl {
+    alignas(64) std::atomic<uint64_t> head;  // 写端写到哪里
+    alignas(64) std::atomic<uint64_t> tail;  // 读端读到哪里
+    alignas(64) std::atomic<uint32_t> readerWaiting;  // 读端读空了，在等eventfd
+    std::atomic<uint32_t> writerWaiting;              // 写端写满了，在等eventfd
+};
+
+struct RpcShmTransport::Layout {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ringSize;
+    RingControl rings[2];  // 0: 客户端到服务端，1: 服务端到客户端
+};
+
+// 两个进程通过同一块内存上的原子变量同步，必须是无锁实现
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm ring needs lock-free 64-bit atomics");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shm ring needs lock-free 32-bit atomics");
+
+RpcShmTransport::RpcShmTransport()
+    : layout_(nullptr), mapSize_(0), ringSize_(0), tx_(nullptr), rx_(nullptr), txData_(nullptr),
+      rxData_(nullptr), txHead_(0), rxTail_(0), memFd_(-1), localWakeFd_(-1), peerWakeFd_(-1) {}
+
+RpcShmTransport::~RpcShmTransport() {
+    if (layout_) {
+        munmap(layout_, mapSize_);
+    }
+    for (int fd : {memFd_, localWakeFd_, peerWakeFd_}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+std::unique_ptr<RpcShmTransport> RpcShmTransport::create(size_t ringSize) {
+    static_assert(sizeof(Layout) <= kControlSize, "shm control block exceeds one page");
+    std::unique_ptr<RpcShmTransport> transport(new RpcShmTransport());
+    transport->ringSize_ = kMinRingSize;
+    while (transport->ringSize_ < ringSize && transport->ringSize_ < kMaxRingSize) {
+        transport->ringSize_ <<= 1;
+    }
+    transport->mapSize_ = kControlSize + 2 * transport->ringSize_;
+
+    // 封上大小，服务端确认过之后客户端也没法再缩小它，否则服务端访问时会收到SIGBUS
+    transport->memFd_ = memfd_create("rpc-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (transport->memFd_ < 0 || ftruncate(transport->memFd_, static_cast<off_t>(transport->mapSize_)) < 0 ||
+        fcntl(transport->memFd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        return nullptr;
+    }
+    transport->localWakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    transport->peerWakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (transport->localWakeFd_ < 0 || transport->peerWakeFd_ < 0) {
+        return nullptr;
+    }
+
+    void* addr = mmap(nullptr, transport->mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, transport->memFd_, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    Layout* layout = new (addr) Layout();
+    layout->magic = kLayoutMagic;
+    layout->version = kLayoutVersion;
+    layout->ringSize = transport->ringSize_;
+    // 一开始两端都还没读过，当作都在等：对端第一次写就会唤醒它
+    for (RingControl& ring : layout->rings) {
+        ring.readerWaiting.store(1, std::memory_order_relaxed);
+    }
+    transport->layout_ = layout;
+    transport->map(false);
+    return transport;
+}
+
+ssize_t RpcShmTransport::receiveHello(int sockfd, std::string& buffer,
+                                      std::unique_ptr<RpcShmTransport>& transport) {
+    char data[kHelloLength];
+    struct iovec iov = {data, sizeof data};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int) * kFdCount)];
+    } control;
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    ssize_t n;
+    do {
+        n = recvmsg(sockfd, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return n;
+    }
+
+    // 先收下所有描述符，不用的全部关掉，不能漏在进程里
+    int fds[kFdCount];
+    size_t fdCount = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char* p = CMSG_DATA(cmsg);
+        for (size_t i = 0; i < count; ++i) {
+            int fd;
+            memcpy(&fd, p + i * sizeof(int), sizeof fd);
+            if (fdCount < kFdCount) {
+                fds[fdCount++] = fd;
+            } else {
+                close(fd);
+            }
+        }
+    }
+
+    bool hello = static_cast<size_t>(n) >= sizeof kHelloMagic && memcmp(data, kHelloMagic, sizeof kHelloMagic) == 0;
+    if (!hello || (msg.msg_flags & MSG_CTRUNC) || fdCount != kFdCount || static_cast<size_t>(n) != kHelloLength) {
+        for (size_t i = 0; i < fdCount; ++i) {
+            close(fds[i]);
+        }
+        if (hello || fdCount > 0 || (msg.msg_flags & MSG_CTRUNC)) {
+            errno = EPROTO;
+            return -1;
+        }
+        buffer.append(data, n);
+        return n;
+    }
+
+    // 共享内存是对端给的，大小和封印都要自己确认
+    std::unique_ptr<RpcShmTransport> attached(new RpcShmTransport());
+    attached->memFd_ = fds[0];
+    attached->localWakeFd_ = fds[1];
+    attached->peerWakeFd_ = fds[2];
+    uint64_t ringSize = 0;
+    for (int i = 0; i < 8; ++i) {
+        ringSize |= static_cast<uint64_t>(static_cast<unsigned char>(data[8 + i])) << (8 * i);
+    }
+    struct stat st;
+    int seals = fcntl(attached->memFd_, F_GET_SEALS);
+    bool valid = ringSize >= kMinRingSize && ringSize <= kMaxRingSize && (ringSize & (ringSize - 1)) == 0 &&
+                 fstat(attached->memFd_, &st) == 0 &&
+                 static_cast<uint64_t>(st.st_size) == kControlSize + 2 * ringSize &&
+                 seals >= 0 && (seals & F_SEAL_SHRINK);
+    // eventfd也是对端给的，万一是个阻塞的描述符，不能让它卡住loop线程
+    valid = valid && fcntl(attached->localWakeFd_, F_SETFL, O_NONBLOCK) == 0 &&
+            fcntl(attached->peerWakeFd_, F_SETFL, O_NONBLOCK) == 0;
+    if (valid) {
+        attached->ringSize_ = static_cast<size_t>(ringSize);
+        attached->mapSize_ = kControlSize + 2 * attached->ringSize_;
+        void* addr = mmap(nullptr, attached->mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, attached->memFd_, 0);
+        if (addr != MAP_FAILED) {
+            attached->layout_ = static_cast<Layout*>(addr);
+            valid = attached->layout_->magic == kLayoutMagic && attached->layout_->version == kLayoutVersion &&
+                    attached->layout_->ringSize == ringSize && attached->map(true);
+        } else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        errno = EPROTO;
+        return -1;
+    }
+    transport = std::move(attached);
+    return n;
+}
+
+bool RpcShmTransport::map(bool server) {
+    char* data = reinterpret_cast<char*>(layout_) + kControlSize;
+    int txRing = server ? 1 : 0;
+    tx_ = &layout_->rings[txRing];
+    rx_ = &layout_->rings[1 - txRing];
+    txData_ = data + txRing * ringSize_;
+    rxData_ = data + (1 - txRing) * ringSize_;
+    // 从对端当前的位置接着用，刚建好的环都是0
+    txHead_ = tx_->head.load(std::memory_order_acquire);
+    rxTail_ = rx_->tail.load(std::memory_order_acquire);
+    return txHead_ - tx_->tail.load(std::memory_order_acquire) <= ringSize_ &&
+           rx_->head.load(std::memory_order_acquire) - rxTail_ <= ringSize_;
+}
+
+bool RpcShmTransport::sendHello(int sockfd) const {
+    char data[kHelloLength];
+    memcpy(data, kHelloMagic, sizeof kHelloMagic);
+    for (int i = 0; i < 8; ++i) {
+        data[8 + i] = static_cast<char>(static_cast<uint64_t>(ringSize_) >> (8 * i));
+    }
+    // 客户端的peerWakeFd_就是服务端要等的那个
+    int fds[kFdCount] = {memFd_, peerWakeFd_, localWakeFd_};
+    struct iovec iov = {data, sizeof data};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof fds)];
+    } control;
+    memset(&control, 0, sizeof control);
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+
+    // 刚连上的socket发送缓冲是空的，16字节一次就能发完
+    ssize_t n;
+    do {
+        n = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(sizeof data);
+}
+
+void RpcShmTransport::clearWakeup() {
+    uint64_t count;
+    ssize_t n = ::read(localWakeFd_, &count, sizeof count);
+    (void)n;
+}
+
+void RpcShmTransport::wakePeer(std::atomic<uint32_t>& waiting) {
+    // 和对端"打标记、fence、再看一次"配对：要么对端再看时已经看到新位置，要么这里看到标记
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) && waiting.exchange(0, std::memory_order_relaxed)) {
+        uint64_t one = 1;
+        ssize_t n = ::write(peerWakeFd_, &one, sizeof one);
+        (void)n;
+    }
+}
+
+ssize_t RpcShmTransport::write(const char* data, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        uint64_t tail = tx_->tail.load(std::memory_order_acquire);
+        uint64_t used = txHead_ - tail;
+        if (used > ringSize_) {
+            return -1;
+        }
+        if (used == ringSize_) {
+            // 写满了：先打上等待标记再看一次，对端在这之间读走的话它一定看得到标记
+            tx_->writerWaiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tx_->tail.load(std::memory_order_acquire) == tail) {
+                break;
+            }
+            tx_->writerWaiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+        size_t n = std::min(static_cast<size_t>(ringSize_ - used), len - written);
+        copyIn(txData_, ringSize_, txHead_, data + written, n);
+        txHead_ += n;
+        written += n;
+        tx_->head.store(txHead_, std::memory_order_release);
+        wakePeer(tx_->readerWaiting);
+    }
+    return static_cast<ssize_t>(written);
+}
+
+ssize_t RpcShmTransport::read(std::string& buffer) {
+    size_t total = 0;
+    while (true) {
+        if (total >= kMaxReadRounds * ringSize_) {
+            // 让出loop线程，下一轮再接着读
+            uint64_t one = 1;
+            ssize_t n = ::write(localWakeFd_, &one, sizeof one);
+            (void)n;
+            break;
+        }
+        uint64_t head = rx_->head.load(std::memory_order_acquire);
+        uint64_t avail = head - rxTail_;
+        if (avail > ringSize_) {
+            return -1;
+        }
+        if (avail == 0) {
+            rx_->readerWaiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (rx_->head.load(std::memory_order_acquire) == head) {
+                break;
+            }
+            rx_->readerWaiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+        size_t n = static_cast<size_t>(avail);
+        size_t old = buffer.size();
+        buffer.resize(old + n);
+        copyOut(&buffer[old], rxData_, ringSize_, rxTail_, n);
+        rxTail_ += n;
+        total += n;
+        rx_->tail.store(rxTail_, std::memory_order_release);
+        wakePeer(rx_->writerWaiting);
+    }
+    return static_cast<ssize_t>(total);
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <sys/types.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "../base/noncopyable.h"
+
+// 同机RPC的共享内存传输(transport_type=SHM)。
+// 客户端用memfd建一块共享内存，里面是两个单生产者单消费者的字节环，每个方向一个，
+// 再建两个eventfd，分别用来唤醒服务端和客户端。连上服务端的Unix域socket之后，
+// 客户端先发一条握手消息，用SCM_RIGHTS把这三个描述符一起带过去；
+// 此后请求和响应都走环，socket上不再有数据，只用来发现对端关闭。
+// 环里传的字节和socket上的完全一样，两端照旧用RpcFrameDecoder切帧。
+// 读端读空、写端写满之后才打上等待标记，对端看到标记才写eventfd，
+// 所以对端正忙着的时候收发都不需要系统调用。
+// 对象只在所属连接的loop线程里使用
+class RpcShmTransport : noncopyable {
+public:
+    // 握手消息：8字节magic加8字节环容量(小端)
+    static const size_t kHelloLength = 16;
+
+    // 客户端：ringSize是每个方向的容量，向上取整到2的幂。失败返回nullptr
+    static std::unique_ptr<RpcShmTransport> create(size_t ringSize);
+
+    // 服务端：Unix域连接第一次可读时调用。对端发来的是握手消息时接上共享内存，结果放进transport；
+    // 不是的话读到的是普通的帧，追加到buffer。
+    // 返回读到的字节数，对端关闭返回0，出错返回-1(还没有数据时errno为EAGAIN，握手消息不对时为EPROTO)
+    static ssize_t receiveHello(int sockfd, std::string& buffer, std::unique_ptr<RpcShmTransport>& transport);
+
+    ~RpcShmTransport();
+
+    // 客户端：把握手消息和描述符发给服务端，要在socket上发出任何帧之前调用
+    bool sendHello(int sockfd) const;
+
+    // 本端的eventfd，可读表示对端写了数据或者读走了数据。
+    // 可读之后先clearWakeup再读写，之后对端的通知会让它重新可读
+    int wakeFd() const { return localWakeFd_; }
+    void clearWakeup();
+
+    // 把data尽量写进发送环，返回写入的字节数。写不下的部分等对端读走一些之后eventfd会可读。
+    // 对端改乱了读写位置时返回-1
+    ssize_t write(const char* data, size_t len);
+
+    // 把接收环里的数据追加到buffer，返回读到的字节数，出错返回-1。
+    // 对端一直在写的话一次最多读几圈就返回，并给自己记一次唤醒，免得占住loop线程
+    ssize_t read(std::string& buffer);
+
+    size_t ringSize() const { return ringSize_; }
+
+private:
+    struct RingControl;
+    struct Layout;
+
+    Layout* layout_;
+    size_t mapSize_;
+    size_t ringSize_;
+    RingControl* tx_;
+    RingControl* rx_;
+    char* txData_;
+    char* rxData_;
+    // 自己写的位置和读的位置在本地另存一份，共享内存里的只给对端看，对端改了也不影响这里
+    uint64_t txHead_;
+    uint64_t rxTail_;
+
+    int memFd_;
+    int localWakeFd_;
+    int peerWakeFd_;
+
+    RpcShmTransport();
+
+    // 映射memFd_，server决定用哪个环发送
+    bool map(bool server);
+
+    // 对端打了等待标记时写它的eventfd
+    void wakePeer(std::atomic<uint32_t>& waiting);
+};
@@ -0,0 +1,183 @@
+#include "RpcStream.h"
+#include <algorithm>
+
+RpcStream::RpcStream(uint32_t streamId, const RpcMessageHeader& format, uint32_t window,
+                     FrameSender sender)
+    : streamId_(streamId), format_(format), window_(std::max(window, kRpcStreamInitialWindow)),
+      sender_(std::move(sender)), sendWindow_(kRpcStreamInitialWindow), sendClosed_(false),
+      recvWindow_(kRpcStreamInitialWindow), unacked_(0), recvClosed_(false),
+      cancelled_(false), aborted_(false), finished_(false) {}
+
+bool RpcStream::write(std::string_view data) {
+    while (!data.empty()) {
+        size_t n;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return sendWindow_ > 0 || sendClosed_ || done(); });
+            if (sendClosed_ || done()) {
+                return false;
+            }
+            n = std::min<size_t>({data.size(), sendWindow_, kRpcStreamMaxFrame});
+            sendWindow_ -= static_cast<uint32_t>(n);
+        }
+        sendFrame(RpcStreamFrame::DATA, data.substr(0, n));
+        data.remove_prefix(n);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return !sendClosed_ && !done();
+}
+
+bool RpcStream::read(std::string& chunk) {
+    uint32_t increment = 0;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [this] { return !chunks_.empty() || recvClosed_ || done(); });
+        // 已经到达的数据在最终响应之后照样能读，取消或者断开之后就不要了
+        if (chunks_.empty() || cancelled_ || aborted_) {
+            return false;
+        }
+        chunk = std::move(chunks_.front());
+        chunks_.pop_front();
+
+        // 攒到半个窗口再还，免得每读一段就发一个WINDOW_UPDATE
+        unacked_ += static_cast<uint32_t>(chunk.size());
+        if (unacked_ >= window_ / 2 && !recvClosed_) {
+            increment = unacked_;
+            recvWindow_ += unacked_;
+            unacked_ = 0;
+        }
+    }
+    if (increment > 0) {
+        sendWindowUpdate(increment);
+    }
+    return true;
+}
+
+void RpcStream::closeSend() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (sendClosed_ || done()) {
+            return;
+        }
+        sendClosed_ = true;
+    }
+    cond_.notify_all();
+    sendFrame(RpcStreamFrame::HALF_CLOSE, std::string_view());
+}
+
+void RpcStream::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done()) {
+            return;
+        }
+        cancelled_ = true;
+        chunks_.clear();
+    }
+    cond_.notify_all();
+    sendFrame(RpcStreamFrame::CANCEL, std::string_view());
+    if (cancelCallback_) {
+        cancelCallback_();
+    }
+}
+
+RpcResponse RpcStream::finish() {
+    // 不读完的话服务端可能卡在窗口上，永远等不到最终响应
+    std::string chunk;
+    while (read(chunk)) {
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return finished_; });
+    return response_;
+}
+
+bool RpcStream::cancelled() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_;
+}
+
+bool RpcStream::aborted() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return aborted_;
+}
+
+void RpcStream::announceWindow() {
+    uint32_t increment;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        increment = window_ - kRpcStreamInitialWindow;
+        recvWindow_ += increment;
+    }
+    if (increment > 0) {
+        sendWindowUpdate(increment);
+    }
+}
+
+bool RpcStream::onFrame(RpcStreamFrame kind, std::string_view payload) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    switch (kind) {
+        case RpcStreamFrame::DATA:
+            if (payload.size() > recvWindow_ || recvClosed_) {
+                return false;
+            }
+            recvWindow_ -= static_cast<uint32_t>(payload.size());
+            if (!cancelled_ && !aborted_) {
+                chunks_.emplace_back(payload);
+            }
+            break;
+        case RpcStreamFrame::HALF_CLOSE:
+            recvClosed_ = true;
+            break;
+        case RpcStreamFrame::CANCEL:
+            aborted_ = true;
+            chunks_.clear();
+            break;
+        case RpcStreamFrame::WINDOW_UPDATE: {
+            if (payload.size() != 4) {
+                return false;
+            }
+            const uint8_t* p = reinterpret_cast<const uint8_t*>(payload.data());
+            uint32_t increment = static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                                 (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+            sendWindow_ += increment;
+            break;
+        }
+        default:
+            return false;
+    }
+    lock.unlock();
+    cond_.notify_all();
+    return true;
+}
+
+void RpcStream::onAbort() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        aborted_ = true;
+        chunks_.clear();
+    }
+    cond_.notify_all();
+}
+
+void RpcStream::onFinish(const RpcResponse& response) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (finished_) {
+            return;
+        }
+        finished_ = true;
+        recvClosed_ = true;
+        response_ = response;
+    }
+    cond_.notify_all();
+}
+
+void RpcStream::sendFrame(RpcStreamFrame kind, std::string_view payload) {
+    sender_(encodeRpcStreamFrame(format_, streamId_, kind, payload));
+}
+
+void RpcStream::sendWindowUpdate(uint32_t increment) {
+    char buf[4] = {static_cast<char>(increment), static_cast<char>(increment >> 8),
+                   static_cast<char>(increment >> 16), static_cast<char>(increment >> 24)};
+    sendFrame(RpcStreamFrame::WINDOW_UPDATE, std::string_view(buf, sizeof buf));
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "../base/noncopyable.h"
+#include "RpcProtocol.h"
+
+class RpcStream;
+using RpcStreamPtr = std::shared_ptr<RpcStream>;
+
+// 流式调用的一端。服务端的流方法拿到的、RpcClient::openStream返回的都是它，
+// 帧格式和流量控制见RpcProtocol.h里的RpcStreamFrame。
+// write/read/closeSend/cancel/finish由使用方的线程调用，可能阻塞，
+// 不能在连接所属的loop线程里调用；同一时间只能有一个线程写、一个线程读。
+// onFrame/onAbort/onFinish由loop线程在收到对应的帧或者连接断开时调用。
+// 收到的数据排在队列里，read取走之后才给对端还窗口，所以对端最多领先本端一个窗口
+class RpcStream : noncopyable {
+public:
+    // 发送一个编好的帧，可以在任意线程调用
+    using FrameSender = std::function<void(std::string frame)>;
+
+    // format提供STREAM帧的版本和标志位。window是本端的接收窗口，
+    // 比kRpcStreamInitialWindow大的部分在announceWindow时告诉对端
+    RpcStream(uint32_t streamId, const RpcMessageHeader& format, uint32_t window, FrameSender sender);
+
+    uint32_t id() const { return streamId_; }
+
+    // 写一段数据，超过对端窗口或者kRpcStreamMaxFrame时分成几帧，窗口用完就等WINDOW_UPDATE。
+    // 流已经结束、被取消或者已经closeSend时返回false
+    bool write(std::string_view data);
+
+    // 读下一段数据，段的边界就是对端DATA帧的边界。
+    // 对端不会再发数据、流被取消或者连接断开时返回false
+    bool read(std::string& chunk);
+
+    // 不再写数据，对端读完已经收到的数据后read返回false
+    void closeSend();
+
+    // 放弃这个流，本端阻塞的read/write都返回false，对端收到CANCEL。
+    // 客户端取消后服务端不再回复，finish返回CANCELLED
+    void cancel();
+
+    // 客户端用：丢掉还没读的数据，等服务端的最终响应
+    RpcResponse finish();
+
+    // 本端调用过cancel
+    bool cancelled() const;
+
+    // 对端取消或者连接断开
+    bool aborted() const;
+
+    // 客户端用：cancel时在发出CANCEL之后调用，用来结束等待中的请求
+    void setCancelCallback(std::function<void()> cb) { cancelCallback_ = std::move(cb); }
+
+    // ---- 以下由loop线程调用 ----
+
+    // 打开流之后调用一次，接收窗口比初始值大时发WINDOW_UPDATE
+    void announceWindow();
+
+    // 处理一个STREAM帧，对端违反协议(超出窗口、类型不对)时返回false
+    bool onFrame(RpcStreamFrame kind, std::string_view payload);
+
+    // 对端取消或者连接断开
+    void onAbort();
+
+    // 客户端收到最终响应(或者请求失败)，之后不会再有数据
+    void onFinish(const RpcResponse& response);
+
+private:
+    const uint32_t streamId_;
+    const RpcMessageHeader format_;
+    const uint32_t window_;
+    FrameSender sender_;
+    std::function<void()> cancelCallback_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+
+    // 发送方向：对端还允许发多少字节
+    uint32_t sendWindow_;
+    bool sendClosed_;
+
+    // 接收方向：已经收到还没读的数据，还允许对端发多少字节，读走了但还没还给对端的字节数
+    std::deque<std::string> chunks_;
+    uint32_t recvWindow_;
+    uint32_t unacked_;
+    bool recvClosed_;
+
+    bool cancelled_;
+    bool aborted_;
+    bool finished_;
+    RpcResponse response_;
+
+    bool done() const { return cancelled_ || aborted_ || finished_; }
+
+    void sendFrame(RpcStreamFrame kind, std::string_view payload);
+    void sendWindowUpdate(uint32_t increment);
+};
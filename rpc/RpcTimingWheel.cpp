@@ -0,0 +1,49 @@
+#include "RpcTimingWheel.h"
+
+RpcTimingWheel::RpcTimingWheel(int tickMs, size_t slotCount)
+    : tickMs_(tickMs), slots_(slotCount), current_(0), size_(0) {
+    for (RpcTimerNode& slot : slots_) {
+        slot.prev = &slot;
+        slot.next = &slot;
+    }
+}
+
+void RpcTimingWheel::add(RpcTimerNode* node, uint32_t timeoutMs) {
+    // 当前这一格已经走了一部分，多算一格保证不会提前到期
+    size_t ticks = timeoutMs / tickMs_ + 1;
+    node->rounds = static_cast<uint32_t>((ticks - 1) / slots_.size());
+
+    RpcTimerNode& slot = slots_[(current_ + ticks) % slots_.size()];
+    node->prev = slot.prev;
+    node->next = &slot;
+    slot.prev->next = node;
+    slot.prev = node;
+    ++size_;
+}
+
+void RpcTimingWheel::cancel(RpcTimerNode* node) {
+    if (!node->linked()) {
+        return;
+    }
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+    --size_;
+}
+
+void RpcTimingWheel::tick(std::vector<RpcTimerNode*>& expired) {
+    current_ = (current_ + 1) % slots_.size();
+    RpcTimerNode* slot = &slots_[current_];
+    RpcTimerNode* node = slot->next;
+    while (node != slot) {
+        RpcTimerNode* next = node->next;
+        if (node->rounds == 0) {
+            cancel(node);
+            expired.push_back(node);
+        } else {
+            --node->rounds;
+        }
+        node = next;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../base/noncopyable.h"
+
+// 挂在时间轮上的节点，需要定时的对象直接继承它，加入和取消都不分配内存
+struct RpcTimerNode {
+    RpcTimerNode* prev = nullptr;
+    RpcTimerNode* next = nullptr;
+    uint32_t rounds = 0;  // 还要再转几圈才到期
+
+    bool linked() const { return prev != nullptr; }
+};
+
+// 单层时间轮：slotCount个槽，每tickMs前进一格。
+// 超过一圈的超时用rounds计数，所以超时时长没有上限。
+// 加入、取消都是O(1)，tick只扫描当前槽。本身不加锁，也不管时钟，
+// 由使用者按自己的节奏(比如timerfd)调用tick。
+class RpcTimingWheel : noncopyable {
+public:
+    RpcTimingWheel(int tickMs, size_t slotCount);
+
+    int tickMs() const { return tickMs_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // 在timeoutMs之后、timeoutMs + tickMs之前到期。node不能已经在轮上
+    void add(RpcTimerNode* node, uint32_t timeoutMs);
+
+    // 从轮上摘下，没挂在轮上时什么都不做
+    void cancel(RpcTimerNode* node);
+
+    // 前进一格，到期的节点摘下来追加到expired
+    void tick(std::vector<RpcTimerNode*>& expired);
+
+private:
+    int tickMs_;
+    std::vector<RpcTimerNode> slots_;  // 每个槽是以自身为哨兵的双向循环链表
+    size_t current_;
+    size_t size_;
+};
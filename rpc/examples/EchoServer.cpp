@@ -11,15 +11,12 @@
 class EchoServer {
 public:
     EchoServer(int port) : loop_(), rpcServer_(&loop_, port) {
-        // 加载配置
-        RpcConfig::getInstance().loadConfig("../config/rpc_server.conf");
-        
-        // 设置协议处理器
-        auto protocolHandler = std::make_unique<JsonProtocolHandler>();
-        rpcServer_.setProtocolHandler(std::move(protocolHandler));
-        
-        // 注册RPC方法
-        registerMethods();
+        init();
+    }
+    
+    // 监听Unix域socket，同机的客户端用"unix:路径"连接
+    EchoServer(const std::string& unixPath) : loop_(), rpcServer_(&loop_, unixPath) {
+        init();
     }
     
     void start() {
@@ -32,9 +29,21 @@ private:
     EventLoop loop_;
     RpcServer rpcServer_;
     
+    void init() {
+        // 加载配置
+        RpcConfig::getInstance().loadConfig("../config/rpc_server.conf");
+        
+        // 设置协议处理器
+        auto protocolHandler = std::make_unique<JsonProtocolHandler>();
+        rpcServer_.setProtocolHandler(std::move(protocolHandler));
+        
+        // 注册RPC方法
+        registerMethods();
+    }
+    
     void registerMethods() {
         // 注册echo方法
-        rpcServer_.registerMethod("echo", [this](const std::string& params) -> std::string {
+        rpcServer_.registerViewMethod("echo", [this](std::string_view params) -> std::string {
             return handleEcho(params);
         });
         
@@ -43,14 +52,22 @@ private:
             return handleAdd(params);
         });
         
-        // 注册slow_operation方法（用于测试超时）
+        // 注册slow_operation方法（用于测试超时），放到工作线程里睡，不阻塞IO线程
         rpcServer_.registerMethod("slow_operation", [this](const std::string& params) -> std::string {
             return handleSlowOperation(params);
-        });
+        }, RpcExecution::POOLED);
         
         // 注册process_data方法（用于测试大数据处理）
         rpcServer_.registerMethod("process_data", [this](const std::string& params) -> std::string {
             return handleProcessData(params);
+        }, RpcExecution::POOLED);
+        
+        // 流式方法：generate_data分段返回size字节，process_stream边收边处理客户端上传的数据
+        rpcServer_.registerStreamMethod("generate_data", [this](const std::string& params, RpcStream& stream) {
+            return handleGenerateData(params, stream);
+        });
+        rpcServer_.registerStreamMethod("process_stream", [this](const std::string& params, RpcStream& stream) {
+            return handleProcessStream(stream);
         });
         
         // 注册get_server_info方法
@@ -59,11 +76,11 @@ private:
         });
     }
     
-    std::string handleEcho(const std::string& params) {
+    std::string handleEcho(std::string_view params) {
         Json::Value root;
         Json::Reader reader;
         
-        if (!reader.parse(params, root)) {
+        if (!reader.parse(params.data(), params.data() + params.size(), root)) {
             return createErrorResponse(-3, "Invalid JSON parameters");
         }
         
@@ -146,6 +163,51 @@ private:
         return Json::writeString(builder, response);
     }
     
+    std::string handleGenerateData(const std::string& params, RpcStream& stream) {
+        Json::Value root;
+        Json::Reader reader;
+        
+        if (!reader.parse(params, root) || !root["size"].isUInt64()) {
+            return createErrorResponse(-3, "Missing parameter 'size'");
+        }
+        
+        // 每次只生成一段，对端读得慢时write会等窗口，内存占用和总大小无关
+        uint64_t size = root["size"].asUInt64();
+        size_t chunkSize = root["chunk"].isUInt() && root["chunk"].asUInt() > 0 ? root["chunk"].asUInt() : 16384;
+        std::string chunk(chunkSize, 'x');
+        uint64_t sent = 0;
+        while (sent < size) {
+            size_t n = static_cast<size_t>(std::min<uint64_t>(chunkSize, size - sent));
+            if (!stream.write(std::string_view(chunk.data(), n))) {
+                break;
+            }
+            sent += n;
+        }
+        
+        Json::Value response;
+        response["sent"] = static_cast<Json::UInt64>(sent);
+        Json::StreamWriterBuilder builder;
+        return Json::writeString(builder, response);
+    }
+    
+    std::string handleProcessStream(RpcStream& stream) {
+        uint64_t dataSize = 0;
+        size_t checksum = 0;
+        std::string chunk;
+        while (stream.read(chunk)) {
+            dataSize += chunk.size();
+            checksum = checksum * 31 + std::hash<std::string>{}(chunk);
+        }
+        
+        Json::Value response;
+        response["processed"] = true;
+        response["data_size"] = static_cast<Json::UInt64>(dataSize);
+        response["checksum"] = static_cast<Json::UInt64>(checksum);
+        
+        Json::StreamWriterBuilder builder;
+        return Json::writeString(builder, response);
+    }
+    
     std::string handleGetServerInfo(const std::string& params) {
         auto stats = rpcServer_.getStatistics();
         
@@ -176,14 +238,17 @@ private:
 };
 
 int main(int argc, char* argv[]) {
-    int port = 8080;
-    if (argc > 1) {
-        port = std::atoi(argv[1]);
-    }
+    // 参数是端口号，或者带'/'的Unix域socket路径
+    std::string address = argc > 1 ? argv[1] : "8080";
     
     try {
-        EchoServer server(port);
-        server.start();
+        std::unique_ptr<EchoServer> server;
+        if (address.find('/') != std::string::npos) {
+            server = std::make_unique<EchoServer>(address);
+        } else {
+            server = std::make_unique<EchoServer>(std::atoi(address.c_str()));
+        }
+        server->start();
     } catch (const std::exception& e) {
         std::cerr << "Server error: " << e.what() << std::endl;
         return 1;
@@ -0,0 +1,724 @@
+// HTTP压测工具，用法类似wrk/wrk2：
+//   ./HttpBench -h 127.0.0.1 -p 8080 -c 100 -t 4 -d 10 -k -P 1
+//               -m /hello:8,/index.html:1,/missing:1 -R 20000
+// 不给-R时是闭环压测(收到响应立刻发下一个)，给了-R则按固定速率开环发送，
+// 延迟从"本该发送的时刻"算起，从而修正coordinated omission：
+// 服务端卡住时后面排队的请求也会计入等待时间，而不是被悄悄少发。
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+struct Config {
+  string host;
+  int port;
+  int connections;
+  int threads;
+  int duration;  // 秒
+  bool keepAlive;
+  int pipeline;
+  double rate;   // 总请求速率，0表示闭环
+  int timeout;   // 毫秒，单个请求超过这个时间按超时处理
+};
+
+struct RequestType {
+  string path;
+  int weight;
+  string request;  // 预先拼好的完整请求报文
+};
+
+int64_t nowMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// HdrHistogram风格的对数-线性直方图，单位微秒。
+// 每个2的幂区间再等分成64格，相对误差不超过1/64，
+// 记录是O(1)的数组自增，各线程各自一份，结束时合并。
+class Histogram {
+ public:
+  static const int kSubBits = 6;
+  static const int kSubHalf = 1 << kSubBits;  // 64
+  static const int kMaxShift = 40;
+  static const int kBuckets = kSubHalf * (kMaxShift + 2);
+
+  Histogram() : counts_(kBuckets, 0), total_(0), min_(INT64_MAX), max_(0),
+                sum_(0), sumSquares_(0) {}
+
+  void record(int64_t value) {
+    if (value < 0) value = 0;
+    ++counts_[indexOf(value)];
+    ++total_;
+    if (value < min_) min_ = value;
+    if (value > max_) max_ = value;
+    sum_ += static_cast<double>(value);
+    sumSquares_ += static_cast<double>(value) * value;
+  }
+
+  void merge(const Histogram& other) {
+    for (int i = 0; i < kBuckets; ++i) counts_[i] += other.counts_[i];
+    total_ += other.total_;
+    if (other.min_ < min_) min_ = other.min_;
+    if (other.max_ > max_) max_ = other.max_;
+    sum_ += other.sum_;
+    sumSquares_ += other.sumSquares_;
+  }
+
+  // 返回所在格子的上界，和HdrHistogram的highestEquivalentValue一致
+  int64_t percentile(double p) const {
+    if (total_ == 0) return 0;
+    uint64_t target = static_cast<uint64_t>(ceil(p / 100.0 * total_));
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= target) {
+        int64_t high = highestOf(i);
+        return high < max_ ? high : max_;
+      }
+    }
+    return max_;
+  }
+
+  uint64_t count() const { return total_; }
+  int64_t min() const { return total_ ? min_ : 0; }
+  int64_t max() const { return max_; }
+  double mean() const { return total_ ? sum_ / total_ : 0.0; }
+  double stddev() const {
+    if (total_ == 0) return 0.0;
+    double m = mean();
+    double var = sumSquares_ / total_ - m * m;
+    return var > 0 ? sqrt(var) : 0.0;
+  }
+
+ private:
+  static int indexOf(int64_t value) {
+    uint64_t v = static_cast<uint64_t>(value);
+    int msb = 63 - __builtin_clzll(v | (kSubHalf * 2 - 1));
+    int shift = msb - kSubBits;
+    if (shift > kMaxShift) return kBuckets - 1;
+    return shift * kSubHalf + static_cast<int>(v >> shift);
+  }
+  static int64_t highestOf(int index) {
+    int shift = index < kSubHalf * 2 ? 0 : index / kSubHalf - 1;
+    int64_t sub = index - shift * kSubHalf;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  vector<uint64_t> counts_;
+  uint64_t total_;
+  int64_t min_;
+  int64_t max_;
+  double sum_;
+  double sumSquares_;
+};
+
+struct Stats {
+  Stats()
+      : completed(0), bytesRead(0), status2xx(0), status3xx(0), status4xx(0),
+        status5xx(0), connectErrors(0), readErrors(0), writeErrors(0),
+        timeouts(0), closed(0), reconnects(0) {}
+
+  void merge(const Stats& other) {
+    latency.merge(other.latency);
+    uncorrected.merge(other.uncorrected);
+    completed += other.completed;
+    bytesRead += other.bytesRead;
+    status2xx += other.status2xx;
+    status3xx += other.status3xx;
+    status4xx += other.status4xx;
+    status5xx += other.status5xx;
+    connectErrors += other.connectErrors;
+    readErrors += other.readErrors;
+    writeErrors += other.writeErrors;
+    timeouts += other.timeouts;
+    closed += other.closed;
+    reconnects += other.reconnects;
+  }
+
+  Histogram latency;      // 开环时从计划发送时刻算起
+  Histogram uncorrected;  // 从实际发送时刻算起
+  uint64_t completed;
+  uint64_t bytesRead;
+  uint64_t status2xx, status3xx, status4xx, status5xx;
+  uint64_t connectErrors, readErrors, writeErrors, timeouts, closed;
+  uint64_t reconnects;
+};
+
+// 一个在途请求：计划发送时刻和实际发送时刻
+struct InFlight {
+  int64_t intended;
+  int64_t sent;
+};
+
+enum ConnState { kIdle, kConnecting, kConnected };
+
+struct Connection {
+  Connection()
+      : fd(-1), state(kIdle), head(0), count(0), nextSend(0), interval(0) {}
+
+  int fd;
+  ConnState state;
+  string outBuffer;
+  string inBuffer;
+  vector<InFlight> inflight;  // 容量为pipeline深度的环形队列
+  int head;
+  int count;
+  int64_t nextSend;  // 开环模式下下一个请求的计划时刻
+  int64_t interval;  // 开环模式下相邻请求的间隔(微秒)
+};
+
+const int kMaxEvents = 256;
+const int kReadSize = 64 * 1024;
+
+class Worker {
+ public:
+  Worker(const Config& config, const vector<RequestType>& mix,
+         const struct sockaddr_in& addr, int connections, unsigned seed)
+      : config_(config), mix_(mix), addr_(addr), conns_(connections),
+        epollFd_(-1), seed_(seed ? seed : 1), totalWeight_(0), stop_(0) {
+    for (size_t i = 0; i < mix_.size(); ++i) totalWeight_ += mix_[i].weight;
+  }
+
+  void run(int64_t start, int64_t deadline);
+  const Stats& stats() const { return stats_; }
+
+ private:
+  void connect(Connection& conn);
+  void closeConn(Connection& conn, bool error);
+  void fill(Connection& conn, int64_t now);
+  void flush(Connection& conn);
+  void onReadable(Connection& conn);
+  bool parseResponse(Connection& conn, bool eof);
+  void finishRequest(Connection& conn, int status);
+  void checkTimeouts(Connection& conn, int64_t now);
+  const RequestType& pick();
+  void updateEvents(Connection& conn);
+
+  const Config& config_;
+  const vector<RequestType>& mix_;
+  struct sockaddr_in addr_;
+  vector<Connection> conns_;
+  int epollFd_;
+  unsigned seed_;
+  int totalWeight_;
+  int64_t stop_;
+  Stats stats_;
+};
+
+const RequestType& Worker::pick() {
+  if (mix_.size() == 1) return mix_[0];
+  // xorshift32，够随机且不用加锁
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  int r = static_cast<int>(seed_ % totalWeight_);
+  for (size_t i = 0; i < mix_.size(); ++i) {
+    if (r < mix_[i].weight) return mix_[i];
+    r -= mix_[i].weight;
+  }
+  return mix_.back();
+}
+
+void Worker::connect(Connection& conn) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    ++stats_.connectErrors;
+    return;
+  }
+  int enable = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof enable);
+  int ret = ::connect(fd, (struct sockaddr*)&addr_, sizeof addr_);
+  if (ret < 0 && errno != EINPROGRESS) {
+    ++stats_.connectErrors;
+    close(fd);
+    return;
+  }
+  conn.fd = fd;
+  conn.state = kConnecting;
+  conn.inBuffer.clear();
+  conn.outBuffer.clear();
+  struct epoll_event event;
+  event.events = EPOLLOUT;
+  event.data.ptr = &conn;
+  epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event);
+}
+
+// 连接断开时在途的请求都拿不到响应了，算作错误
+void Worker::closeConn(Connection& conn, bool error) {
+  if (conn.fd >= 0) {
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn.fd, NULL);
+    close(conn.fd);
+  }
+  if (error) stats_.closed += conn.count;
+  conn.fd = -1;
+  conn.state = kIdle;
+  conn.head = 0;
+  conn.count = 0;
+  conn.inBuffer.clear();
+  conn.outBuffer.clear();
+}
+
+// 在pipeline深度允许的范围内把该发的请求都放进outBuffer
+void Worker::fill(Connection& conn, int64_t now) {
+  if (conn.state != kConnected || now >= stop_) return;
+  int depth = static_cast<int>(conn.inflight.size());
+  while (conn.count < depth) {
+    int64_t intended = now;
+    if (conn.interval > 0) {
+      if (conn.nextSend > now) break;
+      intended = conn.nextSend;
+      conn.nextSend += conn.interval;
+    }
+    conn.outBuffer += pick().request;
+    InFlight& slot = conn.inflight[(conn.head + conn.count) % depth];
+    slot.intended = intended;
+    slot.sent = now;
+    ++conn.count;
+  }
+}
+
+void Worker::updateEvents(Connection& conn) {
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  if (!conn.outBuffer.empty()) event.events |= EPOLLOUT;
+  event.data.ptr = &conn;
+  epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn.fd, &event);
+}
+
+void Worker::flush(Connection& conn) {
+  bool wasPending = !conn.outBuffer.empty();
+  size_t written = 0;
+  while (written < conn.outBuffer.size()) {
+    ssize_t n = write(conn.fd, conn.outBuffer.data() + written,
+                      conn.outBuffer.size() - written);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) break;
+      ++stats_.writeErrors;
+      closeConn(conn, true);
+      return;
+    }
+    written += n;
+  }
+  conn.outBuffer.erase(0, written);
+  if (wasPending != !conn.outBuffer.empty()) updateEvents(conn);
+}
+
+void Worker::finishRequest(Connection& conn, int status) {
+  int depth = static_cast<int>(conn.inflight.size());
+  const InFlight& slot = conn.inflight[conn.head];
+  conn.head = (conn.head + 1) % depth;
+  --conn.count;
+  int64_t now = nowMicros();
+  if (now > stop_) return;  // 压测结束之后到达的响应不计入
+  ++stats_.completed;
+  stats_.latency.record(now - slot.intended);
+  stats_.uncorrected.record(now - slot.sent);
+  if (status >= 200 && status < 300)
+    ++stats_.status2xx;
+  else if (status >= 300 && status < 400)
+    ++stats_.status3xx;
+  else if (status >= 400 && status < 500)
+    ++stats_.status4xx;
+  else
+    ++stats_.status5xx;
+}
+
+// 从inBuffer里解析出尽可能多的完整响应，返回false表示连接需要关闭
+bool Worker::parseResponse(Connection& conn, bool eof) {
+  size_t pos = 0;
+  bool keep = true;
+  while (conn.count > 0) {
+    size_t headerEnd = conn.inBuffer.find("\r\n\r\n", pos);
+    if (headerEnd == string::npos) break;
+    const char* begin = conn.inBuffer.data() + pos;
+    const char* end = conn.inBuffer.data() + headerEnd;
+    int status = 0;
+    if (end - begin > 12 && strncmp(begin, "HTTP/1.", 7) == 0)
+      status = atoi(begin + 9);
+    long contentLength = -1;
+    bool closeAfter = false;
+    // 逐行找Content-Length和Connection头
+    const char* line = static_cast<const char*>(memchr(begin, '\n', end - begin));
+    while (line && line < end) {
+      ++line;
+      if (end - line > 15 && strncasecmp(line, "Content-Length:", 15) == 0)
+        contentLength = atol(line + 15);
+      else if (end - line > 17 &&
+               strncasecmp(line, "Connection: close", 17) == 0)
+        closeAfter = true;
+      line = static_cast<const char*>(memchr(line, '\n', end - line));
+    }
+    size_t bodyStart = headerEnd + 4;
+    size_t total;
+    if (contentLength >= 0) {
+      total = bodyStart + contentLength;
+      if (conn.inBuffer.size() < total) break;
+    } else {
+      // 没有Content-Length，只能读到对端关闭为止
+      if (!eof) break;
+      total = conn.inBuffer.size();
+      closeAfter = true;
+    }
+    stats_.bytesRead += total - pos;
+    finishRequest(conn, status);
+    pos = total;
+    if (closeAfter || !config_.keepAlive) {
+      keep = false;
+      break;
+    }
+  }
+  conn.inBuffer.erase(0, pos);
+  return keep;
+}
+
+void Worker::onReadable(Connection& conn) {
+  char buf[kReadSize];
+  bool eof = false;
+  while (true) {
+    ssize_t n = read(conn.fd, buf, sizeof buf);
+    if (n > 0) {
+      conn.inBuffer.append(buf, n);
+      continue;
+    }
+    if (n == 0) {
+      eof = true;
+      break;
+    }
+    if (errno == EINTR) continue;
+    if (errno == EAGAIN) break;
+    ++stats_.readErrors;
+    closeConn(conn, true);
+    return;
+  }
+  bool keep = parseResponse(conn, eof);
+  if (!keep || eof) {
+    // 非keep-alive或服务端要求关闭：剩余在途请求作废，重新建连
+    closeConn(conn, true);
+    if (nowMicros() < stop_) {
+      ++stats_.reconnects;
+      connect(conn);
+    }
+    return;
+  }
+  fill(conn, nowMicros());
+  flush(conn);
+}
+
+void Worker::checkTimeouts(Connection& conn, int64_t now) {
+  if (conn.count == 0 || config_.timeout <= 0) return;
+  if (now - conn.inflight[conn.head].sent > config_.timeout * 1000LL) {
+    stats_.timeouts += conn.count;
+    conn.count = 0;
+    closeConn(conn, false);
+    if (now < stop_) {
+      ++stats_.reconnects;
+      connect(conn);
+    }
+  }
+}
+
+void Worker::run(int64_t start, int64_t deadline) {
+  stop_ = deadline;
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    perror("epoll_create1");
+    return;
+  }
+  int depth = config_.keepAlive ? config_.pipeline : 1;
+  int n = static_cast<int>(conns_.size());
+  for (int i = 0; i < n; ++i) {
+    Connection& conn = conns_[i];
+    conn.inflight.resize(depth);
+    if (config_.rate > 0) {
+      // 每个连接分摊总速率，起始时刻错开，避免所有连接同时发
+      double perConn = config_.rate / (config_.connections);
+      conn.interval = static_cast<int64_t>(1000000.0 / perConn);
+      if (conn.interval < 1) conn.interval = 1;
+      conn.nextSend = start + conn.interval * i / n;
+    }
+    connect(conn);
+  }
+
+  struct epoll_event events[kMaxEvents];
+  int64_t lastTimeoutCheck = start;
+  while (true) {
+    int64_t now = nowMicros();
+    if (now >= deadline) break;
+    // 开环模式下要按时唤醒去发下一批请求
+    int64_t wakeAt = deadline;
+    if (config_.rate > 0) {
+      for (int i = 0; i < n; ++i) {
+        const Connection& conn = conns_[i];
+        if (conn.state == kConnected && conn.count < depth &&
+            conn.nextSend < wakeAt)
+          wakeAt = conn.nextSend;
+      }
+    }
+    int waitMs = wakeAt > now ? static_cast<int>((wakeAt - now + 999) / 1000) : 0;
+    if (waitMs > 100) waitMs = 100;
+    int num = epoll_wait(epollFd_, events, kMaxEvents, waitMs);
+    if (num < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    for (int i = 0; i < num; ++i) {
+      Connection& conn = *static_cast<Connection*>(events[i].data.ptr);
+      if (conn.fd < 0) continue;
+      if (conn.state == kConnecting) {
+        int err = 0;
+        socklen_t len = sizeof err;
+        getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0 || (events[i].events & (EPOLLERR | EPOLLHUP))) {
+          ++stats_.connectErrors;
+          closeConn(conn, false);
+          continue;
+        }
+        conn.state = kConnected;
+        updateEvents(conn);
+        fill(conn, nowMicros());
+        flush(conn);
+        continue;
+      }
+      if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) onReadable(conn);
+      if (conn.fd >= 0 && (events[i].events & EPOLLOUT)) flush(conn);
+    }
+    now = nowMicros();
+    bool checkTimeout = now - lastTimeoutCheck > 10000;
+    if (checkTimeout) lastTimeoutCheck = now;
+    for (int i = 0; i < n; ++i) {
+      Connection& conn = conns_[i];
+      if (conn.state == kIdle) {
+        // 连接失败的稍后重试
+        if (checkTimeout && now < deadline) connect(conn);
+        continue;
+      }
+      if (checkTimeout) checkTimeouts(conn, now);
+      if (config_.rate > 0 && conn.state == kConnected) {
+        fill(conn, now);
+        flush(conn);
+      }
+    }
+  }
+  for (int i = 0; i < n; ++i) closeConn(conns_[i], false);
+  close(epollFd_);
+}
+
+bool parseMix(const string& spec, const Config& config,
+              vector<RequestType>& mix) {
+  size_t begin = 0;
+  while (begin < spec.size()) {
+    size_t end = spec.find(',', begin);
+    if (end == string::npos) end = spec.size();
+    string item = spec.substr(begin, end - begin);
+    begin = end + 1;
+    if (item.empty()) continue;
+    RequestType type;
+    type.weight = 1;
+    size_t colon = item.rfind(':');
+    if (colon != string::npos) {
+      type.weight = atoi(item.c_str() + colon + 1);
+      item = item.substr(0, colon);
+    }
+    if (item.empty() || item[0] != '/' || type.weight <= 0) return false;
+    type.path = item;
+    type.request = "GET " + item + " HTTP/1.1\r\nHost: " + config.host + ":" +
+                   to_string(config.port) + "\r\n";
+    type.request += config.keepAlive ? "Connection: Keep-Alive\r\n"
+                                     : "Connection: close\r\n";
+    type.request += "\r\n";
+    mix.push_back(type);
+  }
+  return !mix.empty();
+}
+
+void usage(const char* name) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  -h host        server address (default 127.0.0.1)\n"
+          "  -p port        server port (default 8080)\n"
+          "  -c conns       total connections (default 100)\n"
+          "  -t threads     worker threads (default 4)\n"
+          "  -d seconds     test duration (default 10)\n"
+          "  -k             use keep-alive (default: one request per connection)\n"
+          "  -P depth       pipelined requests per connection, needs -k (default 1)\n"
+          "  -m mix         request mix, path:weight[,path:weight...] "
+          "(default /hello:1)\n"
+          "  -R rate        total requests/sec, open loop with coordinated "
+          "omission correction (default: closed loop)\n"
+          "  -T ms          request timeout (default 2000)\n",
+          name);
+}
+
+void printLatency(const char* title, const Histogram& h) {
+  static const double kPercentiles[] = {50, 75, 90, 99, 99.9, 99.99, 100};
+  printf("  %s (us)\n", title);
+  printf("    mean %10.1f   stdev %10.1f   min %8lld   max %10lld\n", h.mean(),
+         h.stddev(), static_cast<long long>(h.min()),
+         static_cast<long long>(h.max()));
+  for (size_t i = 0; i < sizeof kPercentiles / sizeof kPercentiles[0]; ++i)
+    printf("    %8.3f%%  %10lld\n", kPercentiles[i],
+           static_cast<long long>(h.percentile(kPercentiles[i])));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  Config config;
+  config.host = "127.0.0.1";
+  config.port = 8080;
+  config.connections = 100;
+  config.threads = 4;
+  config.duration = 10;
+  config.keepAlive = false;
+  config.pipeline = 1;
+  config.rate = 0;
+  config.timeout = 2000;
+  string mixSpec = "/hello:1";
+
+  int opt;
+  const char* str = "h:p:c:t:d:kP:m:R:T:";
+  while ((opt = getopt(argc, argv, str)) != -1) {
+    switch (opt) {
+      case 'h':
+        config.host = optarg;
+        break;
+      case 'p':
+        config.port = atoi(optarg);
+        break;
+      case 'c':
+        config.connections = atoi(optarg);
+        break;
+      case 't':
+        config.threads = atoi(optarg);
+        break;
+      case 'd':
+        config.duration = atoi(optarg);
+        break;
+      case 'k':
+        config.keepAlive = true;
+        break;
+      case 'P':
+        config.pipeline = atoi(optarg);
+        break;
+      case 'm':
+        mixSpec = optarg;
+        break;
+      case 'R':
+        config.rate = atof(optarg);
+        break;
+      case 'T':
+        config.timeout = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (config.connections <= 0 || config.threads <= 0 || config.duration <= 0 ||
+      config.pipeline <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (config.threads > config.connections) config.threads = config.connections;
+  if (!config.keepAlive) config.pipeline = 1;
+
+  vector<RequestType> mix;
+  if (!parseMix(mixSpec, config, mix)) {
+    fprintf(stderr, "invalid request mix: %s\n", mixSpec.c_str());
+    return 1;
+  }
+
+  struct sockaddr_in addr;
+  bzero(&addr, sizeof addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<uint16_t>(config.port));
+  if (inet_pton(AF_INET, config.host.c_str(), &addr.sin_addr) != 1) {
+    struct hostent* host = gethostbyname(config.host.c_str());
+    if (host == NULL || host->h_addrtype != AF_INET) {
+      fprintf(stderr, "cannot resolve %s\n", config.host.c_str());
+      return 1;
+    }
+    memcpy(&addr.sin_addr, host->h_addr_list[0], sizeof addr.sin_addr);
+  }
+
+  printf("Running %ds test @ %s:%d\n", config.duration, config.host.c_str(),
+         config.port);
+  printf("  %d threads and %d connections, keep-alive %s, pipeline %d, ",
+         config.threads, config.connections, config.keepAlive ? "on" : "off",
+         config.pipeline);
+  if (config.rate > 0)
+    printf("open loop at %.0f req/s\n", config.rate);
+  else
+    printf("closed loop\n");
+
+  vector<Worker*> workers;
+  for (int i = 0; i < config.threads; ++i) {
+    // 连接尽量均分到各线程
+    int conns = config.connections / config.threads +
+                (i < config.connections % config.threads ? 1 : 0);
+    workers.push_back(new Worker(config, mix, addr, conns, 2463534242u + i));
+  }
+  int64_t start = nowMicros();
+  int64_t deadline = start + config.duration * 1000000LL;
+  vector<thread> threads;
+  for (int i = 0; i < config.threads; ++i)
+    threads.push_back(thread(&Worker::run, workers[i], start, deadline));
+  for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  double elapsed = (nowMicros() - start) / 1e6;
+
+  Stats total;
+  for (size_t i = 0; i < workers.size(); ++i) {
+    total.merge(workers[i]->stats());
+    delete workers[i];
+  }
+
+  if (config.rate > 0) {
+    printLatency("Latency, corrected for coordinated omission", total.latency);
+    printLatency("Latency, uncorrected (from actual send)", total.uncorrected);
+  } else {
+    printLatency("Latency", total.uncorrected);
+  }
+  printf("  %llu requests in %.2fs, %.2fMB read\n",
+         static_cast<unsigned long long>(total.completed), elapsed,
+         total.bytesRead / 1048576.0);
+  printf("  Status: 2xx %llu, 3xx %llu, 4xx %llu, 5xx/other %llu\n",
+         static_cast<unsigned long long>(total.status2xx),
+         static_cast<unsigned long long>(total.status3xx),
+         static_cast<unsigned long long>(total.status4xx),
+         static_cast<unsigned long long>(total.status5xx));
+  printf("  Errors: connect %llu, read %llu, write %llu, timeout %llu, "
+         "closed %llu, reconnects %llu\n",
+         static_cast<unsigned long long>(total.connectErrors),
+         static_cast<unsigned long long>(total.readErrors),
+         static_cast<unsigned long long>(total.writeErrors),
+         static_cast<unsigned long long>(total.timeouts),
+         static_cast<unsigned long long>(total.closed),
+         static_cast<unsigned long long>(total.reconnects));
+  printf("Requests/sec: %.2f\n", total.completed / elapsed);
+  printf("Transfer/sec: %.2fMB\n", total.bytesRead / 1048576.0 / elapsed);
+  return 0;
+}